@@ -0,0 +1,175 @@
+#!/usr/bin/env python3
+#
+# Copyright 2021 Michel Kremer (kremi151)
+#
+# Licensed under the Apache License, Version 2.0 (the License);
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+
+# Converts PNG drawables into premultiplied RGBA 8888 pixel arrays, laid out exactly like the
+# textures drawn by the native UI. Invoked by fb_bake_textures() in jni_adhesive.cmake.
+
+import argparse
+import struct
+import sys
+import zlib
+
+# Texture rows start on cache line boundaries, see FB_ANDROID_TEXTURE_ALIGNMENT
+PIXELS_PER_ALIGNMENT = 16
+
+
+def paeth(a, b, c):
+    p = a + b - c
+    pa, pb, pc = abs(p - a), abs(p - b), abs(p - c)
+    if pa <= pb and pa <= pc:
+        return a
+    return b if pb <= pc else c
+
+
+def decode_png(path):
+    """Decodes a non-interlaced 8 bit PNG into rows of (r, g, b, a) tuples."""
+    with open(path, 'rb') as file:
+        data = file.read()
+    if data[:8] != b'\x89PNG\r\n\x1a\n':
+        sys.exit('%s is not a PNG file' % path)
+
+    offset = 8
+    idat = b''
+    palette = []
+    transparency = b''
+    while offset < len(data):
+        length, kind = struct.unpack('>I4s', data[offset:offset + 8])
+        chunk = data[offset + 8:offset + 8 + length]
+        offset += 12 + length
+        if kind == b'IHDR':
+            width, height, depth, color_type, _, _, interlace = struct.unpack('>IIBBBBB', chunk)
+        elif kind == b'PLTE':
+            palette = [tuple(chunk[i:i + 3]) for i in range(0, length, 3)]
+        elif kind == b'tRNS':
+            transparency = chunk
+        elif kind == b'IDAT':
+            idat += chunk
+        elif kind == b'IEND':
+            break
+
+    channels = {0: 1, 2: 3, 3: 1, 4: 2, 6: 4}.get(color_type)
+    if depth != 8 or interlace != 0 or channels is None:
+        sys.exit('%s: only non-interlaced PNGs with 8 bits per channel are supported' % path)
+
+    raw = zlib.decompress(idat)
+    stride = width * channels
+    rows = []
+    previous = bytearray(stride)
+    position = 0
+    for _ in range(height):
+        filter_type = raw[position]
+        line = bytearray(raw[position + 1:position + 1 + stride])
+        position += 1 + stride
+        for i in range(stride):
+            left = line[i - channels] if i >= channels else 0
+            up = previous[i]
+            upper_left = previous[i - channels] if i >= channels else 0
+            if filter_type == 1:
+                line[i] = (line[i] + left) & 0xff
+            elif filter_type == 2:
+                line[i] = (line[i] + up) & 0xff
+            elif filter_type == 3:
+                line[i] = (line[i] + ((left + up) >> 1)) & 0xff
+            elif filter_type == 4:
+                line[i] = (line[i] + paeth(left, up, upper_left)) & 0xff
+        previous = line
+
+        pixels = []
+        for x in range(width):
+            p = line[x * channels:(x + 1) * channels]
+            if color_type == 0:
+                pixels.append((p[0], p[0], p[0], 255))
+            elif color_type == 2:
+                pixels.append((p[0], p[1], p[2], 255))
+            elif color_type == 3:
+                alpha = transparency[p[0]] if p[0] < len(transparency) else 255
+                pixels.append(palette[p[0]] + (alpha,))
+            elif color_type == 4:
+                pixels.append((p[0], p[0], p[0], p[1]))
+            else:
+                pixels.append(tuple(p))
+        rows.append(pixels)
+    return width, height, rows
+
+
+def premultiply(channel, alpha):
+    # Rounds like Skia does when BitmapFactory decodes into a premultiplied bitmap
+    product = channel * alpha + 128
+    return (product + (product >> 8)) >> 8
+
+
+def to_pixel(rgba):
+    r, g, b, a = rgba
+    # Byte order R, G, B, A in memory, as in ANDROID_BITMAP_FORMAT_RGBA_8888 and the window buffer
+    return premultiply(r, a) | (premultiply(g, a) << 8) | (premultiply(b, a) << 16) | (a << 24)
+
+
+def font_atlas(rows, glyph_width, glyph_height, glyph_count):
+    """Stores the rows of each glyph contiguously, as expected by drawTextAt()."""
+    columns = len(rows[0]) // glyph_width
+    available = columns * (len(rows) // glyph_height)
+    empty = [(0, 0, 0, 0)] * glyph_width
+    atlas = []
+    for glyph in range(glyph_count):
+        x = (glyph % columns) * glyph_width
+        y = (glyph // columns) * glyph_height
+        for row in range(glyph_height):
+            # Glyphs which are not covered by the bitmap stay empty
+            atlas.append(rows[y + row][x:x + glyph_width] if glyph < available else empty)
+    return glyph_width, glyph_count * glyph_height, atlas
+
+
+def write_texture(out, name, width, height, rows):
+    stride = (width + PIXELS_PER_ALIGNMENT - 1) & ~(PIXELS_PER_ALIGNMENT - 1)
+    out.write('    alignas(FB_ANDROID_TEXTURE_ALIGNMENT) const uint32_t %sPixels[] = {\n' % name)
+    for row in rows:
+        pixels = [to_pixel(p) for p in row] + [0] * (stride - width)
+        for i in range(0, stride, 8):
+            out.write('            %s,\n' % ', '.join('0x%08x' % p for p in pixels[i:i + 8]))
+    out.write('    };\n\n')
+    return stride
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Bakes PNG drawables into native texture arrays')
+    parser.add_argument('--output', required=True)
+    parser.add_argument('--texture', nargs=2, action='append', default=[], metavar=('NAME', 'PNG'))
+    parser.add_argument('--font', nargs=5, action='append', default=[],
+                        metavar=('NAME', 'PNG', 'GLYPH_WIDTH', 'GLYPH_HEIGHT', 'GLYPH_COUNT'))
+    args = parser.parse_args()
+
+    textures = []
+    for name, path in args.texture:
+        textures.append((name, path) + decode_png(path))
+    for name, path, glyph_width, glyph_height, glyph_count in args.font:
+        _, _, rows = decode_png(path)
+        textures.append((name, path) + font_atlas(rows, int(glyph_width), int(glyph_height), int(glyph_count)))
+
+    with open(args.output, 'w') as out:
+        out.write('// Generated by bake_textures.py from the app drawables, do not edit\n\n')
+        out.write('#include <fb_app_textures.h>\n\n')
+        out.write('namespace {\n\n')
+        strides = [write_texture(out, name, width, height, rows) for name, _, width, height, rows in textures]
+        out.write('}\n\n')
+        for (name, path, width, height, _), stride in zip(textures, strides):
+            out.write('// %s\n' % path.replace('\\', '/').split('/res/')[-1])
+            out.write('const FunkyBoyAndroid::texture FunkyBoyAndroid::R::Drawable::%s = {%sPixels, %d, %d, %d};\n'
+                      % (name, name, width, height, stride))
+
+
+if __name__ == '__main__':
+    main()
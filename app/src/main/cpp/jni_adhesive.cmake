@@ -10,10 +10,32 @@ macro(fb_generate_strings_cpp)
             set(FB_STRINGS_CPP_ENUM_LINES "${FB_STRINGS_CPP_ENUM_LINES}\t\t${CMAKE_MATCH_1} = ${FB_STRINGS_IDX},\n")
             set(FB_STRINGS_CPP_SWITCH_LINES "${FB_STRINGS_CPP_SWITCH_LINES}\tcase ${CMAKE_MATCH_1}:\n\t\tstrName = \"${CMAKE_MATCH_1}\";\n\t\tbreak;\n")
 
+            # Default value as a C string literal, resolving the XML entities and the Android escapes
+            # which are no valid C escapes
+            string(REGEX MATCH ">(.*)</string>" _ "${LINE}")
+            set(FB_STRING_VALUE "${CMAKE_MATCH_1}")
+            string(REPLACE "&lt;" "<" FB_STRING_VALUE "${FB_STRING_VALUE}")
+            string(REPLACE "&gt;" ">" FB_STRING_VALUE "${FB_STRING_VALUE}")
+            string(REPLACE "&quot;" "\\\"" FB_STRING_VALUE "${FB_STRING_VALUE}")
+            string(REPLACE "&apos;" "'" FB_STRING_VALUE "${FB_STRING_VALUE}")
+            string(REPLACE "&amp;" "&" FB_STRING_VALUE "${FB_STRING_VALUE}")
+            string(REPLACE "\\'" "'" FB_STRING_VALUE "${FB_STRING_VALUE}")
+            string(REPLACE "\\@" "@" FB_STRING_VALUE "${FB_STRING_VALUE}")
+            set(FB_STRINGS_CPP_DEFAULT_LINES "${FB_STRINGS_CPP_DEFAULT_LINES}\t\t\"${FB_STRING_VALUE}\",\n")
+
             MATH(EXPR FB_STRINGS_IDX "${FB_STRINGS_IDX}+1")
         endif()
     endforeach()
 
+    # Only languages which override the default strings need to look them up over JNI
+    file(GLOB FB_STRINGS_OVERRIDES RELATIVE "${CMAKE_CURRENT_SOURCE_DIR}/../res" "${CMAKE_CURRENT_SOURCE_DIR}/../res/values-*/strings.xml")
+    foreach(FB_STRINGS_OVERRIDE IN LISTS FB_STRINGS_OVERRIDES)
+        string(REGEX MATCH "^values-(b\\+)?([a-z][a-z][a-z]?)[-+/]" _ "${FB_STRINGS_OVERRIDE}")
+        if(NOT "${CMAKE_MATCH_2}" STREQUAL "")
+            set(FB_STRINGS_CPP_OVERRIDE_LINES "${FB_STRINGS_CPP_OVERRIDE_LINES}\t\t\"${CMAKE_MATCH_2}\",\n")
+        endif()
+    endforeach()
+
     configure_file("${CMAKE_CURRENT_SOURCE_DIR}/source/dynamic/fb_app_strings.h.in" "${CMAKE_BINARY_DIR}/generated/include/fb_app_strings.h" @ONLY)
     set(FB_ANDROID_DYNAMIC_SOURCES ${FB_ANDROID_DYNAMIC_SOURCES} "${CMAKE_BINARY_DIR}/generated/include/fb_app_strings.h")
 
@@ -21,3 +43,70 @@ macro(fb_generate_strings_cpp)
     set(FB_ANDROID_DYNAMIC_SOURCES ${FB_ANDROID_DYNAMIC_SOURCES} "${CMAKE_BINARY_DIR}/generated/fb_app_strings.cpp")
 endmacro()
 
+
+# Converts PNG drawables into native textures which get compiled into the library, so that they do
+# not have to be decoded at runtime. Expects entries of either TEXTURE <name> <png>, or
+# FONT <name> <png> <glyph width> <glyph height> <glyph count> for fonts which are split into the
+# glyph atlas used by drawTextAt().
+function(fb_bake_textures)
+    find_package(Python3 REQUIRED COMPONENTS Interpreter)
+
+    list(LENGTH ARGN FB_TEXTURES_ARGC)
+    set(FB_TEXTURES_IDX 0)
+    while(FB_TEXTURES_IDX LESS FB_TEXTURES_ARGC)
+        list(GET ARGN ${FB_TEXTURES_IDX} FB_TEXTURE_KIND)
+        MATH(EXPR FB_TEXTURE_NAME_IDX "${FB_TEXTURES_IDX}+1")
+        MATH(EXPR FB_TEXTURE_PNG_IDX "${FB_TEXTURES_IDX}+2")
+        list(GET ARGN ${FB_TEXTURE_NAME_IDX} FB_TEXTURE_NAME)
+        list(GET ARGN ${FB_TEXTURE_PNG_IDX} FB_TEXTURE_PNG)
+        if(FB_TEXTURE_KIND STREQUAL "FONT")
+            MATH(EXPR FB_TEXTURE_GLYPHS_IDX "${FB_TEXTURES_IDX}+3")
+            list(SUBLIST ARGN ${FB_TEXTURE_GLYPHS_IDX} 3 FB_TEXTURE_GLYPHS)
+            list(APPEND FB_TEXTURES_ARGS --font ${FB_TEXTURE_NAME} ${FB_TEXTURE_PNG} ${FB_TEXTURE_GLYPHS})
+            MATH(EXPR FB_TEXTURES_IDX "${FB_TEXTURES_IDX}+6")
+        else()
+            list(APPEND FB_TEXTURES_ARGS --texture ${FB_TEXTURE_NAME} ${FB_TEXTURE_PNG})
+            MATH(EXPR FB_TEXTURES_IDX "${FB_TEXTURES_IDX}+3")
+        endif()
+        list(APPEND FB_TEXTURES_PNGS ${FB_TEXTURE_PNG})
+        set(FB_TEXTURES_CPP_DECLARATION_LINES "${FB_TEXTURES_CPP_DECLARATION_LINES}\textern const texture ${FB_TEXTURE_NAME};\n")
+    endwhile()
+
+    configure_file("${CMAKE_CURRENT_SOURCE_DIR}/source/dynamic/fb_app_textures.h.in" "${CMAKE_BINARY_DIR}/generated/include/fb_app_textures.h" @ONLY)
+    add_custom_command(
+            OUTPUT "${CMAKE_BINARY_DIR}/generated/fb_app_textures.cpp"
+            COMMAND ${Python3_EXECUTABLE} "${CMAKE_CURRENT_SOURCE_DIR}/bake_textures.py"
+                    --output "${CMAKE_BINARY_DIR}/generated/fb_app_textures.cpp" ${FB_TEXTURES_ARGS}
+            DEPENDS "${CMAKE_CURRENT_SOURCE_DIR}/bake_textures.py" ${FB_TEXTURES_PNGS}
+            COMMENT "Baking UI textures"
+            VERBATIM)
+    set(FB_ANDROID_DYNAMIC_SOURCES ${FB_ANDROID_DYNAMIC_SOURCES}
+            "${CMAKE_BINARY_DIR}/generated/include/fb_app_textures.h"
+            "${CMAKE_BINARY_DIR}/generated/fb_app_textures.cpp"
+            PARENT_SCOPE)
+endfunction()
+
+
+# Expects pairs of activity method names and their JNI signatures. This is a function rather than a
+# macro, as ARGV<n> keeps the semicolons of the signatures, while ARGN would split them up.
+function(fb_generate_jni_bindings)
+    MATH(EXPR FB_JNI_LAST "${ARGC}-1")
+
+    set(FB_JNI_IDX 0)
+    foreach(FB_JNI_NAME_IDX RANGE 0 ${FB_JNI_LAST} 2)
+        MATH(EXPR FB_JNI_SIGNATURE_IDX "${FB_JNI_NAME_IDX}+1")
+        set(FB_JNI_NAME "${ARGV${FB_JNI_NAME_IDX}}")
+        set(FB_JNI_SIGNATURE "${ARGV${FB_JNI_SIGNATURE_IDX}}")
+        set(FB_JNI_CPP_ENUM_LINES "${FB_JNI_CPP_ENUM_LINES}\t\t${FB_JNI_NAME} = ${FB_JNI_IDX},\n")
+        set(FB_JNI_CPP_TABLE_LINES "${FB_JNI_CPP_TABLE_LINES}\t\t{\"${FB_JNI_NAME}\", \"${FB_JNI_SIGNATURE}\"},\n")
+
+        MATH(EXPR FB_JNI_IDX "${FB_JNI_IDX}+1")
+    endforeach()
+
+    configure_file("${CMAKE_CURRENT_SOURCE_DIR}/source/dynamic/fb_jni_bindings.h.in" "${CMAKE_BINARY_DIR}/generated/include/fb_jni_bindings.h" @ONLY)
+    configure_file("${CMAKE_CURRENT_SOURCE_DIR}/source/dynamic/fb_jni_bindings.cpp.in" "${CMAKE_BINARY_DIR}/generated/fb_jni_bindings.cpp" @ONLY)
+    set(FB_ANDROID_DYNAMIC_SOURCES ${FB_ANDROID_DYNAMIC_SOURCES}
+            "${CMAKE_BINARY_DIR}/generated/include/fb_jni_bindings.h"
+            "${CMAKE_BINARY_DIR}/generated/fb_jni_bindings.cpp"
+            PARENT_SCOPE)
+endfunction()
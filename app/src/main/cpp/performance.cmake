@@ -0,0 +1,36 @@
+# Optional optimizations for performance builds, see tools/perf.sh for collecting profiles and
+# comparing the options against each other.
+
+option(FB_ANDROID_PERFORMANCE "Optimize fb_core and fb_android for speed, including the per-ABI flags" OFF)
+option(FB_ANDROID_LTO "Link fb_core and fb_android with ThinLTO" OFF)
+option(FB_ANDROID_PGO_GENERATE "Instrument fb_core and fb_android to collect a PGO profile" OFF)
+option(FB_ANDROID_BENCHMARK "Replay movies headlessly when asked to by the launch intent, see tools/perf.sh" OFF)
+set(FB_ANDROID_PGO_PROFILE "" CACHE FILEPATH "Merged .profdata file to optimize fb_core and fb_android with")
+set(FB_ANDROID_PGO_PROFILE_DIR "/sdcard/Android/data/lu.kremi151.funkyboy/files/pgo" CACHE STRING "Device directory the instrumented build writes its raw profiles to")
+
+# Defaults only rely on the features each ABI guarantees
+set(FB_ANDROID_ABI_FLAGS_arm64-v8a "" CACHE STRING "Tuning flags for arm64-v8a")
+set(FB_ANDROID_ABI_FLAGS_armeabi-v7a "" CACHE STRING "Tuning flags for armeabi-v7a")
+set(FB_ANDROID_ABI_FLAGS_x86 "-mssse3" CACHE STRING "Tuning flags for x86")
+set(FB_ANDROID_ABI_FLAGS_x86_64 "-msse4.2 -mpopcnt" CACHE STRING "Tuning flags for x86_64")
+
+function(fb_optimize_target target)
+    if(FB_ANDROID_PERFORMANCE)
+        separate_arguments(FB_ABI_FLAGS UNIX_COMMAND "${FB_ANDROID_ABI_FLAGS_${ANDROID_ABI}}")
+        target_compile_options(${target} PRIVATE -O3 ${FB_ABI_FLAGS})
+    endif()
+
+    if(FB_ANDROID_LTO)
+        target_compile_options(${target} PRIVATE -flto=thin)
+        target_link_options(${target} PRIVATE -flto=thin "-Wl,--thinlto-cache-dir=${CMAKE_BINARY_DIR}/thinlto-cache")
+    endif()
+
+    if(FB_ANDROID_PGO_GENERATE)
+        target_compile_options(${target} PRIVATE "-fprofile-generate=${FB_ANDROID_PGO_PROFILE_DIR}")
+        target_link_options(${target} PRIVATE "-fprofile-generate=${FB_ANDROID_PGO_PROFILE_DIR}")
+        target_compile_definitions(${target} PRIVATE FB_ANDROID_PGO_GENERATE)
+    elseif(NOT "${FB_ANDROID_PGO_PROFILE}" STREQUAL "")
+        target_compile_options(${target} PRIVATE "-fprofile-use=${FB_ANDROID_PGO_PROFILE}" -Wno-profile-instr-unprofiled -Wno-profile-instr-out-of-date)
+        target_link_options(${target} PRIVATE "-fprofile-use=${FB_ANDROID_PGO_PROFILE}")
+    endif()
+endfunction()
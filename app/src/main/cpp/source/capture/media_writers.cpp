@@ -0,0 +1,223 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "media_writers.h"
+
+#include <fba_util/logging.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+#include <zlib.h>
+
+// Writes happen in large chunks, so that the encoder thread rarely waits for the storage
+#define FB_ANDROID_CAPTURE_FILE_BUFFER_SIZE (256 * 1024)
+
+#define FB_ANDROID_WAV_HEADER_SIZE 44
+
+using namespace FunkyBoyAndroid::Capture;
+
+namespace {
+
+    FILE *openForWriting(const std::string &path) {
+        FILE *file = std::fopen(path.c_str(), "wbe");
+        if (file == nullptr) {
+            LOGW("Unable to open %s for writing: %s", path.c_str(), std::strerror(errno));
+            return nullptr;
+        }
+        std::setvbuf(file, nullptr, _IOFBF, FB_ANDROID_CAPTURE_FILE_BUFFER_SIZE);
+        return file;
+    }
+
+    inline void putLE16(uint8_t *out, uint16_t value) {
+        out[0] = value & 0xffu;
+        out[1] = value >> 8u;
+    }
+
+    inline void putLE32(uint8_t *out, uint32_t value) {
+        putLE16(out, value & 0xffffu);
+        putLE16(out + 2, value >> 16u);
+    }
+
+    inline void putBE32(uint8_t *out, uint32_t value) {
+        out[0] = value >> 24u;
+        out[1] = (value >> 16u) & 0xffu;
+        out[2] = (value >> 8u) & 0xffu;
+        out[3] = value & 0xffu;
+    }
+
+    bool writePNGChunk(FILE *file, const char *type, const uint8_t *data, uint32_t length) {
+        uint8_t header[8];
+        putBE32(header, length);
+        std::memcpy(header + 4, type, 4);
+        uLong crc = crc32(0, header + 4, 4);
+        if (length > 0) {
+            crc = crc32(crc, data, length);
+        }
+        uint8_t trailer[4];
+        putBE32(trailer, crc);
+        return std::fwrite(header, 1, sizeof(header), file) == sizeof(header)
+            && (length == 0 || std::fwrite(data, 1, length, file) == length)
+            && std::fwrite(trailer, 1, sizeof(trailer), file) == sizeof(trailer);
+    }
+
+}
+
+Y4MWriter::Y4MWriter()
+    : file(nullptr)
+    , frameSize(0)
+{
+}
+
+Y4MWriter::~Y4MWriter() {
+    close();
+}
+
+bool Y4MWriter::open(const std::string &path, uint32_t width, uint32_t height, uint32_t rateNumerator, uint32_t rateDenominator) {
+    close();
+    file = openForWriting(path);
+    if (file == nullptr) {
+        return false;
+    }
+    frameSize = width * height;
+    std::fprintf(file, "YUV4MPEG2 W%u H%u F%u:%u Ip A1:1 Cmono\n", width, height, rateNumerator, rateDenominator);
+    return true;
+}
+
+bool Y4MWriter::writeFrame(const uint8_t *luma) {
+    static const char frameHeader[] = "FRAME\n";
+    return std::fwrite(frameHeader, 1, sizeof(frameHeader) - 1, file) == sizeof(frameHeader) - 1
+        && std::fwrite(luma, 1, frameSize, file) == frameSize;
+}
+
+void Y4MWriter::close() {
+    if (file != nullptr) {
+        std::fclose(file);
+        file = nullptr;
+    }
+}
+
+WavWriter::WavWriter()
+    : file(nullptr)
+    , channels(0)
+    , dataSize(0)
+{
+}
+
+WavWriter::~WavWriter() {
+    close();
+}
+
+bool WavWriter::open(const std::string &path, uint32_t sampleRate, uint16_t channelCount) {
+    close();
+    file = openForWriting(path);
+    if (file == nullptr) {
+        return false;
+    }
+    channels = channelCount;
+    dataSize = 0;
+
+    // The sizes are filled in on close()
+    uint8_t header[FB_ANDROID_WAV_HEADER_SIZE]{};
+    std::memcpy(header, "RIFF", 4);
+    std::memcpy(header + 8, "WAVEfmt ", 8);
+    putLE32(header + 16, 16);
+    putLE16(header + 20, 1); // PCM
+    putLE16(header + 22, channels);
+    putLE32(header + 24, sampleRate);
+    putLE32(header + 28, sampleRate * channels * sizeof(int16_t));
+    putLE16(header + 32, channels * sizeof(int16_t));
+    putLE16(header + 34, 16);
+    std::memcpy(header + 36, "data", 4);
+    return std::fwrite(header, 1, sizeof(header), file) == sizeof(header);
+}
+
+bool WavWriter::write(const int16_t *samples, size_t frames) {
+    // Android only runs on little-endian CPUs, which matches the byte order of WAV
+    size_t count = frames * channels;
+    size_t written = std::fwrite(samples, sizeof(int16_t), count, file);
+    dataSize += written * sizeof(int16_t);
+    return written == count;
+}
+
+bool WavWriter::writeSilence(size_t frames) {
+    static const int16_t silence[256 * 2]{};
+    size_t perChunk = sizeof(silence) / sizeof(int16_t) / channels;
+    while (frames > 0) {
+        size_t chunk = std::min(frames, perChunk);
+        if (!write(silence, chunk)) {
+            return false;
+        }
+        frames -= chunk;
+    }
+    return true;
+}
+
+void WavWriter::close() {
+    if (file == nullptr) {
+        return;
+    }
+    uint8_t size[4];
+    putLE32(size, dataSize + FB_ANDROID_WAV_HEADER_SIZE - 8);
+    std::fseek(file, 4, SEEK_SET);
+    std::fwrite(size, 1, sizeof(size), file);
+    putLE32(size, dataSize);
+    std::fseek(file, 40, SEEK_SET);
+    std::fwrite(size, 1, sizeof(size), file);
+    std::fclose(file);
+    file = nullptr;
+}
+
+bool FunkyBoyAndroid::Capture::writeIndexedPNG(const std::string &path, const uint8_t *indices, uint32_t width, uint32_t height, const uint8_t *palette, size_t colors) {
+    // Each row is prefixed with its filter type, which is always "none"
+    std::vector<uint8_t> raw((width + 1) * height);
+    for (uint32_t y = 0 ; y < height ; y++) {
+        raw[y * (width + 1)] = 0;
+        std::memcpy(&raw[y * (width + 1) + 1], indices + y * width, width);
+    }
+    uLongf compressedSize = compressBound(raw.size());
+    std::vector<uint8_t> compressed(compressedSize);
+    if (compress2(compressed.data(), &compressedSize, raw.data(), raw.size(), Z_BEST_COMPRESSION) != Z_OK) {
+        LOGW("Unable to compress screenshot");
+        return false;
+    }
+
+    FILE *file = std::fopen(path.c_str(), "wbe");
+    if (file == nullptr) {
+        LOGW("Unable to open %s for writing: %s", path.c_str(), std::strerror(errno));
+        return false;
+    }
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    uint8_t header[13];
+    putBE32(header, width);
+    putBE32(header + 4, height);
+    header[8] = 8; // Bits per index
+    header[9] = 3; // Indexed color
+    header[10] = 0;
+    header[11] = 0;
+    header[12] = 0;
+    bool ok = std::fwrite(signature, 1, sizeof(signature), file) == sizeof(signature)
+            && writePNGChunk(file, "IHDR", header, sizeof(header))
+            && writePNGChunk(file, "PLTE", palette, colors * 3)
+            && writePNGChunk(file, "IDAT", compressed.data(), compressedSize)
+            && writePNGChunk(file, "IEND", nullptr, 0);
+    std::fclose(file);
+    if (!ok) {
+        LOGW("Unable to write screenshot to %s", path.c_str());
+    }
+    return ok;
+}
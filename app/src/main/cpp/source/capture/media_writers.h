@@ -0,0 +1,94 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FB_ANDROID_CAPTURE_MEDIA_WRITERS_H
+#define FB_ANDROID_CAPTURE_MEDIA_WRITERS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+namespace FunkyBoyAndroid::Capture {
+
+    /**
+     * Writes uncompressed 8 bit grayscale video in the YUV4MPEG2 format, which is understood by
+     * ffmpeg and most players.
+     */
+    class Y4MWriter {
+    private:
+        FILE *file;
+        size_t frameSize;
+
+    public:
+        Y4MWriter();
+        ~Y4MWriter();
+
+        Y4MWriter(const Y4MWriter &) = delete;
+        Y4MWriter &operator=(const Y4MWriter &) = delete;
+
+        /**
+         * @param rateNumerator frame rate as a fraction, as the Game Boy does not run at an integer rate
+         */
+        bool open(const std::string &path, uint32_t width, uint32_t height, uint32_t rateNumerator, uint32_t rateDenominator);
+        bool writeFrame(const uint8_t *luma);
+        void close();
+
+        inline bool isOpen() const {
+            return file != nullptr;
+        }
+    };
+
+    /**
+     * Writes interleaved 16 bit PCM samples into a WAV file, whose header is completed on close().
+     */
+    class WavWriter {
+    private:
+        FILE *file;
+        uint16_t channels;
+        uint32_t dataSize;
+
+    public:
+        WavWriter();
+        ~WavWriter();
+
+        WavWriter(const WavWriter &) = delete;
+        WavWriter &operator=(const WavWriter &) = delete;
+
+        bool open(const std::string &path, uint32_t sampleRate, uint16_t channels);
+
+        /**
+         * @param frames amount of samples per channel
+         */
+        bool write(const int16_t *samples, size_t frames);
+        bool writeSilence(size_t frames);
+        void close();
+
+        inline bool isOpen() const {
+            return file != nullptr;
+        }
+    };
+
+    /**
+     * Writes an image with up to 256 colors as an indexed PNG.
+     *
+     * @param palette RGB triplets, one for each color
+     */
+    bool writeIndexedPNG(const std::string &path, const uint8_t *indices, uint32_t width, uint32_t height, const uint8_t *palette, size_t colors);
+
+}
+
+#endif //FB_ANDROID_CAPTURE_MEDIA_WRITERS_H
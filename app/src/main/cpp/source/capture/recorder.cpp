@@ -0,0 +1,331 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "recorder.h"
+
+#include <fba_util/logging.h>
+
+#include <algorithm>
+#include <chrono>
+#include <pthread.h>
+
+using namespace FunkyBoyAndroid::Capture;
+
+namespace {
+
+    // One gray level per palette index, from white to black like the DMG palette
+    const uint8_t indexLuma[4] = {255, 170, 85, 0};
+
+    inline int16_t toPCM(float sample) {
+        return static_cast<int16_t>(std::clamp(sample, -1.0f, 1.0f) * 32767.0f);
+    }
+
+}
+
+Recorder::Recorder(Util::Arena &arena)
+    : frames(arena.allocateArray<frame_slot>(FB_ANDROID_CAPTURE_FRAME_SLOTS, Util::ArenaTag::Capture))
+    , blocks(arena.allocateArray<audio_block>(FB_ANDROID_CAPTURE_AUDIO_BLOCKS, Util::ArenaTag::Capture))
+    , frame(nullptr)
+    , block(nullptr)
+    , frameCounter(0)
+    , sampleCounter(0)
+    , recording(false)
+    , screenshotWanted(false)
+    , droppedFrames(0)
+    , droppedSamples(0)
+    , stopRequested(false)
+    , recordedFrames(0)
+    , recordedSamples(0)
+    , quit(false)
+    , recordingOpen(false)
+    , framesWritten(0)
+    , samplesWritten(0)
+    , stats{}
+    , luma{}
+    , encoder(&Recorder::encode, this)
+{
+}
+
+Recorder::~Recorder() {
+    stop();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    wake.notify_one();
+    encoder.join();
+}
+
+bool Recorder::start(const std::string &basePath) {
+    if (recording) {
+        LOGW("A recording is already running");
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        recordPath = basePath;
+    }
+    frameCounter = 0;
+    sampleCounter = 0;
+    droppedFrames = 0;
+    droppedSamples = 0;
+    recording = true;
+    wake.notify_one();
+    LOGD("Recording to %s", basePath.c_str());
+    return true;
+}
+
+bool Recorder::stop() {
+    if (!recording) {
+        return false;
+    }
+    recording = false;
+    if (block != nullptr) {
+        blocks.commitWrite();
+        block = nullptr;
+    }
+
+    // Everything recorded has been published, the encoder closes the files once it has written it
+    std::unique_lock<std::mutex> lock(mutex);
+    recordedFrames = frameCounter;
+    recordedSamples = sampleCounter;
+    stopRequested = true;
+    wake.notify_one();
+    stopped.wait(lock, [this]{ return !stopRequested; });
+    LOGI("Recorded %llu frames (%llu dropped) and %llu samples (%llu dropped)",
+            static_cast<unsigned long long>(stats.frames), static_cast<unsigned long long>(stats.droppedFrames),
+            static_cast<unsigned long long>(stats.samples), static_cast<unsigned long long>(stats.droppedSamples));
+    return true;
+}
+
+bool Recorder::requestScreenshot(const std::string &path) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!screenshotPath.empty()) {
+        LOGW("A screenshot is already pending");
+        return false;
+    }
+    screenshotPath = path;
+    screenshotWanted = true;
+    wake.notify_one();
+    return true;
+}
+
+capture_stats Recorder::getStats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+void Recorder::beginFrame(const uint32_t *palette) {
+    frame = nullptr;
+    if (!recording && !screenshotWanted) {
+        return;
+    }
+    frame = frames.beginWrite();
+    if (frame == nullptr) {
+        if (recording) {
+            droppedFrames.fetch_add(1, std::memory_order_relaxed);
+        }
+        return;
+    }
+    frame->frame = frameCounter;
+    frame->recorded = recording;
+    frame->screenshot = screenshotWanted;
+    std::memcpy(frame->palette, palette, sizeof(frame->palette));
+}
+
+void Recorder::finishFrame() {
+    if (frame != nullptr) {
+        if (frame->screenshot) {
+            screenshotWanted = false;
+        }
+        frames.commitWrite();
+        frame = nullptr;
+    }
+    if (recording) {
+        frameCounter++;
+    }
+}
+
+void Recorder::captureSample(float left, float right) {
+    if (!recording) {
+        return;
+    }
+    if (block == nullptr) {
+        block = blocks.beginWrite();
+        if (block == nullptr) {
+            droppedSamples.fetch_add(1, std::memory_order_relaxed);
+            sampleCounter++;
+            return;
+        }
+        block->firstSample = sampleCounter;
+        block->count = 0;
+    }
+    block->samples[block->count * 2] = toPCM(left);
+    block->samples[block->count * 2 + 1] = toPCM(right);
+    sampleCounter++;
+    if (++block->count == FB_ANDROID_CAPTURE_AUDIO_BLOCK_FRAMES) {
+        blocks.commitWrite();
+        block = nullptr;
+    }
+}
+
+bool Recorder::hasWork() {
+    return quit || stopRequested || recordingOpen || !recordPath.empty() || !screenshotPath.empty();
+}
+
+void Recorder::encode() {
+    pthread_setname_np(pthread_self(), "FBCapture");
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        wake.wait(lock, [this]{ return hasWork(); });
+        if (quit) {
+            return;
+        }
+        bool stopping = stopRequested;
+        lock.unlock();
+
+        drain();
+        if (stopping) {
+            closeRecording();
+        } else {
+            // The emulation thread does not signal new frames, so that it never has to take a lock
+            std::this_thread::sleep_for(std::chrono::milliseconds(FB_ANDROID_CAPTURE_POLL_MS));
+        }
+
+        lock.lock();
+        if (stopping) {
+            stopRequested = false;
+            stopped.notify_all();
+        }
+    }
+}
+
+void Recorder::drain() {
+    // Frames and samples are consumed in alternation, so that neither ring fills up meanwhile
+    bool pending = true;
+    while (pending) {
+        pending = false;
+        if (auto *slot = frames.beginRead()) {
+            if (slot->recorded) {
+                encodeFrame(*slot);
+            }
+            if (slot->screenshot) {
+                takeScreenshot(*slot);
+            }
+            frames.commitRead();
+            pending = true;
+        }
+        if (auto *slot = blocks.beginRead()) {
+            encodeBlock(*slot);
+            blocks.commitRead();
+            pending = true;
+        }
+    }
+}
+
+void Recorder::openRecording() {
+    std::string basePath;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        basePath = std::move(recordPath);
+        recordPath.clear();
+    }
+    recordingOpen = true;
+    std::memset(luma, indexLuma[0], sizeof(luma));
+    if (!video.open(basePath + ".y4m", FB_GB_DISPLAY_WIDTH, FB_GB_DISPLAY_HEIGHT, FB_ANDROID_CAPTURE_RATE_NUMERATOR, FB_ANDROID_CAPTURE_RATE_DENOMINATOR)
+            || !audio.open(basePath + ".wav", FB_ANDROID_CAPTURE_SAMPLE_RATE, 2)) {
+        // Frames and samples keep being consumed, but are discarded
+        video.close();
+        audio.close();
+    }
+}
+
+void Recorder::closeRecording() {
+    std::lock_guard<std::mutex> lock(mutex);
+    // Frames and samples dropped at the very end have not been followed by any which were captured
+    if (video.isOpen()) {
+        for (; framesWritten < recordedFrames ; framesWritten++) {
+            video.writeFrame(luma);
+        }
+    }
+    if (audio.isOpen() && samplesWritten < recordedSamples) {
+        audio.writeSilence(recordedSamples - samplesWritten);
+        samplesWritten = recordedSamples;
+    }
+    video.close();
+    audio.close();
+    recordingOpen = false;
+    // Nothing may have been recorded at all, in which case the files have never been opened
+    recordPath.clear();
+    stats.frames = framesWritten;
+    stats.droppedFrames = droppedFrames.load(std::memory_order_relaxed);
+    stats.samples = samplesWritten;
+    stats.droppedSamples = droppedSamples.load(std::memory_order_relaxed);
+    framesWritten = 0;
+    samplesWritten = 0;
+}
+
+void Recorder::encodeFrame(const frame_slot &slot) {
+    if (!recordingOpen) {
+        openRecording();
+    }
+    if (!video.isOpen()) {
+        return;
+    }
+    // Dropped frames are replaced by the previous one, so that the video keeps its timing
+    for (; framesWritten < slot.frame ; framesWritten++) {
+        video.writeFrame(luma);
+    }
+    for (size_t i = 0 ; i < sizeof(luma) ; i++) {
+        luma[i] = indexLuma[slot.indices[i] & 3u];
+    }
+    video.writeFrame(luma);
+    framesWritten = slot.frame + 1;
+}
+
+void Recorder::encodeBlock(const audio_block &slot) {
+    if (!recordingOpen) {
+        openRecording();
+    }
+    if (!audio.isOpen()) {
+        return;
+    }
+    if (slot.firstSample > samplesWritten) {
+        audio.writeSilence(slot.firstSample - samplesWritten);
+    }
+    audio.write(slot.samples, slot.count);
+    samplesWritten = slot.firstSample + slot.count;
+}
+
+void Recorder::takeScreenshot(const frame_slot &slot) {
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        path = std::move(screenshotPath);
+        screenshotPath.clear();
+    }
+    uint8_t palette[4 * 3];
+    for (int i = 0 ; i < 4 ; i++) {
+        palette[i * 3] = (slot.palette[i] >> 16u) & 0xffu;
+        palette[i * 3 + 1] = (slot.palette[i] >> 8u) & 0xffu;
+        palette[i * 3 + 2] = slot.palette[i] & 0xffu;
+    }
+    if (writeIndexedPNG(path, slot.indices, FB_GB_DISPLAY_WIDTH, FB_GB_DISPLAY_HEIGHT, palette, 4)) {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.screenshots++;
+        LOGD("Screenshot written to %s", path.c_str());
+    }
+}
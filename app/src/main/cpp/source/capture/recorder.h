@@ -0,0 +1,199 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FB_ANDROID_CAPTURE_RECORDER_H
+#define FB_ANDROID_CAPTURE_RECORDER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <util/typedefs.h>
+#include <util/arena.h>
+#include <util/spsc_ring.h>
+#include <capture/media_writers.h>
+
+// About 130 ms of video may be pending before frames get dropped
+#define FB_ANDROID_CAPTURE_FRAME_SLOTS 8
+
+#define FB_ANDROID_CAPTURE_AUDIO_BLOCK_FRAMES 1024
+#define FB_ANDROID_CAPTURE_AUDIO_BLOCKS 16
+
+// Rate at which the emulator emits samples through pushSample()
+#define FB_ANDROID_CAPTURE_SAMPLE_RATE 44100
+
+// The Game Boy renders 4194304 / 70224 (about 59.73) frames per second
+#define FB_ANDROID_CAPTURE_RATE_NUMERATOR 4194304
+#define FB_ANDROID_CAPTURE_RATE_DENOMINATOR 70224
+
+// How often the encoder looks for new frames and samples while recording
+#define FB_ANDROID_CAPTURE_POLL_MS 4
+
+namespace FunkyBoyAndroid::Capture {
+
+    struct capture_stats {
+        // Length of the video and of the audio, including the replacements of dropped frames and samples
+        uint64_t frames;
+        // Frames which could not be captured and have been replaced by repeating the previous one
+        uint64_t droppedFrames;
+        uint64_t samples;
+        // Samples which could not be captured and have been replaced by silence
+        uint64_t droppedSamples;
+        uint32_t screenshots;
+    };
+
+    /**
+     * Records the emulated frames and samples into a video and an audio file, and takes screenshots.
+     *
+     * The emulation thread fills frame and audio slots in place, which are then handed over
+     * through SPSC rings to an encoder thread doing all of the conversion and I/O. Frames are
+     * captured as palette indices and numbered by emulated frame, samples by emulated sample, so
+     * that both files stay in sync. If the encoder falls behind, frames and samples are dropped
+     * and counted, and the gaps are filled with repeated frames and silence. The emulation thread
+     * never waits for the encoder, except in stop().
+     *
+     * The video is written as Y4M with one gray level per palette index, so that it is lossless
+     * regardless of the selected palette. Screenshots are taken from the same frames and written
+     * as PNG in the palette of the display.
+     *
+     * All methods have to be called from the emulation thread, between frames.
+     */
+    class Recorder {
+    private:
+        struct frame_slot {
+            uint64_t frame;
+            bool recorded;
+            bool screenshot;
+            // As used by the display controller
+            uint32_t palette[4];
+            uint8_t indices[FB_GB_DISPLAY_WIDTH * FB_GB_DISPLAY_HEIGHT];
+        };
+
+        struct audio_block {
+            uint64_t firstSample;
+            uint32_t count;
+            int16_t samples[FB_ANDROID_CAPTURE_AUDIO_BLOCK_FRAMES * 2];
+        };
+
+        Util::SpscRing<frame_slot, FB_ANDROID_CAPTURE_FRAME_SLOTS> frames;
+        Util::SpscRing<audio_block, FB_ANDROID_CAPTURE_AUDIO_BLOCKS> blocks;
+
+        // Emulation thread
+        frame_slot *frame;
+        audio_block *block;
+        uint64_t frameCounter;
+        uint64_t sampleCounter;
+        bool recording;
+        bool screenshotWanted;
+        std::atomic<uint64_t> droppedFrames;
+        std::atomic<uint64_t> droppedSamples;
+
+        // Requests to the encoder thread
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable stopped;
+        std::string recordPath;
+        std::string screenshotPath;
+        bool stopRequested;
+        // Emulated length of the recording, known once it gets stopped
+        uint64_t recordedFrames;
+        uint64_t recordedSamples;
+        bool quit;
+
+        // Encoder thread
+        Y4MWriter video;
+        WavWriter audio;
+        bool recordingOpen;
+        uint64_t framesWritten;
+        uint64_t samplesWritten;
+        capture_stats stats;
+        uint8_t luma[FB_GB_DISPLAY_WIDTH * FB_GB_DISPLAY_HEIGHT];
+        std::thread encoder;
+
+        void beginFrame(const uint32_t *palette);
+        void encode();
+        bool hasWork();
+        void drain();
+        void openRecording();
+        void closeRecording();
+        void encodeFrame(const frame_slot &slot);
+        void encodeBlock(const audio_block &slot);
+        void takeScreenshot(const frame_slot &slot);
+
+    public:
+        /**
+         * Allocates the slots from the given arena, which has to outlive the recorder.
+         */
+        explicit Recorder(Util::Arena &arena);
+        ~Recorder();
+
+        Recorder(const Recorder &) = delete;
+        Recorder &operator=(const Recorder &) = delete;
+
+        /**
+         * Starts recording into basePath.y4m and basePath.wav.
+         *
+         * @return false if a recording is already running
+         */
+        bool start(const std::string &basePath);
+
+        /**
+         * Stops recording, waiting until the encoder has written all pending frames and samples.
+         */
+        bool stop();
+
+        inline bool isRecording() const {
+            return recording;
+        }
+
+        /**
+         * Writes the next frame into the given PNG file.
+         *
+         * @return false if the previous screenshot has not been taken yet
+         */
+        bool requestScreenshot(const std::string &path);
+
+        /**
+         * Called for each scan line of a frame, with the palette index of each pixel.
+         */
+        inline void captureLine(FunkyBoy::u8 y, const FunkyBoy::u8 *indices, const uint32_t *palette) {
+            if (y == 0) {
+                beginFrame(palette);
+            }
+            if (frame != nullptr) {
+                std::memcpy(frame->indices + y * FB_GB_DISPLAY_WIDTH, indices, FB_GB_DISPLAY_WIDTH);
+            }
+        }
+
+        /**
+         * Called once all scan lines of a frame have been drawn.
+         */
+        void finishFrame();
+
+        void captureSample(float left, float right);
+
+        /**
+         * @return the statistics of the last recording, valid after stop()
+         */
+        capture_stats getStats();
+    };
+
+}
+
+#endif //FB_ANDROID_CAPTURE_RECORDER_H
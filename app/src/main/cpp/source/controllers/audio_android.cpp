@@ -21,7 +21,27 @@
 
 using namespace FunkyBoyAndroid::Controller;
 
-AudioControllerAndroid::AudioControllerAndroid() {
+AudioControllerAndroid::AudioControllerAndroid(Util::Arena &arena)
+    : streamOpen(false)
+    , playRequested(true)
+    , playing(false)
+    , dropWhenFull(false)
+    , muted(false)
+    , resampleStep(1.0f)
+    , resamplePhase(0.0f)
+    , capture(nullptr)
+    , queue(arena.allocateArray<float>(FB_ANDROID_AUDIO_QUEUE_SIZE, Util::ArenaTag::Audio))
+{
+}
+
+AudioControllerAndroid::~AudioControllerAndroid() {
+    std::lock_guard<std::mutex> lock(streamMutex);
+    if (streamOpen) {
+        managedStream->requestStop();
+    }
+}
+
+bool AudioControllerAndroid::open() {
     oboe::AudioStreamBuilder builder;
     builder.setDirection(oboe::Direction::Output);
     builder.setPerformanceMode(oboe::PerformanceMode::LowLatency);
@@ -31,19 +51,22 @@ AudioControllerAndroid::AudioControllerAndroid() {
     builder.setDataCallback(this);
     builder.setFramesPerDataCallback(400);
 
-    streamResult = builder.openManagedStream(managedStream);
-    if (streamResult == oboe::Result::OK) {
-        managedStream->requestStart();
-        playing = true;
-    } else {
-        LOGE("Failed to create stream. Error: %s", oboe::convertToText(streamResult));
+    // Opened without holding the lock, so that playback can be toggled in the meantime
+    oboe::ManagedStream stream;
+    oboe::Result result = builder.openManagedStream(stream);
+    if (result != oboe::Result::OK) {
+        LOGE("Failed to create stream. Error: %s", oboe::convertToText(result));
+        return false;
     }
-}
 
-AudioControllerAndroid::~AudioControllerAndroid() {
-    if (streamResult == oboe::Result::OK) {
-        managedStream->requestStop();
+    std::lock_guard<std::mutex> lock(streamMutex);
+    managedStream = std::move(stream);
+    streamOpen = true;
+    if (playRequested) {
+        managedStream->requestStart();
+        playing = true;
     }
+    return true;
 }
 
 oboe::DataCallbackResult AudioControllerAndroid::onAudioReady(oboe::AudioStream *audioStream, void *audioData, int32_t numFrames) {
@@ -62,18 +85,37 @@ oboe::DataCallbackResult AudioControllerAndroid::onAudioReady(oboe::AudioStream
 }
 
 void AudioControllerAndroid::pushSample(float left, float right) {
-    if (!playing) {
+    if (muted) {
         return;
     }
-    while (!queue.push(left)) {
-        // Wait
+    if (capture != nullptr) {
+        capture->captureSample(left, right);
     }
-    while (!queue.push(right)) {
-        // Wait
+    if (!playing) {
+        return;
+    }
+    resamplePhase += resampleStep;
+    while (resamplePhase >= 1.0f) {
+        resamplePhase -= 1.0f;
+        if (dropWhenFull && queue.size() + 2 > FB_ANDROID_AUDIO_QUEUE_SIZE) {
+            return;
+        }
+        while (!queue.push(left)) {
+            // Wait
+        }
+        while (!queue.push(right)) {
+            // Wait
+        }
     }
 }
 
 void AudioControllerAndroid::setPlaying(bool p) {
+    std::lock_guard<std::mutex> lock(streamMutex);
+    playRequested = p;
+    if (!streamOpen) {
+        // Applied once the stream has been opened
+        return;
+    }
     if (playing && !p) {
         LOGD("Pausing audio\n");
         playing = false;
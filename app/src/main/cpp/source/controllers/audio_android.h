@@ -17,9 +17,13 @@
 #ifndef FB_ANDROID_CONTROLLERS_AUDIO_ANDROID_H
 #define FB_ANDROID_CONTROLLERS_AUDIO_ANDROID_H
 
+#include <atomic>
+#include <mutex>
 #include <oboe/Oboe.h>
 #include <controllers/audio.h>
+#include <capture/recorder.h>
 #include <util/LockFreeQueue.h>
+#include <util/arena.h>
 
 #define FB_ANDROID_AUDIO_QUEUE_SIZE 4096
 
@@ -27,20 +31,72 @@ namespace FunkyBoyAndroid::Controller {
 
     class AudioControllerAndroid: public oboe::AudioStreamDataCallback, public FunkyBoy::Controller::AudioController {
     private:
+        // Guards the stream, which gets opened in the background while playback may already be toggled
+        std::mutex streamMutex;
         oboe::ManagedStream managedStream;
-        oboe::Result streamResult;
-        bool playing;
+        bool streamOpen;
+        bool playRequested;
+
+        std::atomic<bool> playing;
+        bool dropWhenFull;
+        bool muted;
+        float resampleStep;
+        float resamplePhase;
+        Capture::Recorder *capture;
 
         LockFreeQueue<float, FB_ANDROID_AUDIO_QUEUE_SIZE, size_t> queue;
 
     public:
-        AudioControllerAndroid();
+        /**
+         * Allocates the sample queue from the given arena, which has to outlive the controller.
+         * Samples are dropped until the stream has been opened.
+         */
+        explicit AudioControllerAndroid(Util::Arena &arena);
         ~AudioControllerAndroid() override;
 
+        /**
+         * Opens the output stream, which can take a while on some devices. May be called from any
+         * thread, but not concurrently with the destructor.
+         *
+         * @return true if the stream could be opened
+         */
+        bool open();
+
         void pushSample(float left, float right) override;
 
         void setPlaying(bool playing);
 
+        /**
+         * Hands every sample to the given recorder, nullptr stops doing so.
+         */
+        inline void setCapture(Capture::Recorder *recorder) {
+            capture = recorder;
+        }
+
+        /**
+         * When enabled, samples are dropped instead of waiting for the queue to drain, which is
+         * required to emulate faster than real time.
+         */
+        inline void setDropWhenFull(bool drop) {
+            dropWhenFull = drop;
+        }
+
+        /**
+         * While muted, samples are neither played nor captured.
+         */
+        inline void setMuted(bool m) {
+            muted = m;
+        }
+
+        /**
+         * Keeps the given fraction of the samples, repeating or skipping single samples evenly, so
+         * that audio stays in real time while the emulation runs slightly fast or slow to follow
+         * the display.
+         */
+        inline void setResampleRatio(float ratio) {
+            resampleStep = ratio;
+        }
+
         oboe::DataCallbackResult onAudioReady(oboe::AudioStream *audioStream, void *audioData, int32_t numFrames) override;
     };
 
@@ -14,19 +14,22 @@
  * limitations under the License.
  */
 
-#ifndef FB_ANDROID_UTIL_SHARED_H
-#define FB_ANDROID_UTIL_SHARED_H
+#ifndef FB_ANDROID_CONTROLLERS_AUDIO_NULL_H
+#define FB_ANDROID_CONTROLLERS_AUDIO_NULL_H
 
-#include <memory>
-#include <emulator/emulator.h>
+#include <controllers/audio.h>
 
-namespace FunkyBoyAndroid::State {
-    extern std::unique_ptr<FunkyBoy::Emulator> emulator;
-    extern std::shared_ptr<FunkyBoy::Controller::DisplayController> emuDisplayController;
-    extern std::shared_ptr<FunkyBoy::Controller::AudioController> emuAudioController;
+namespace FunkyBoyAndroid::Controller {
+
+    /**
+     * Discards all samples, used for headless emulation.
+     */
+    class AudioControllerNull: public FunkyBoy::Controller::AudioController {
+    public:
+        void pushSample(float left, float right) override {
+        }
+    };
 
-    extern bool initialSaveLoaded;
-    extern std::string romPath;
 }
 
-#endif //FB_ANDROID_UTIL_SHARED_H
+#endif //FB_ANDROID_CONTROLLERS_AUDIO_NULL_H
@@ -23,34 +23,93 @@
 #include <ui/draw_controls.h>
 
 #include <fba_util/logging.h>
+#include <kernels/kernels.h>
+#include <util/hash.h>
+#include <cstring>
+
+#define FB_ANDROID_PALETTE_COUNT 2
 
 using namespace FunkyBoyAndroid::Controller;
 
-DisplayControllerAndroid::DisplayControllerAndroid(struct engine *engine)
+namespace {
+
+    const uint8_t grayscalePalette[4][3] = {
+            {255, 255, 255},
+            {170, 170, 170},
+            {85, 85, 85},
+            {0, 0, 0},
+    };
+
+    inline uint32_t toPixel(uint8_t r, uint8_t g, uint8_t b) {
+        return (255u << 24u) | (r << 16) | (g << 8) | b;
+    }
+
+}
+
+DisplayControllerAndroid::DisplayControllerAndroid(struct engine *engine, Util::Arena &arena)
     : engine(engine)
     , window(nullptr)
-    , pixels(new uint32_t[FB_GB_DISPLAY_WIDTH * FB_GB_DISPLAY_HEIGHT])
+    , pixels(arena.allocateArray<uint32_t>(FB_GB_DISPLAY_WIDTH * FB_GB_DISPLAY_HEIGHT, Util::ArenaTag::Display))
+    , rendering(true)
+    , hashFrames(false)
+    , hash(FB_ANDROID_FNV1A64_OFFSET)
+    , frameHash(0)
+    , capture(nullptr)
 {
-}
-
-DisplayControllerAndroid::~DisplayControllerAndroid() {
-    delete[] pixels;
+    setPalette(0);
 }
 
 void DisplayControllerAndroid::setWindow(ANativeWindow *w) {
     window = w;
 }
 
+void DisplayControllerAndroid::loadPixels(const uint32_t *source) {
+    std::memcpy(pixels, source, FB_GB_DISPLAY_WIDTH * FB_GB_DISPLAY_HEIGHT * sizeof(uint32_t));
+}
+
+void DisplayControllerAndroid::setPalette(int index) {
+    if (index < 0 || index >= FB_ANDROID_PALETTE_COUNT) {
+        LOGW("Unknown palette %d", index);
+        return;
+    }
+    for (int i = 0 ; i < 4 ; i++) {
+        if (index == 0) {
+            auto &color = FunkyBoy::Palette::ARGB8888::DMG[i];
+            palette[i] = toPixel(color[0], color[1], color[2]);
+        } else {
+            auto &color = grayscalePalette[i];
+            palette[i] = toPixel(color[0], color[1], color[2]);
+        }
+    }
+}
+
+void DisplayControllerAndroid::setFrameHashing(bool enabled) {
+    hashFrames = enabled;
+}
+
 void DisplayControllerAndroid::drawScanLine(FunkyBoy::u8 y, FunkyBoy::u8 *buffer) {
-    uint32_t pixel;
-    for (FunkyBoy::u8 x = 0 ; x < FB_GB_DISPLAY_WIDTH ; x++) {
-        auto &color = FunkyBoy::Palette::ARGB8888::DMG[*(buffer + x)];
-        pixel = (255u << 24u) | (color[0] << 16) | (color[1] << 8) | color[2];
-        pixels[(y * FB_GB_DISPLAY_WIDTH) + x] = pixel;
+    if (!rendering) {
+        return;
+    }
+    if (hashFrames) {
+        // Hash the palette indices, so that the result does not depend on the selected palette
+        hash = FunkyBoyAndroid::Util::fnv1a64(buffer, FB_GB_DISPLAY_WIDTH, y == 0 ? FB_ANDROID_FNV1A64_OFFSET : hash);
+    }
+    FunkyBoyAndroid::Kernels::paletteLine(buffer, palette, pixels + (y * FB_GB_DISPLAY_WIDTH), FB_GB_DISPLAY_WIDTH);
+    if (capture != nullptr) {
+        capture->captureLine(y, buffer, palette);
     }
 }
 
 void DisplayControllerAndroid::drawScreen() {
+    if (!rendering) {
+        return;
+    }
+    frameHash = hash;
+    if (capture != nullptr) {
+        capture->finishFrame();
+    }
+
     if (window == nullptr) {
         // Window is not yet initialized
         return;
@@ -64,9 +123,7 @@ void DisplayControllerAndroid::drawScreen() {
     }
     auto *line = (uint32_t *) buffer.bits;
     for (int y = 0 ; y < FB_GB_DISPLAY_HEIGHT ; y++) {
-        for (int x = 0 ; x < FB_GB_DISPLAY_WIDTH ; x++) {
-            line[x] = pixels[(y * FB_GB_DISPLAY_WIDTH) + x];
-        }
+        std::memcpy(line, pixels + (y * FB_GB_DISPLAY_WIDTH), FB_GB_DISPLAY_WIDTH * sizeof(uint32_t));
         line = line + buffer.stride;
     }
 
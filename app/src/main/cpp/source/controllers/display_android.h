@@ -18,7 +18,9 @@
 #define FB_ANDROID_CONTROLLER_DISPLAY_ANDROID_H
 
 #include <controllers/display.h>
+#include <capture/recorder.h>
 #include <engine/engine.h>
+#include <util/arena.h>
 
 #include <android/native_window.h>
 
@@ -32,12 +34,53 @@ namespace FunkyBoyAndroid {
             ANativeWindow *window;
             ANativeWindow_Buffer buffer{};
             uint32_t *pixels;
+            uint32_t palette[4];
+            bool rendering;
+            bool hashFrames;
+            uint64_t hash;
+            uint64_t frameHash;
+            Capture::Recorder *capture;
         public:
-            explicit DisplayControllerAndroid(struct engine *engine);
-            ~DisplayControllerAndroid() override;
+            /**
+             * Allocates the frame buffer from the given arena, which has to outlive the controller.
+             */
+            DisplayControllerAndroid(struct engine *engine, Util::Arena &arena);
 
             void setWindow(ANativeWindow *window);
 
+            inline const uint32_t *getPixels() const {
+                return pixels;
+            }
+            void loadPixels(const uint32_t *source);
+
+            /**
+             * Selects one of the built-in color palettes, 0 being the default DMG palette.
+             */
+            void setPalette(int index);
+
+            /**
+             * When disabled, frames are neither converted, hashed, captured nor presented.
+             */
+            inline void setRendering(bool enabled) {
+                rendering = enabled;
+            }
+
+            /**
+             * Enables hashing the palette indices of each frame, used to verify movie replays.
+             */
+            void setFrameHashing(bool enabled);
+
+            inline uint64_t getFrameHash() const {
+                return frameHash;
+            }
+
+            /**
+             * Hands every frame to the given recorder, nullptr stops doing so.
+             */
+            inline void setCapture(Capture::Recorder *recorder) {
+                capture = recorder;
+            }
+
             void drawScanLine(FunkyBoy::u8 y, FunkyBoy::u8 *buffer) override;
             void drawScreen() override;
         };
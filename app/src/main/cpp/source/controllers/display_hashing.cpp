@@ -0,0 +1,40 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "display_hashing.h"
+
+#include <util/hash.h>
+
+using namespace FunkyBoyAndroid::Controller;
+
+DisplayControllerHashing::DisplayControllerHashing()
+    : hash(FB_ANDROID_FNV1A64_OFFSET)
+    , frameHash(0)
+    , frameCount(0)
+{
+}
+
+void DisplayControllerHashing::drawScanLine(FunkyBoy::u8 y, FunkyBoy::u8 *buffer) {
+    if (y == 0) {
+        hash = FB_ANDROID_FNV1A64_OFFSET;
+    }
+    hash = FunkyBoyAndroid::Util::fnv1a64(buffer, FB_GB_DISPLAY_WIDTH, hash);
+}
+
+void DisplayControllerHashing::drawScreen() {
+    frameHash = hash;
+    frameCount++;
+}
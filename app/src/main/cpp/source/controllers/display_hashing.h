@@ -0,0 +1,54 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FB_ANDROID_CONTROLLERS_DISPLAY_HASHING_H
+#define FB_ANDROID_CONTROLLERS_DISPLAY_HASHING_H
+
+#include <controllers/display.h>
+#include <cstdint>
+
+namespace FunkyBoyAndroid::Controller {
+
+    /**
+     * Headless display controller which only computes a hash over the palette indices of each frame.
+     */
+    class DisplayControllerHashing: public FunkyBoy::Controller::DisplayController {
+    private:
+        uint64_t hash;
+        uint64_t frameHash;
+        uint64_t frameCount;
+
+    public:
+        DisplayControllerHashing();
+
+        void drawScanLine(FunkyBoy::u8 y, FunkyBoy::u8 *buffer) override;
+        void drawScreen() override;
+
+        /**
+         * @return hash of the last completed frame
+         */
+        inline uint64_t getFrameHash() const {
+            return frameHash;
+        }
+
+        inline uint64_t getFrameCount() const {
+            return frameCount;
+        }
+    };
+
+}
+
+#endif //FB_ANDROID_CONTROLLERS_DISPLAY_HASHING_H
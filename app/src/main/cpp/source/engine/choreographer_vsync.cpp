@@ -0,0 +1,95 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "choreographer_vsync.h"
+
+#include <fba_util/logging.h>
+#include <dlfcn.h>
+
+// ANATIVEWINDOW_FRAME_RATE_COMPATIBILITY_FIXED_SOURCE, the content is not able to adapt its rate
+#define FB_ANDROID_FRAME_RATE_COMPATIBILITY_FIXED_SOURCE 1
+
+using namespace FunkyBoyAndroid::Engine;
+
+ChoreographerVsync::ChoreographerVsync()
+    : choreographer(nullptr)
+    , postFrameCallback(nullptr)
+    , postFrameCallback64(nullptr)
+    , pending(false)
+    , callback(nullptr)
+    , callbackData(nullptr)
+{
+}
+
+bool ChoreographerVsync::init() {
+    typedef void *(*get_instance)();
+    auto getInstance = reinterpret_cast<get_instance>(dlsym(RTLD_DEFAULT, "AChoreographer_getInstance"));
+    // The 64 bit variant was added with API level 29, because long overflows on 32 bit ABIs
+    postFrameCallback64 = reinterpret_cast<post_frame_callback64>(dlsym(RTLD_DEFAULT, "AChoreographer_postFrameCallback64"));
+    postFrameCallback = reinterpret_cast<post_frame_callback>(dlsym(RTLD_DEFAULT, "AChoreographer_postFrameCallback"));
+    if (getInstance == nullptr || (postFrameCallback64 == nullptr && postFrameCallback == nullptr)) {
+        LOGI("Choreographer is not available, frames are paced by a timer");
+        return false;
+    }
+    choreographer = getInstance();
+    return choreographer != nullptr;
+}
+
+bool ChoreographerVsync::request(vsync_callback cb, void *data) {
+    if (choreographer == nullptr) {
+        return false;
+    }
+    callback = cb;
+    callbackData = data;
+    if (pending) {
+        return true;
+    }
+    pending = true;
+    if (postFrameCallback64 != nullptr) {
+        postFrameCallback64(choreographer, onFrame64, this);
+    } else {
+        postFrameCallback(choreographer, onFrame, this);
+    }
+    return true;
+}
+
+void ChoreographerVsync::onFrame(long frameTimeNanos, void *data) {
+    static_cast<ChoreographerVsync *>(data)->dispatch(frameTimeNanos);
+}
+
+void ChoreographerVsync::onFrame64(int64_t frameTimeNanos, void *data) {
+    static_cast<ChoreographerVsync *>(data)->dispatch(frameTimeNanos);
+}
+
+void ChoreographerVsync::dispatch(int64_t frameTimeNanos) {
+    pending = false;
+    vsync_callback cb = callback;
+    callback = nullptr;
+    if (cb != nullptr) {
+        cb(frameTimeNanos, callbackData);
+    }
+}
+
+void FunkyBoyAndroid::Engine::setContentFrameRate(ANativeWindow *window, float frameRate) {
+    typedef int32_t (*set_frame_rate)(ANativeWindow *window, float frameRate, int8_t compatibility);
+    static auto setFrameRate = reinterpret_cast<set_frame_rate>(dlsym(RTLD_DEFAULT, "ANativeWindow_setFrameRate"));
+    if (setFrameRate == nullptr || window == nullptr) {
+        return;
+    }
+    if (setFrameRate(window, frameRate, FB_ANDROID_FRAME_RATE_COMPATIBILITY_FIXED_SOURCE) != 0) {
+        LOGW("Unable to set the frame rate of the window to %.2f", frameRate);
+    }
+}
@@ -0,0 +1,77 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FB_ANDROID_ENGINE_CHOREOGRAPHER_VSYNC_H
+#define FB_ANDROID_ENGINE_CHOREOGRAPHER_VSYNC_H
+
+#include "vsync_source.h"
+
+#include <android/native_window.h>
+
+namespace FunkyBoyAndroid::Engine {
+
+    /**
+     * Vsync source backed by the AChoreographer of the calling thread. The NDK only offers it
+     * from API level 24 on, so it is resolved at runtime.
+     */
+    class ChoreographerVsync: public VsyncSource {
+    private:
+        typedef void (*frame_callback)(long frameTimeNanos, void *data);
+        typedef void (*frame_callback64)(int64_t frameTimeNanos, void *data);
+        typedef void (*post_frame_callback)(void *choreographer, frame_callback callback, void *data);
+        typedef void (*post_frame_callback64)(void *choreographer, frame_callback64 callback, void *data);
+
+        void *choreographer;
+        post_frame_callback postFrameCallback;
+        post_frame_callback64 postFrameCallback64;
+        bool pending;
+        vsync_callback callback;
+        void *callbackData;
+
+        static void onFrame(long frameTimeNanos, void *data);
+        static void onFrame64(int64_t frameTimeNanos, void *data);
+        void dispatch(int64_t frameTimeNanos);
+
+    public:
+        ChoreographerVsync();
+
+        /**
+         * Binds to the choreographer of the calling thread, which has to have a looper.
+         *
+         * @return false if the device does not provide a choreographer
+         */
+        bool init();
+
+        inline bool isAvailable() const {
+            return choreographer != nullptr;
+        }
+
+        inline bool isPending() const {
+            return pending;
+        }
+
+        bool request(vsync_callback callback, void *data) override;
+    };
+
+    /**
+     * Tells the compositor the frame rate of the content, so that displays supporting several
+     * refresh rates can switch to a matching one. Does nothing before API level 30.
+     */
+    void setContentFrameRate(ANativeWindow *window, float frameRate);
+
+}
+
+#endif //FB_ANDROID_ENGINE_CHOREOGRAPHER_VSYNC_H
@@ -17,11 +17,17 @@
 #ifndef FB_ANDROID_ENGINE_ENGINE_H
 #define FB_ANDROID_ENGINE_ENGINE_H
 
-#include <vector>
+#include <cstdint>
 #include <engine/ui_obj.h>
 #include <jni.h>
 #include <android_native_app_glue.h>
 
+// Android pointer ids are always below 32 (MAX_POINTER_ID is 31)
+#define FB_ANDROID_MAX_POINTERS 32
+
+// Covers all Android key codes, which are below 320 as of API level 30
+#define FB_ANDROID_KEY_MAP_SIZE 512
+
 namespace FunkyBoyAndroid {
 
     /**
@@ -31,9 +37,6 @@ namespace FunkyBoyAndroid {
         struct android_app* app;
         JNIEnv *env;
 
-        jobject bitmapButtons;
-        jobject bitmapFontsUppercase;
-
         int32_t width;
         int32_t height;
 
@@ -52,10 +55,34 @@ namespace FunkyBoyAndroid {
         float uiScale;
 
         bool animating;
+        bool paused;
+
+        float emulationSpeed;
+        float frameBudget;
+        // Speed of the emulation relative to real time, as adjusted by the frame pacer to follow the display
+        double pacingSpeed;
 
+        // Combined joypad state of all input sources, as applied to the emulator
         int keyLatch;
+        int touchKeys;
+        int padKeys;
+        int axisKeys;
+
+        // Content of the status screen presented last, which is only redrawn when it changes
+        bool statusScreenDirty;
+        int32_t statusScreenStatus;
+        bool statusScreenBlink;
+
+        // Android key code to FBA_KEY_* mask
+        uint8_t keyMap[FB_ANDROID_KEY_MAP_SIZE];
+
+        uint8_t *hitMap;
+        uint32_t hitMapWidth;
+        uint32_t hitMapHeight;
 
-        std::vector<size_t> activePointerIds;
+        // Bit n is set while pointer id n is down
+        uint32_t activePointers;
+        uint8_t pointerKeys[FB_ANDROID_MAX_POINTERS];
     };
 
 }
@@ -0,0 +1,280 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "frame_pacer.h"
+
+#include <fba_util/logging.h>
+#include <cmath>
+#include <cstdlib>
+
+using namespace FunkyBoyAndroid::Engine;
+
+#ifdef FB_DEBUG
+namespace {
+
+    const char *modeNames[] = {
+            "estimating",
+            "vsync locked",
+            "real time",
+    };
+
+}
+#endif
+
+FramePacer::FramePacer(int64_t framePeriodNs)
+    : framePeriod(framePeriodNs)
+    , lastVsync(0)
+    , period(0)
+    , gridTime(0)
+    , gridIndex(0)
+    , anchorTime(0)
+    , anchorIndex(0)
+    , stableIntervals(0)
+    , outlierIntervals(0)
+    , outlierPeriodSum(0)
+    , mode(PacingMode::Estimating)
+    , lockingEnabled(true)
+    , cadenceVsyncs(1)
+    , cadenceFrames(1)
+    , cadencePhase(0)
+    , speed(1.0)
+    , clockOrigin(0)
+    , emittedFrames(0)
+    , lastPresentIndex(0)
+    , hasPresented(false)
+    , judderSum(0.0)
+    , judderSamples(0)
+    , stats()
+{
+}
+
+void FramePacer::setVsyncLocking(bool enabled) {
+    lockingEnabled = enabled;
+    if (mode != PacingMode::Estimating) {
+        choosePolicy();
+    }
+}
+
+void FramePacer::reset() {
+    // The next vsync starts over, without taking the pause as a vsync interval
+    lastVsync = 0;
+    hasPresented = false;
+}
+
+uint32_t FramePacer::updatePeriod(int64_t vsyncNs) {
+    int64_t delta = vsyncNs - lastVsync;
+    lastVsync = vsyncNs;
+    if (delta <= 0) {
+        return 0;
+    }
+    if (period == 0) {
+        period = delta;
+        anchorTime = vsyncNs - delta;
+        anchorIndex = gridIndex;
+        gridTime = vsyncNs;
+        gridIndex++;
+        return 1;
+    }
+
+    // Missed vsyncs show up as multiples of the period
+    auto intervals = static_cast<uint32_t>(std::llround(static_cast<double>(delta) / static_cast<double>(period)));
+    if (intervals == 0) {
+        intervals = 1;
+    }
+    int64_t interval = delta / intervals;
+    bool consistent = intervals == 1 && std::llabs(interval - period) <= period / 16;
+    if (consistent) {
+        stableIntervals++;
+        outlierIntervals = 0;
+        outlierPeriodSum = 0;
+    } else {
+        // Either vsyncs were missed, or the display switched its refresh rate. When this keeps
+        // happening, presenting at the new interval is all that is possible anyway.
+        outlierPeriodSum += delta;
+        if (++outlierIntervals >= FB_ANDROID_PACING_RATE_SWITCH_VSYNCS) {
+            period = outlierPeriodSum / outlierIntervals;
+            LOGD("Display period changed to %.3f ms", static_cast<double>(period) / 1e6);
+            stableIntervals = 0;
+            outlierIntervals = 0;
+            outlierPeriodSum = 0;
+            mode = PacingMode::Estimating;
+            speed = 1.0;
+            gridTime = vsyncNs;
+            gridIndex++;
+            anchorTime = vsyncNs;
+            anchorIndex = gridIndex;
+            return 1;
+        }
+    }
+
+    gridIndex += intervals;
+    uint64_t span = gridIndex - anchorIndex;
+    if (consistent && span >= FB_ANDROID_PACING_ESTIMATE_VSYNCS) {
+        period = (vsyncNs - anchorTime) / static_cast<int64_t>(span);
+    } else if (consistent) {
+        period += (interval - period) / 8;
+    }
+    gridTime += intervals * period;
+    // Follow the actual vsyncs slowly, so that the grid does not pick up the jitter of the timestamps
+    gridTime += (vsyncNs - gridTime) / 8;
+    if (std::llabs(vsyncNs - gridTime) > period) {
+        gridTime = vsyncNs;
+    }
+    return intervals;
+}
+
+void FramePacer::choosePolicy() {
+    PacingMode previousMode = mode;
+    mode = PacingMode::RealTime;
+    speed = 1.0;
+
+    // Vsyncs per emulated frame
+    double ratio = static_cast<double>(framePeriod) / static_cast<double>(period);
+    for (uint32_t frames = 1 ; lockingEnabled && frames <= FB_ANDROID_PACING_MAX_CADENCE_FRAMES ; frames++) {
+        auto vsyncs = static_cast<uint32_t>(std::llround(ratio * frames));
+        if (vsyncs == 0) {
+            continue;
+        }
+        double cadenceSpeed = ratio * frames / vsyncs;
+        if (std::fabs(cadenceSpeed - 1.0) <= FB_ANDROID_PACING_MAX_SPEED_ADJUST) {
+            mode = PacingMode::VsyncLocked;
+            if (vsyncs != cadenceVsyncs || frames != cadenceFrames) {
+                cadenceVsyncs = vsyncs;
+                cadenceFrames = frames;
+                cadencePhase = 0;
+            }
+            speed = cadenceSpeed;
+            break;
+        }
+    }
+
+    if (mode == PacingMode::RealTime && previousMode == PacingMode::VsyncLocked) {
+        clockOrigin = gridTime - framePeriod;
+        emittedFrames = 0;
+    }
+    if (mode != previousMode) {
+        LOGD("Frame pacing: %s at %.2f Hz, %u frames per %u vsyncs, speed %.4f",
+             modeNames[static_cast<int>(mode)], 1e9 / static_cast<double>(period),
+             cadenceFrames, cadenceVsyncs, speed);
+    }
+}
+
+uint32_t FramePacer::framesInRealTime() {
+    if (gridTime < clockOrigin) {
+        return 0;
+    }
+    auto due = static_cast<uint64_t>((gridTime - clockOrigin) / framePeriod);
+    if (due <= emittedFrames) {
+        return 0;
+    }
+    uint64_t frames = due - emittedFrames;
+    if (frames > FB_ANDROID_PACING_MAX_CATCH_UP) {
+        // The app did not keep up, e.g. because of a stall, so restart the clock
+        clockOrigin = gridTime - framePeriod;
+        emittedFrames = 0;
+        frames = 1;
+    }
+    emittedFrames += frames;
+    return static_cast<uint32_t>(frames);
+}
+
+uint32_t FramePacer::onVsync(int64_t vsyncNs) {
+    stats.vsyncs++;
+    uint32_t frames;
+    if (lastVsync == 0) {
+        // First vsync after starting or resuming
+        lastVsync = vsyncNs;
+        gridTime = vsyncNs;
+        if (period > 0) {
+            // The vsyncs during the pause are unknown, so the period is measured from here on
+            anchorTime = vsyncNs;
+            anchorIndex = gridIndex;
+        }
+        clockOrigin = vsyncNs - framePeriod;
+        emittedFrames = 0;
+        cadencePhase = 0;
+        frames = framesInRealTime();
+    } else {
+        uint32_t intervals = updatePeriod(vsyncNs);
+        if ((mode == PacingMode::Estimating && stableIntervals >= FB_ANDROID_PACING_ESTIMATE_VSYNCS)
+                || (intervals > 0 && stableIntervals == FB_ANDROID_PACING_REFINE_VSYNCS)) {
+            choosePolicy();
+        }
+        if (mode == PacingMode::VsyncLocked) {
+            cadencePhase += cadenceFrames * intervals;
+            frames = cadencePhase / cadenceVsyncs;
+            cadencePhase %= cadenceVsyncs;
+            if (frames > FB_ANDROID_PACING_MAX_CATCH_UP) {
+                frames = 1;
+            }
+        } else {
+            frames = framesInRealTime();
+        }
+    }
+    recordPresent(frames);
+    return frames;
+}
+
+void FramePacer::recordPresent(uint32_t frames) {
+    if (frames == 0) {
+        return;
+    }
+    stats.presentedFrames++;
+    stats.skippedFrames += frames - 1;
+    if (hasPresented && period > 0) {
+        auto vsyncs = static_cast<double>(gridIndex - lastPresentIndex);
+        double ideal = static_cast<double>(framePeriod) / speed;
+        double deviation = vsyncs * static_cast<double>(period) - ideal;
+        judderSum += deviation * deviation;
+        judderSamples++;
+        if (vsyncs > std::ceil(ideal / static_cast<double>(period) - 0.05)) {
+            stats.longFrames++;
+        }
+    }
+    lastPresentIndex = gridIndex;
+    hasPresented = true;
+    if (stats.presentedFrames % FB_ANDROID_PACING_REPORT_INTERVAL == 0) {
+        log();
+    }
+}
+
+pacing_stats FramePacer::getStats() const {
+    pacing_stats result = stats;
+    result.mode = mode;
+    result.displayPeriodNs = period;
+    result.cadenceVsyncs = mode == PacingMode::VsyncLocked ? cadenceVsyncs : 0;
+    result.cadenceFrames = mode == PacingMode::VsyncLocked ? cadenceFrames : 0;
+    result.speed = speed;
+    result.judderMs = judderSamples > 0 ? std::sqrt(judderSum / static_cast<double>(judderSamples)) / 1e6 : 0.0;
+    return result;
+}
+
+void FramePacer::resetStats() {
+    stats = {};
+    judderSum = 0.0;
+    judderSamples = 0;
+}
+
+void FramePacer::log() const {
+#ifdef FB_DEBUG
+    auto s = getStats();
+    LOGI("Frame pacing: %s at %.2f Hz, speed %.4f, judder %.2f ms, %llu long and %llu skipped of %llu frames over %llu vsyncs",
+         modeNames[static_cast<int>(s.mode)], s.displayPeriodNs > 0 ? 1e9 / static_cast<double>(s.displayPeriodNs) : 0.0,
+         s.speed, s.judderMs, static_cast<unsigned long long>(s.longFrames),
+         static_cast<unsigned long long>(s.skippedFrames), static_cast<unsigned long long>(s.presentedFrames),
+         static_cast<unsigned long long>(s.vsyncs));
+#endif
+}
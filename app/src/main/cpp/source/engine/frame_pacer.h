@@ -0,0 +1,159 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FB_ANDROID_ENGINE_FRAME_PACER_H
+#define FB_ANDROID_ENGINE_FRAME_PACER_H
+
+#include <cstdint>
+
+// The Game Boy completes a frame every 70224 cycles of its 4194304 Hz clock, which is about 59.73 Hz
+#define FB_ANDROID_GB_FRAME_NS 16742706
+
+// Amount of consistent vsync intervals before the estimated display period is trusted
+#define FB_ANDROID_PACING_ESTIMATE_VSYNCS 30
+
+// The policy is chosen again with the more precise estimate after this many consistent intervals
+#define FB_ANDROID_PACING_REFINE_VSYNCS 480
+
+// Amount of consecutive intervals off the estimate after which the display is assumed to have switched its rate
+#define FB_ANDROID_PACING_RATE_SWITCH_VSYNCS 8
+
+// Emulation may run up to 1% faster or slower in order to follow a regular vsync cadence
+#define FB_ANDROID_PACING_MAX_SPEED_ADJUST 0.01
+
+// Cadences of up to this many emulated frames per cycle are considered for locking to vsync
+#define FB_ANDROID_PACING_MAX_CADENCE_FRAMES 4
+
+// In real time pacing, a backlog of more frames than this is dropped instead of being caught up with
+#define FB_ANDROID_PACING_MAX_CATCH_UP 3
+
+// Amount of presented frames after which the pacing statistics get logged
+#define FB_ANDROID_PACING_REPORT_INTERVAL 1800
+
+namespace FunkyBoyAndroid::Engine {
+
+    enum class PacingMode: uint8_t {
+        // The display period is not known yet, frames are paced in real time meanwhile
+        Estimating,
+        // A fixed cadence of emulated frames per vsync, at a slightly adjusted emulation speed
+        VsyncLocked,
+        // Frames are emulated in real time, so that the audio stays in sync, and repeated as needed
+        RealTime,
+    };
+
+    struct pacing_stats {
+        PacingMode mode;
+        int64_t displayPeriodNs;
+        // Cadence while locked to vsync, as vsyncs per emulated frames
+        uint32_t cadenceVsyncs;
+        uint32_t cadenceFrames;
+        // Emulation speed relative to the Game Boy, which the audio has to be resampled by
+        double speed;
+        uint64_t vsyncs;
+        uint64_t presentedFrames;
+        // Frames shown for at least a vsync longer than the cadence asks for
+        uint64_t longFrames;
+        // Frames which were emulated, but never shown
+        uint64_t skippedFrames;
+        // Root mean square of the deviation of each frame's time on screen from its ideal duration
+        double judderMs;
+    };
+
+    /**
+     * Decides how many frames to emulate on each vsync of the display. The display period is
+     * learned from the vsync timestamps. If a small cadence of frames per vsyncs matches the
+     * display within FB_ANDROID_PACING_MAX_SPEED_ADJUST, e.g. 1:1 at 60 Hz, 2:3 at 90 Hz or 1:2 at
+     * 120 Hz, the emulation follows that cadence exactly and runs slightly fast or slow instead of
+     * dropping or repeating frames irregularly. Otherwise frames are emulated in real time against
+     * a jitter-free vsync grid, which keeps the audio in sync and repeats frames as evenly as the
+     * display allows.
+     * The period is measured over all vsyncs since the rate last changed, which averages out the
+     * jitter of individual timestamps.
+     * The pacer only sees timestamps, so that it can be driven by a simulated vsync source.
+     */
+    class FramePacer {
+    private:
+        int64_t framePeriod;
+
+        // Period estimation
+        int64_t lastVsync;
+        int64_t period;
+        int64_t gridTime;
+        uint64_t gridIndex;
+        int64_t anchorTime;
+        uint64_t anchorIndex;
+        uint32_t stableIntervals;
+        uint32_t outlierIntervals;
+        int64_t outlierPeriodSum;
+
+        PacingMode mode;
+        bool lockingEnabled;
+        uint32_t cadenceVsyncs;
+        uint32_t cadenceFrames;
+        uint32_t cadencePhase;
+        double speed;
+
+        // Real time pacing
+        int64_t clockOrigin;
+        uint64_t emittedFrames;
+
+        // Judder measurement
+        uint64_t lastPresentIndex;
+        bool hasPresented;
+        double judderSum;
+        uint64_t judderSamples;
+        pacing_stats stats;
+
+        uint32_t updatePeriod(int64_t vsyncNs);
+        void choosePolicy();
+        uint32_t framesInRealTime();
+        void recordPresent(uint32_t frames);
+
+    public:
+        explicit FramePacer(int64_t framePeriodNs = FB_ANDROID_GB_FRAME_NS);
+
+        /**
+         * Allows to compare against pure real time pacing
+         */
+        void setVsyncLocking(bool enabled);
+
+        /**
+         * Restarts the frame clock, e.g. after the emulation was paused. The display period is kept.
+         */
+        void reset();
+
+        /**
+         * @param vsyncNs timestamp of the vsync, based on CLOCK_MONOTONIC
+         * @return amount of frames to emulate for this vsync, of which the last one is presented
+         */
+        uint32_t onVsync(int64_t vsyncNs);
+
+        inline PacingMode getMode() const {
+            return mode;
+        }
+
+        inline double getSpeed() const {
+            return speed;
+        }
+
+        pacing_stats getStats() const;
+        void resetStats();
+        void log() const;
+    };
+
+}
+
+#endif //FB_ANDROID_ENGINE_FRAME_PACER_H
@@ -0,0 +1,116 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "hit_map.h"
+
+#include <cmath>
+#include <cstring>
+
+// tan(22.5°), separates straight from diagonal D-pad directions
+#define DPAD_DIAGONAL_SLOPE 0.41421356f
+
+namespace {
+
+    inline float cellCenter(uint32_t cell) {
+        return static_cast<float>((cell << FB_ANDROID_HIT_MAP_SHIFT) + (1 << FB_ANDROID_HIT_MAP_SHIFT) / 2);
+    }
+
+    void paintRect(struct FunkyBoyAndroid::engine *engine, const FunkyBoyAndroid::ui_obj &obj, uint8_t key, int margin, bool onlyEmpty) {
+        float left = static_cast<float>(obj.x) - margin;
+        float top = static_cast<float>(obj.y) - margin;
+        float right = static_cast<float>(obj.x + obj.width) + margin;
+        float bottom = static_cast<float>(obj.y + obj.height) + margin;
+        for (uint32_t y = 0 ; y < engine->hitMapHeight ; y++) {
+            float cy = cellCenter(y);
+            if (cy < top || cy >= bottom) {
+                continue;
+            }
+            uint8_t *row = engine->hitMap + (y * engine->hitMapWidth);
+            for (uint32_t x = 0 ; x < engine->hitMapWidth ; x++) {
+                float cx = cellCenter(x);
+                if (cx >= left && cx < right && (!onlyEmpty || row[x] == 0)) {
+                    row[x] |= key;
+                }
+            }
+        }
+    }
+
+    void paintDPad(struct FunkyBoyAndroid::engine *engine, int margin) {
+        float left = static_cast<float>(engine->keyLeft.x) - margin;
+        float top = static_cast<float>(engine->keyUp.y) - margin;
+        float right = static_cast<float>(engine->keyRight.x + engine->keyRight.width) + margin;
+        float bottom = static_cast<float>(engine->keyDown.y + engine->keyDown.height) + margin;
+        float centerX = (left + right) / 2.0f;
+        float centerY = (top + bottom) / 2.0f;
+        for (uint32_t y = 0 ; y < engine->hitMapHeight ; y++) {
+            float cy = cellCenter(y);
+            if (cy < top || cy >= bottom) {
+                continue;
+            }
+            uint8_t *row = engine->hitMap + (y * engine->hitMapWidth);
+            for (uint32_t x = 0 ; x < engine->hitMapWidth ; x++) {
+                float cx = cellCenter(x);
+                if (cx < left || cx >= right || row[x] != 0) {
+                    continue;
+                }
+                float dx = cx - centerX;
+                float dy = cy - centerY;
+                if (std::fabs(dx) < FB_ANDROID_DPAD_DEAD_ZONE && std::fabs(dy) < FB_ANDROID_DPAD_DEAD_ZONE) {
+                    continue;
+                }
+                uint8_t keys = 0;
+                // Horizontal component, unless the touch is (almost) straight up or down
+                if (std::fabs(dx) > std::fabs(dy) * DPAD_DIAGONAL_SLOPE) {
+                    keys |= dx < 0 ? FBA_KEY_LEFT : FBA_KEY_RIGHT;
+                }
+                // Vertical component, unless the touch is (almost) straight left or right
+                if (std::fabs(dy) > std::fabs(dx) * DPAD_DIAGONAL_SLOPE) {
+                    keys |= dy < 0 ? FBA_KEY_UP : FBA_KEY_DOWN;
+                }
+                row[x] = keys;
+            }
+        }
+    }
+
+}
+
+void FunkyBoyAndroid::Engine::bakeHitMap(struct engine *engine) {
+    freeHitMap(engine);
+    engine->hitMapWidth = (engine->bufferWidth >> FB_ANDROID_HIT_MAP_SHIFT) + 1;
+    engine->hitMapHeight = (engine->bufferHeight >> FB_ANDROID_HIT_MAP_SHIFT) + 1;
+    engine->hitMap = new uint8_t[engine->hitMapWidth * engine->hitMapHeight];
+    std::memset(engine->hitMap, 0, engine->hitMapWidth * engine->hitMapHeight);
+
+    // Exact button areas first, so that slop regions never take precedence over them
+    paintRect(engine, engine->keyA, FBA_KEY_A, 0, false);
+    paintRect(engine, engine->keyB, FBA_KEY_B, 0, false);
+    paintRect(engine, engine->keyStart, FBA_KEY_START, 0, false);
+    paintRect(engine, engine->keySelect, FBA_KEY_SELECT, 0, false);
+    paintDPad(engine, 0);
+
+    paintRect(engine, engine->keyA, FBA_KEY_A, FB_ANDROID_TOUCH_SLOP, true);
+    paintRect(engine, engine->keyB, FBA_KEY_B, FB_ANDROID_TOUCH_SLOP, true);
+    paintRect(engine, engine->keyStart, FBA_KEY_START, FB_ANDROID_TOUCH_SLOP, true);
+    paintRect(engine, engine->keySelect, FBA_KEY_SELECT, FB_ANDROID_TOUCH_SLOP, true);
+    paintDPad(engine, FB_ANDROID_TOUCH_SLOP);
+}
+
+void FunkyBoyAndroid::Engine::freeHitMap(struct engine *engine) {
+    delete[] engine->hitMap;
+    engine->hitMap = nullptr;
+    engine->hitMapWidth = 0;
+    engine->hitMapHeight = 0;
+}
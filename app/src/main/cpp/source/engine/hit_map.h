@@ -0,0 +1,63 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FB_ANDROID_ENGINE_HIT_MAP_H
+#define FB_ANDROID_ENGINE_HIT_MAP_H
+
+#include <engine/engine.h>
+
+#define FBA_KEY_A 0b00000001
+#define FBA_KEY_B 0b00000010
+#define FBA_KEY_START 0b00000100
+#define FBA_KEY_SELECT 0b00001000
+#define FBA_KEY_LEFT 0b00010000
+#define FBA_KEY_UP 0b00100000
+#define FBA_KEY_RIGHT 0b01000000
+#define FBA_KEY_DOWN 0b10000000
+
+// Each hit map cell covers (1 << FB_ANDROID_HIT_MAP_SHIFT) pixels of the scaled buffer in both directions
+#define FB_ANDROID_HIT_MAP_SHIFT 1
+
+// Margin around buttons which still counts as a touch, as long as no other button is closer
+#define FB_ANDROID_TOUCH_SLOP 4
+
+// Radius around the D-pad center in which no direction is triggered
+#define FB_ANDROID_DPAD_DEAD_ZONE 4
+
+namespace FunkyBoyAndroid::Engine {
+
+    /**
+     * Precomputes a map from scaled touch coordinates to key masks, based on the key positions
+     * set up in initDisplay(). Diagonal D-pad zones and slop regions are encoded in the map.
+     */
+    void bakeHitMap(struct engine *engine);
+    void freeHitMap(struct engine *engine);
+
+    inline uint8_t hitTest(const struct engine *engine, float scaledX, float scaledY) {
+        if (scaledX < 0.0f || scaledY < 0.0f) {
+            return 0;
+        }
+        auto cellX = static_cast<uint32_t>(scaledX) >> FB_ANDROID_HIT_MAP_SHIFT;
+        auto cellY = static_cast<uint32_t>(scaledY) >> FB_ANDROID_HIT_MAP_SHIFT;
+        if (engine->hitMap == nullptr || cellX >= engine->hitMapWidth || cellY >= engine->hitMapHeight) {
+            return 0;
+        }
+        return engine->hitMap[cellY * engine->hitMapWidth + cellX];
+    }
+
+}
+
+#endif //FB_ANDROID_ENGINE_HIT_MAP_H
@@ -19,10 +19,44 @@
 #include <fba_util/logging.h>
 #include <util/typedefs.h>
 #include <cmath>
-#include <fb_jni.h>
+#include <engine/hit_map.h>
+#include <ui/draw_text.h>
+#include <fb_app_textures.h>
+
+#ifdef FB_DEBUG
+#include <ui/draw_controls.h>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#endif
+
+namespace {
+
+#ifdef FB_DEBUG
+    void benchmarkBlits(struct FunkyBoyAndroid::engine *engine) {
+        const int iterations = 1000;
+        std::unique_ptr<uint32_t[]> pixels(new uint32_t[engine->bufferWidth * engine->bufferHeight]);
+        ANativeWindow_Buffer buffer{};
+        buffer.width = engine->bufferWidth;
+        buffer.height = engine->bufferHeight;
+        buffer.stride = engine->bufferWidth;
+        buffer.bits = pixels.get();
+
+        const char *text = "PRESS START";
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0 ; i < iterations ; i++) {
+            FunkyBoyAndroid::drawControls(engine, buffer);
+            FunkyBoyAndroid::drawTextAt(buffer, FunkyBoyAndroid::R::Drawable::fontUppercase, text, 0, 0, 0);
+        }
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        // D-pad, A, B, start and select plus one glyph per character
+        size_t pixelsPerIteration = (50 * 50) + 2 * (25 * 25) + 2 * (25 * 10) + std::strlen(text) * 7 * FBA_CHAR_HEIGHT;
+        LOGD("UI blits take %.2f us per frame, %.1f MPixels/s", elapsed / 1000.0 / iterations,
+             static_cast<double>(pixelsPerIteration) * iterations * 1000.0 / elapsed);
+    }
+#endif
 
-#define BITMAP_TYPE_BUTTONS 0
-#define BITMAP_FONT_UPPERCASE 1
+}
 
 int FunkyBoyAndroid::Engine::initDisplay(struct engine *engine) {
     LOGD("engine_init_display");
@@ -87,25 +121,21 @@ int FunkyBoyAndroid::Engine::initDisplay(struct engine *engine) {
     uiObjTemplate.x = (FB_GB_DISPLAY_WIDTH - 25) / 2;
     uiObjTemplate.y = FB_GB_DISPLAY_HEIGHT + 10;
 
+    bakeHitMap(engine);
+
     auto result = ANativeWindow_setBuffersGeometry(window, bufferWidth, bufferHeight, WINDOW_FORMAT_RGBA_8888);
     if (result != 0) {
         LOGW("Unable to set buffers geometry");
     }
 
-    jobject bitmap = loadBitmap(engine, BITMAP_TYPE_BUTTONS);
-    if (bitmap != nullptr) {
-        bitmap = engine->env->NewGlobalRef(bitmap);
-        engine->bitmapButtons = bitmap;
-    } else {
-        LOGW("Unable to load buttons texture bitmap");
-    }
-    bitmap = loadBitmap(engine, BITMAP_FONT_UPPERCASE);
-    if (bitmap != nullptr) {
-        bitmap = engine->env->NewGlobalRef(bitmap);
-        engine->bitmapFontsUppercase = bitmap;
-    } else {
-        LOGW("Unable to load uppercase font bitmap");
+#ifdef FB_DEBUG
+    // The kernels do not depend on the window, so measuring them once per process is enough
+    static bool blitsBenchmarked = false;
+    if (!blitsBenchmarked) {
+        blitsBenchmarked = true;
+        benchmarkBlits(engine);
     }
+#endif
 
     engine->keyLatch = 0;
 
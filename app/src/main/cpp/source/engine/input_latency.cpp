@@ -0,0 +1,134 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "input_latency.h"
+
+#include <fba_util/logging.h>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+using namespace FunkyBoyAndroid::Engine;
+
+namespace {
+
+    const char *sourceNames[InputSourceCount] = {
+            "touch",
+            "gamepad",
+    };
+
+}
+
+LatencyHistogram::LatencyHistogram()
+    : buckets()
+    , count(0)
+    , sum(0)
+    , max(0)
+{
+}
+
+void LatencyHistogram::record(int64_t latencyNs) {
+    if (latencyNs < 0) {
+        latencyNs = 0;
+    }
+    int64_t bucket = latencyNs / FB_ANDROID_LATENCY_BUCKET_NS;
+    if (bucket >= FB_ANDROID_LATENCY_BUCKET_COUNT) {
+        bucket = FB_ANDROID_LATENCY_BUCKET_COUNT - 1;
+    }
+    buckets[bucket]++;
+    count++;
+    sum += latencyNs;
+    if (latencyNs > max) {
+        max = latencyNs;
+    }
+}
+
+void LatencyHistogram::reset() {
+    std::memset(buckets, 0, sizeof(buckets));
+    count = 0;
+    sum = 0;
+    max = 0;
+}
+
+int64_t LatencyHistogram::percentile(float p) const {
+    auto target = static_cast<uint32_t>(static_cast<float>(count) * p);
+    uint32_t seen = 0;
+    for (int i = 0 ; i < FB_ANDROID_LATENCY_BUCKET_COUNT ; i++) {
+        seen += buckets[i];
+        if (seen > target) {
+            return static_cast<int64_t>(i + 1) * FB_ANDROID_LATENCY_BUCKET_NS;
+        }
+    }
+    return max;
+}
+
+void LatencyHistogram::log(const char *name) const {
+    if (count == 0) {
+        return;
+    }
+    LOGI("%s latency over %u samples: mean %.2f ms, p50 %.2f ms, p90 %.2f ms, p99 %.2f ms, max %.2f ms",
+         name, count, static_cast<double>(sum) / count / 1e6, percentile(0.5f) / 1e6,
+         percentile(0.9f) / 1e6, percentile(0.99f) / 1e6, max / 1e6);
+}
+
+InputLatency::InputLatency()
+    : pendingEventTime(0)
+    , pendingSource(InputSource::Touch)
+    , changes(0)
+{
+}
+
+int64_t InputLatency::now() {
+    struct timespec ts{};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+void InputLatency::onChange() {
+    if (++changes % FB_ANDROID_INPUT_LATENCY_REPORT_INTERVAL == 0) {
+        log();
+    }
+}
+
+void InputLatency::onApplied(InputSource source, int64_t eventTime) {
+#ifdef FB_DEBUG
+    dispatch[source].record(now() - eventTime);
+    if (pendingEventTime == 0) {
+        pendingEventTime = eventTime;
+        pendingSource = source;
+    }
+    onChange();
+#endif
+}
+
+void InputLatency::onFrameStart() {
+#ifdef FB_DEBUG
+    if (pendingEventTime != 0) {
+        frame[pendingSource].record(now() - pendingEventTime);
+        pendingEventTime = 0;
+    }
+#endif
+}
+
+void InputLatency::log() const {
+    char name[32];
+    for (int i = 0 ; i < InputSourceCount ; i++) {
+        snprintf(name, sizeof(name), "%s dispatch", sourceNames[i]);
+        dispatch[i].log(name);
+        snprintf(name, sizeof(name), "%s to frame", sourceNames[i]);
+        frame[i].log(name);
+    }
+}
@@ -0,0 +1,97 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FB_ANDROID_ENGINE_INPUT_LATENCY_H
+#define FB_ANDROID_ENGINE_INPUT_LATENCY_H
+
+#include <cstdint>
+
+// Latency histograms have buckets of 250 us, covering up to 64 ms
+#define FB_ANDROID_LATENCY_BUCKET_NS 250000
+#define FB_ANDROID_LATENCY_BUCKET_COUNT 256
+
+// Amount of input changes after which the latency statistics get logged
+#define FB_ANDROID_INPUT_LATENCY_REPORT_INTERVAL 200
+
+namespace FunkyBoyAndroid::Engine {
+
+    enum InputSource: uint8_t {
+        Touch,
+        Gamepad,
+        InputSourceCount,
+    };
+
+    /**
+     * Fixed-size latency histogram which can be filled without allocating.
+     */
+    class LatencyHistogram {
+    private:
+        uint32_t buckets[FB_ANDROID_LATENCY_BUCKET_COUNT];
+        uint32_t count;
+        int64_t sum;
+        int64_t max;
+
+    public:
+        LatencyHistogram();
+
+        void record(int64_t latencyNs);
+        void reset();
+
+        inline uint32_t getCount() const {
+            return count;
+        }
+
+        /**
+         * @return upper bound of the bucket containing the given percentile, in nanoseconds
+         */
+        int64_t percentile(float p) const;
+
+        void log(const char *name) const;
+    };
+
+    /**
+     * Measures the latency of input changes per input source. The dispatch latency covers the
+     * time from the kernel timestamping the event until the emulator's joypad state got updated,
+     * the frame latency extends it until the start of the first frame emulated with that state.
+     * Nothing is measured without FB_DEBUG, as the statistics are only logged in debug builds.
+     */
+    class InputLatency {
+    private:
+        LatencyHistogram dispatch[InputSourceCount];
+        LatencyHistogram frame[InputSourceCount];
+        int64_t pendingEventTime;
+        InputSource pendingSource;
+        uint32_t changes;
+
+        void onChange();
+
+    public:
+        InputLatency();
+
+        /**
+         * @param eventTime event time as reported by Android, based on CLOCK_MONOTONIC
+         */
+        void onApplied(InputSource source, int64_t eventTime);
+        void onFrameStart();
+
+        void log() const;
+
+        static int64_t now();
+    };
+
+}
+
+#endif //FB_ANDROID_ENGINE_INPUT_LATENCY_H
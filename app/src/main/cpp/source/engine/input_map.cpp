@@ -0,0 +1,79 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "input_map.h"
+
+#include <engine/hit_map.h>
+#include <cstring>
+
+namespace {
+
+    const struct {
+        int32_t keyCode;
+        uint8_t keys;
+    } defaultKeyMap[] = {
+            // Gamepads
+            {AKEYCODE_DPAD_UP, FBA_KEY_UP},
+            {AKEYCODE_DPAD_DOWN, FBA_KEY_DOWN},
+            {AKEYCODE_DPAD_LEFT, FBA_KEY_LEFT},
+            {AKEYCODE_DPAD_RIGHT, FBA_KEY_RIGHT},
+            {AKEYCODE_BUTTON_A, FBA_KEY_A},
+            {AKEYCODE_BUTTON_B, FBA_KEY_B},
+            {AKEYCODE_BUTTON_X, FBA_KEY_B},
+            {AKEYCODE_BUTTON_Y, FBA_KEY_A},
+            {AKEYCODE_BUTTON_START, FBA_KEY_START},
+            {AKEYCODE_BUTTON_SELECT, FBA_KEY_SELECT},
+            // Keyboards, arrow keys are reported as D-pad keys
+            {AKEYCODE_X, FBA_KEY_A},
+            {AKEYCODE_Z, FBA_KEY_B},
+            {AKEYCODE_ENTER, FBA_KEY_START},
+            {AKEYCODE_SHIFT_RIGHT, FBA_KEY_SELECT},
+            {AKEYCODE_DEL, FBA_KEY_SELECT},
+    };
+
+    inline uint8_t axisKeys(float value, uint8_t negative, uint8_t positive) {
+        if (value <= -FB_ANDROID_AXIS_THRESHOLD) {
+            return negative;
+        } else if (value >= FB_ANDROID_AXIS_THRESHOLD) {
+            return positive;
+        }
+        return 0;
+    }
+
+}
+
+void FunkyBoyAndroid::Engine::resetKeyMap(struct engine *engine) {
+    std::memset(engine->keyMap, 0, sizeof(engine->keyMap));
+    for (auto &mapping : defaultKeyMap) {
+        engine->keyMap[mapping.keyCode] = mapping.keys;
+    }
+}
+
+bool FunkyBoyAndroid::Engine::mapKey(struct engine *engine, int32_t keyCode, uint8_t keys) {
+    if (keyCode < 0 || keyCode >= FB_ANDROID_KEY_MAP_SIZE) {
+        return false;
+    }
+    engine->keyMap[keyCode] = keys;
+    return true;
+}
+
+uint8_t FunkyBoyAndroid::Engine::readAxes(const AInputEvent *event) {
+    // Only the most recent sample is of interest, historical ones would only add lag
+    return axisKeys(AMotionEvent_getAxisValue(event, AMOTION_EVENT_AXIS_X, 0), FBA_KEY_LEFT, FBA_KEY_RIGHT)
+        | axisKeys(AMotionEvent_getAxisValue(event, AMOTION_EVENT_AXIS_Y, 0), FBA_KEY_UP, FBA_KEY_DOWN)
+        | axisKeys(AMotionEvent_getAxisValue(event, AMOTION_EVENT_AXIS_HAT_X, 0), FBA_KEY_LEFT, FBA_KEY_RIGHT)
+        | axisKeys(AMotionEvent_getAxisValue(event, AMOTION_EVENT_AXIS_HAT_Y, 0), FBA_KEY_UP, FBA_KEY_DOWN);
+}
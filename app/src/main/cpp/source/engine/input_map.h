@@ -0,0 +1,55 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FB_ANDROID_ENGINE_INPUT_MAP_H
+#define FB_ANDROID_ENGINE_INPUT_MAP_H
+
+#include <engine/engine.h>
+#include <android/input.h>
+
+// Stick deflection above which a direction counts as pressed
+#define FB_ANDROID_AXIS_THRESHOLD 0.5f
+
+namespace FunkyBoyAndroid::Engine {
+
+    /**
+     * Restores the default mapping of gamepad buttons and keyboard keys to FBA_KEY_* masks.
+     */
+    void resetKeyMap(struct engine *engine);
+
+    /**
+     * Maps an Android key code to a mask of FBA_KEY_* bits, 0 removes the mapping.
+     *
+     * @return false if the key code is out of range
+     */
+    bool mapKey(struct engine *engine, int32_t keyCode, uint8_t keys);
+
+    inline uint8_t lookupKey(const struct engine *engine, int32_t keyCode) {
+        if (keyCode < 0 || keyCode >= FB_ANDROID_KEY_MAP_SIZE) {
+            return 0;
+        }
+        return engine->keyMap[keyCode];
+    }
+
+    /**
+     * Resolves the D-pad directions of a joystick motion event, considering both the left stick
+     * and the hat axes.
+     */
+    uint8_t readAxes(const AInputEvent *event);
+
+}
+
+#endif //FB_ANDROID_ENGINE_INPUT_MAP_H
@@ -0,0 +1,54 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "simulated_vsync.h"
+
+using namespace FunkyBoyAndroid::Engine;
+
+SimulatedVsync::SimulatedVsync(int64_t periodNs, int64_t jitterNs, double missRate, uint32_t seed)
+    : period(periodNs)
+    , jitter(jitterNs)
+    , missRate(missRate)
+    , idealTime(periodNs)
+    , random(seed)
+    , callback(nullptr)
+    , callbackData(nullptr)
+{
+}
+
+bool SimulatedVsync::request(vsync_callback cb, void *data) {
+    callback = cb;
+    callbackData = data;
+    return true;
+}
+
+void SimulatedVsync::tick() {
+    idealTime += period;
+    if (callback == nullptr) {
+        return;
+    }
+    if (missRate > 0.0 && std::uniform_real_distribution<double>(0.0, 1.0)(random) < missRate) {
+        // The app was too late for this vsync, so the callback comes with the next one
+        return;
+    }
+    int64_t timestamp = idealTime;
+    if (jitter > 0) {
+        timestamp += std::uniform_int_distribution<int64_t>(-jitter, jitter)(random);
+    }
+    vsync_callback cb = callback;
+    callback = nullptr;
+    cb(timestamp, callbackData);
+}
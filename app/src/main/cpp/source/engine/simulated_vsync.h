@@ -0,0 +1,64 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FB_ANDROID_ENGINE_SIMULATED_VSYNC_H
+#define FB_ANDROID_ENGINE_SIMULATED_VSYNC_H
+
+#include "vsync_source.h"
+
+#include <random>
+
+namespace FunkyBoyAndroid::Engine {
+
+    /**
+     * Vsync source with a configurable period, timestamp jitter and rate of missed callbacks,
+     * which allows to evaluate frame pacing without a display, see tools/pacing.
+     */
+    class SimulatedVsync: public VsyncSource {
+    private:
+        int64_t period;
+        int64_t jitter;
+        double missRate;
+        int64_t idealTime;
+        std::mt19937 random;
+        vsync_callback callback;
+        void *callbackData;
+
+    public:
+        SimulatedVsync(int64_t periodNs, int64_t jitterNs, double missRate, uint32_t seed);
+
+        /**
+         * Changes the refresh rate from the next vsync on, like a display switching modes
+         */
+        inline void setPeriod(int64_t periodNs) {
+            period = periodNs;
+        }
+
+        bool request(vsync_callback callback, void *data) override;
+
+        /**
+         * Advances to the next vsync and delivers the pending callback, unless the vsync is missed.
+         */
+        void tick();
+
+        inline int64_t now() const {
+            return idealTime;
+        }
+    };
+
+}
+
+#endif //FB_ANDROID_ENGINE_SIMULATED_VSYNC_H
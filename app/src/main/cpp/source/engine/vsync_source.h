@@ -0,0 +1,43 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FB_ANDROID_ENGINE_VSYNC_SOURCE_H
+#define FB_ANDROID_ENGINE_VSYNC_SOURCE_H
+
+#include <cstdint>
+
+namespace FunkyBoyAndroid::Engine {
+
+    typedef void (*vsync_callback)(int64_t vsyncNs, void *data);
+
+    /**
+     * Delivers the timestamps of display vsyncs, one callback per request.
+     */
+    class VsyncSource {
+    public:
+        virtual ~VsyncSource() = default;
+
+        /**
+         * Calls back once on the next vsync. A request replaces the pending one.
+         *
+         * @return false if no vsync signal is available
+         */
+        virtual bool request(vsync_callback callback, void *data) = 0;
+    };
+
+}
+
+#endif //FB_ANDROID_ENGINE_VSYNC_SOURCE_H
@@ -15,76 +15,218 @@
  */
 
 #include "fb_jni.h"
+#include <fb_jni_bindings.h>
 #include <cstring>
 #include <unistd.h>
 #include <android/native_activity.h>
+#include <fba_util/rom_library.h>
+#include <fba_util/logging.h>
 
 void FunkyBoyAndroid::requestPickRom(struct engine* engine) {
-    ANativeActivity *nativeActivity = engine->app->activity;
-    JNIEnv *env = engine->env;
-
-    jobject nativeActivityObj = nativeActivity->clazz; // "clazz" is misnamed, this is the actual activity instance
-    jclass nativeActivityClass = env->GetObjectClass(nativeActivity->clazz);
-    jmethodID method = env->GetMethodID(nativeActivityClass, "requestPickRom", "()V");
-
-    env->CallVoidMethod(nativeActivityObj, method);
-}
-
-jobject FunkyBoyAndroid::loadBitmap(struct engine* engine, jint type) {
-    ANativeActivity *nativeActivity = engine->app->activity;
-    JNIEnv *env = engine->env;
-
-    jobject nativeActivityObj = nativeActivity->clazz; // "clazz" is misnamed, this is the actual activity instance
-    jclass nativeActivityClass = env->GetObjectClass(nativeActivity->clazz);
-    jmethodID method = env->GetMethodID(nativeActivityClass, "loadBitmap", "(I)Landroid/graphics/Bitmap;");
-
-    jobject bitmap = env->CallObjectMethod(nativeActivityObj, method, type);
-
-    return bitmap;
+    engine->env->CallVoidMethod(JNI::activity(), JNI::method(JNI::requestPickRom));
 }
 
 std::string FunkyBoyAndroid::getSavePath(struct engine* engine, const FunkyBoy::ROMHeader *romHeader) {
-    ANativeActivity *nativeActivity = engine->app->activity;
-    JNIEnv *env = engine->env;
+    return getSavePath(engine->env, romHeader);
+}
 
-    jobject nativeActivityObj = nativeActivity->clazz; // "clazz" is misnamed, this is the actual activity instance
-    jclass nativeActivityClass = env->GetObjectClass(nativeActivity->clazz);
-    jmethodID method = env->GetMethodID(nativeActivityClass, "getSavePath", "(Ljava/lang/String;II)Ljava/lang/String;");
+std::string FunkyBoyAndroid::getSavePath(JNIEnv *env, const FunkyBoy::ROMHeader *romHeader) {
+    if (env->PushLocalFrame(2) < 0) {
+        LOGW("Unable to allocate a local reference frame");
+        return std::string();
+    }
 
     char romTitleSafe[FB_ROM_HEADER_TITLE_BYTES + 1]{};
     std::memcpy(romTitleSafe, romHeader->title, FB_ROM_HEADER_TITLE_BYTES);
 
     jstring romTitle = env->NewStringUTF(romTitleSafe);
     auto path = static_cast<jstring>(env->CallObjectMethod(
-            nativeActivityObj, method, romTitle,
+            JNI::activity(), JNI::method(JNI::getSavePath), romTitle,
             romHeader->destinationCode,
             (romHeader->globalChecksum[0] << 8) | romHeader->globalChecksum[1]
     ));
 
     std::string savePath;
-    jboolean isCopy;
-    const char *jstr = env->GetStringUTFChars(path, &isCopy);
-    savePath = jstr;
-    env->ReleaseStringUTFChars(path, jstr);
+    if (path != nullptr) {
+        jboolean isCopy;
+        const char *jstr = env->GetStringUTFChars(path, &isCopy);
+        savePath = jstr;
+        env->ReleaseStringUTFChars(path, jstr);
+    }
 
-    env->DeleteLocalRef(romTitle);
-    env->DeleteLocalRef(path);
+    // Releases romTitle and path
+    env->PopLocalFrame(nullptr);
 
     return savePath;
 }
 
+void FunkyBoyAndroid::reportFullyDrawn(struct engine* engine) {
+    engine->env->CallVoidMethod(JNI::activity(), JNI::method(JNI::reportFullyDrawn));
+}
+
+void FunkyBoyAndroid::reportROMNotReadable(struct engine* engine, const std::string &path) {
+    jstring jpath = engine->env->NewStringUTF(path.c_str());
+    engine->env->CallVoidMethod(JNI::activity(), JNI::method(JNI::reportROMNotReadable), jpath);
+    engine->env->DeleteLocalRef(jpath);
+}
+
+static std::string getPrintableTitle(const FunkyBoyAndroid::rom_library_entry &entry) {
+    // Titles are padded with zeros, and may contain any byte on unlicensed cartridges
+    std::string title;
+    for (auto c : entry.title) {
+        if (c == 0) {
+            break;
+        }
+        title += c >= 0x20 && c < 0x7f ? static_cast<char>(c) : '?';
+    }
+    return title;
+}
+
+/**
+ * Enqueues a command for the looper thread, after letting the caller fill in its arguments.
+ */
+template<typename Setup>
+static bool sendCommand(FunkyBoyAndroid::CommandType type, Setup setup) {
+    FunkyBoyAndroid::app_command command{};
+    command.type = type;
+    setup(command);
+    return fbCommandChannel.send(command);
+}
+
+static bool sendCommand(FunkyBoyAndroid::CommandType type) {
+    return sendCommand(type, [](FunkyBoyAndroid::app_command &) {});
+}
+
+/**
+ * Paths are copied into the command, as the channel does not allocate. Longer paths could not be
+ * stored in the app state or a movie either, so they are rejected and reported back to Kotlin.
+ */
+static jboolean sendPathCommand(JNIEnv *env, FunkyBoyAndroid::CommandType type, jstring path) {
+    jsize strln = env->GetStringUTFLength(path);
+    if (strln >= FB_ANDROID_APP_STATE_ROM_PATH_BUFFER_SIZE) {
+        LOGW("Path is too long (%d bytes)", strln);
+        return JNI_FALSE;
+    }
+    return sendCommand(type, [env, path](FunkyBoyAndroid::app_command &command) {
+        env->GetStringUTFRegion(path, 0, env->GetStringLength(path), command.path);
+    }) ? JNI_TRUE : JNI_FALSE;
+}
+
 extern "C" {
 
-    JNIEXPORT void JNICALL Java_lu_kremi151_funkyboy_FunkyBoyActivity_romPicked(JNIEnv *env, jobject, jstring path) {
-        jboolean isCopy;
-        auto path_cstr = env->GetStringUTFChars(path, &isCopy);
+    JNIEXPORT jboolean JNICALL Java_lu_kremi151_funkyboy_FunkyBoyActivity_romPicked(JNIEnv *env, jobject, jstring path) {
+        return sendPathCommand(env, FunkyBoyAndroid::CommandType::LoadROM, path);
+    }
+
+    JNIEXPORT void JNICALL Java_lu_kremi151_funkyboy_FunkyBoyActivity_saveSlot(JNIEnv *env, jobject, jint slot) {
+        sendCommand(FunkyBoyAndroid::CommandType::SaveSlot, [slot](FunkyBoyAndroid::app_command &command) {
+            command.slot = slot;
+        });
+    }
 
-        size_t strln = std::strlen(path_cstr);
+    JNIEXPORT void JNICALL Java_lu_kremi151_funkyboy_FunkyBoyActivity_loadSlot(JNIEnv *env, jobject, jint slot) {
+        sendCommand(FunkyBoyAndroid::CommandType::LoadSlot, [slot](FunkyBoyAndroid::app_command &command) {
+            command.slot = slot;
+        });
+    }
+
+    JNIEXPORT void JNICALL Java_lu_kremi151_funkyboy_FunkyBoyActivity_setPaused(JNIEnv *env, jobject, jboolean paused) {
+        sendCommand(FunkyBoyAndroid::CommandType::SetPaused, [paused](FunkyBoyAndroid::app_command &command) {
+            command.paused = paused;
+        });
+    }
 
-        write(fbMsgPipe[1], reinterpret_cast<char *>(&strln), sizeof(size_t));
-        write(fbMsgPipe[1], path_cstr, strln);
+    JNIEXPORT void JNICALL Java_lu_kremi151_funkyboy_FunkyBoyActivity_setSpeed(JNIEnv *env, jobject, jfloat speed) {
+        sendCommand(FunkyBoyAndroid::CommandType::SetSpeed, [speed](FunkyBoyAndroid::app_command &command) {
+            command.speed = speed;
+        });
+    }
 
-        env->ReleaseStringUTFChars(path, path_cstr);
+    JNIEXPORT void JNICALL Java_lu_kremi151_funkyboy_FunkyBoyActivity_setPalette(JNIEnv *env, jobject, jint palette) {
+        sendCommand(FunkyBoyAndroid::CommandType::SetPalette, [palette](FunkyBoyAndroid::app_command &command) {
+            command.palette = palette;
+        });
+    }
+
+    JNIEXPORT jboolean JNICALL Java_lu_kremi151_funkyboy_FunkyBoyActivity_recordMovie(JNIEnv *env, jobject, jstring path) {
+        return sendPathCommand(env, FunkyBoyAndroid::CommandType::RecordMovie, path);
+    }
+
+    JNIEXPORT void JNICALL Java_lu_kremi151_funkyboy_FunkyBoyActivity_stopMovie(JNIEnv *env, jobject) {
+        sendCommand(FunkyBoyAndroid::CommandType::StopMovie);
+    }
+
+    JNIEXPORT jboolean JNICALL Java_lu_kremi151_funkyboy_FunkyBoyActivity_playMovie(JNIEnv *env, jobject, jstring path) {
+        return sendPathCommand(env, FunkyBoyAndroid::CommandType::PlayMovie, path);
+    }
+
+#ifdef FB_ANDROID_BENCHMARK
+    JNIEXPORT jboolean JNICALL Java_lu_kremi151_funkyboy_FunkyBoyActivity_verifyMovie(JNIEnv *env, jobject, jstring path) {
+        return sendPathCommand(env, FunkyBoyAndroid::CommandType::VerifyMovie, path);
+    }
+#endif
+
+    JNIEXPORT void JNICALL Java_lu_kremi151_funkyboy_FunkyBoyActivity_mapKey(JNIEnv *env, jobject, jint keyCode, jint keys) {
+        sendCommand(FunkyBoyAndroid::CommandType::MapKey, [keyCode, keys](FunkyBoyAndroid::app_command &command) {
+            command.mapping.keyCode = keyCode;
+            command.mapping.keys = keys;
+        });
+    }
+
+    JNIEXPORT void JNICALL Java_lu_kremi151_funkyboy_FunkyBoyActivity_setRunAhead(JNIEnv *env, jobject, jint frames) {
+        sendCommand(FunkyBoyAndroid::CommandType::SetRunAhead, [frames](FunkyBoyAndroid::app_command &command) {
+            command.frames = frames;
+        });
+    }
+
+    JNIEXPORT jboolean JNICALL Java_lu_kremi151_funkyboy_FunkyBoyActivity_startCapture(JNIEnv *env, jobject, jstring basePath) {
+        return sendPathCommand(env, FunkyBoyAndroid::CommandType::StartCapture, basePath);
+    }
+
+    JNIEXPORT void JNICALL Java_lu_kremi151_funkyboy_FunkyBoyActivity_stopCapture(JNIEnv *env, jobject) {
+        sendCommand(FunkyBoyAndroid::CommandType::StopCapture);
+    }
+
+    JNIEXPORT jboolean JNICALL Java_lu_kremi151_funkyboy_FunkyBoyActivity_takeScreenshot(JNIEnv *env, jobject, jstring path) {
+        return sendPathCommand(env, FunkyBoyAndroid::CommandType::TakeScreenshot, path);
+    }
+
+    JNIEXPORT jobjectArray JNICALL Java_lu_kremi151_funkyboy_FunkyBoyActivity_scanLibrary(JNIEnv *env, jobject, jstring indexPath, jobjectArray directories) {
+        jboolean isCopy;
+        auto indexPath_cstr = env->GetStringUTFChars(indexPath, &isCopy);
+        FunkyBoyAndroid::ROMLibrary library(indexPath_cstr);
+        env->ReleaseStringUTFChars(indexPath, indexPath_cstr);
+
+        std::vector<std::string> dirs;
+        jsize count = env->GetArrayLength(directories);
+        for (jsize i = 0 ; i < count ; i++) {
+            auto dir = static_cast<jstring>(env->GetObjectArrayElement(directories, i));
+            auto dir_cstr = env->GetStringUTFChars(dir, &isCopy);
+            dirs.emplace_back(dir_cstr);
+            env->ReleaseStringUTFChars(dir, dir_cstr);
+            env->DeleteLocalRef(dir);
+        }
+
+        // Unchanged files are taken over from the existing index
+        library.open();
+        library.scan(dirs);
+
+        // Title and path of each ROM, alternating
+        jclass stringClass = env->FindClass("java/lang/String");
+        jobjectArray result = env->NewObjectArray(static_cast<jsize>(library.size() * 2), stringClass, nullptr);
+        env->DeleteLocalRef(stringClass);
+        if (result == nullptr) {
+            return nullptr;
+        }
+        for (size_t i = 0 ; i < library.size() ; i++) {
+            jstring title = env->NewStringUTF(getPrintableTitle(library.getEntry(i)).c_str());
+            jstring path = env->NewStringUTF(library.getPath(i).c_str());
+            env->SetObjectArrayElement(result, static_cast<jsize>(i * 2), title);
+            env->SetObjectArrayElement(result, static_cast<jsize>(i * 2 + 1), path);
+            env->DeleteLocalRef(title);
+            env->DeleteLocalRef(path);
+        }
+        return result;
     }
 
 }
\ No newline at end of file
@@ -21,15 +21,30 @@
 #include <string>
 #include <cartridge/header.h>
 #include <engine/engine.h>
+#include <fba_util/command_channel.h>
 
-extern int fbMsgPipe[2];
+extern FunkyBoyAndroid::CommandChannel fbCommandChannel;
 
 namespace FunkyBoyAndroid {
 
     void requestPickRom(struct engine* engine);
-    jobject loadBitmap(struct engine* engine, jint type);
     std::string getSavePath(struct engine* engine, const FunkyBoy::ROMHeader *romHeader);
 
+    /**
+     * Variant for threads other than the main thread, which have to be attached to the JVM.
+     */
+    std::string getSavePath(JNIEnv *env, const FunkyBoy::ROMHeader *romHeader);
+
+    /**
+     * Tells the system that the activity has presented its first meaningful frame.
+     */
+    void reportFullyDrawn(struct engine* engine);
+
+    /**
+     * Tells the user that the ROM at the given path could not be read or inflated.
+     */
+    void reportROMNotReadable(struct engine* engine, const std::string &path);
+
 }
 
 #endif //FB_ANDROID_JNI_H
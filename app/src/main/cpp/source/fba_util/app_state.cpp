@@ -16,41 +16,41 @@
 
 #include "app_state.h"
 
-#include <fba_util/shared.h>
 #include <fba_util/logging.h>
-#include <fba_util/emulator_state.h>
+#include <fba_util/session.h>
 #include <util/membuf.h>
 
-void FunkyBoyAndroid::serializeState(app_save_state *state) {
-    if (State::emulator->getCartridgeStatus() != FunkyBoy::CartridgeStatus::Loaded) {
+void FunkyBoyAndroid::serializeState(Session &session, app_save_state *state) {
+    if (!session.isLoaded()) {
         LOGD("No ROM loaded, skipping serialization");
         return;
     }
 
-    if (State::romPath.size() < FB_ANDROID_APP_STATE_ROM_PATH_BUFFER_SIZE) {
-        std::strcpy(state->romPath, State::romPath.c_str());
+    const std::string &romPath = session.getROMPath();
+    if (romPath.size() < FB_ANDROID_APP_STATE_ROM_PATH_BUFFER_SIZE) {
+        std::strcpy(state->romPath, romPath.c_str());
     } else {
         LOGW("ROM path size is too large, cannot be serialized\n");
     }
 
     FunkyBoy::Util::membuf membuf(state->state, FB_SAVE_STATE_MAX_BUFFER_SIZE, false);
     std::ostream ostream(&membuf);
-    State::emulator->saveState(ostream);
+    session.getEmulator().saveState(ostream);
 }
 
-void FunkyBoyAndroid::resumeFromState(app_save_state *state) {
-    if (State::emulator->getCartridgeStatus() != FunkyBoy::CartridgeStatus::Loaded) {
+void FunkyBoyAndroid::resumeFromState(Session &session, app_save_state *state) {
+    if (!session.isLoaded()) {
         if (std::strlen(state->romPath) == 0) {
             LOGW("ROM path was not serialized, not resuming from previous state");
             return;
         }
-        if (FunkyBoyAndroid::loadROM(state->romPath) != FunkyBoy::CartridgeStatus::Loaded) {
+        if (session.loadROM(state->romPath) != FunkyBoy::CartridgeStatus::Loaded) {
             LOGE("ROM could not be loaded, resuming from previous state failed");
             return;
         }
     }
     FunkyBoy::Util::membuf membuf(state->state, FB_SAVE_STATE_MAX_BUFFER_SIZE, true);
     std::istream istream(&membuf);
-    State::emulator->loadState(istream);
+    session.getEmulator().loadState(istream);
     LOGD("Resumed emulation from previous state");
 }
\ No newline at end of file
@@ -28,8 +28,10 @@ namespace FunkyBoyAndroid {
         char romPath[FB_ANDROID_APP_STATE_ROM_PATH_BUFFER_SIZE];
     } app_save_state;
 
-    void serializeState(app_save_state *state);
-    void resumeFromState(app_save_state *state);
+    class Session;
+
+    void serializeState(Session &session, app_save_state *state);
+    void resumeFromState(Session &session, app_save_state *state);
 
 }
 
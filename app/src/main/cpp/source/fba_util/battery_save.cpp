@@ -0,0 +1,244 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "battery_save.h"
+
+#include <fba_util/logging.h>
+#include <util/byte_buffer.h>
+#include <util/hash.h>
+
+#include <ostream>
+#include <cstdio>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace FunkyBoyAndroid;
+
+BatterySaveService::BatterySaveService(Util::Arena &arena)
+    : captureBuffer(arena.allocateArray<char>(FB_ANDROID_CARTRIDGE_RAM_MAX_SIZE, Util::ArenaTag::BatterySave))
+    , framesSinceCheck(0)
+    , attached(false)
+    , pendingBuffer(arena.allocateArray<char>(FB_ANDROID_CARTRIDGE_RAM_MAX_SIZE, Util::ArenaTag::BatterySave))
+    , pendingSize(0)
+    , pendingHash(0)
+    , lastHash(0)
+    , writingHash(0)
+    , dirty(false)
+    , flushNow(false)
+    , writing(false)
+    , running(true)
+    , writeBuffer(arena.allocateArray<char>(FB_ANDROID_CARTRIDGE_RAM_MAX_SIZE, Util::ArenaTag::BatterySave))
+{
+    writerThread = std::thread(&BatterySaveService::run, this);
+}
+
+BatterySaveService::~BatterySaveService() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    condition.notify_all();
+    // The writer thread drains pending changes before terminating
+    writerThread.join();
+}
+
+bool BatterySaveService::capture(FunkyBoy::Emulator &emulator, size_t &size, uint64_t &hash) {
+    Util::byte_buffer buffer(captureBuffer, FB_ANDROID_CARTRIDGE_RAM_MAX_SIZE);
+    std::ostream ostream(&buffer);
+    emulator.writeCartridgeRam(ostream);
+    if (buffer.overflowed()) {
+        LOGE("Cartridge RAM exceeds %d bytes, cannot be persisted", FB_ANDROID_CARTRIDGE_RAM_MAX_SIZE);
+        return false;
+    }
+    size = buffer.size();
+    hash = Util::fnv1a64(captureBuffer, size);
+    return true;
+}
+
+void BatterySaveService::publish(size_t size, uint64_t hash) {
+    std::lock_guard<std::mutex> lock(mutex);
+    // Compared to the latest snapshot handed over, which may not have been written yet
+    if (hash == (dirty ? pendingHash : writing ? writingHash : lastHash)) {
+        return;
+    }
+    // Swap instead of copying, the previous pending snapshot is outdated anyway
+    std::swap(captureBuffer, pendingBuffer);
+    pendingSize = size;
+    pendingHash = hash;
+    pendingPath = savePath;
+    if (!dirty) {
+        dirty = true;
+        dirtySince = clock::now();
+    }
+}
+
+void BatterySaveService::attach(FunkyBoy::Emulator &emulator, const FunkyBoy::fs::path &path) {
+    attached = false;
+    framesSinceCheck = 0;
+    if (path.empty() || !emulator.supportsSaving()) {
+        return;
+    }
+    if (captureBuffer == nullptr || pendingBuffer == nullptr || writeBuffer == nullptr) {
+        LOGE("No memory left for cartridge RAM buffers, %s will not be saved", path.c_str());
+        return;
+    }
+    size_t size;
+    uint64_t hash;
+    if (!capture(emulator, size, hash)) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        lastHash = hash;
+    }
+    savePath = path;
+    attached = true;
+    LOGD("Tracking %zu bytes of cartridge RAM", size);
+}
+
+void BatterySaveService::detach(FunkyBoy::Emulator &emulator) {
+    if (attached) {
+        requestFlush(emulator);
+    }
+    attached = false;
+}
+
+void BatterySaveService::onFrame(FunkyBoy::Emulator &emulator) {
+    if (!attached || ++framesSinceCheck < FB_ANDROID_BATTERY_SAVE_CHECK_INTERVAL) {
+        return;
+    }
+    framesSinceCheck = 0;
+    size_t size;
+    uint64_t hash;
+    if (capture(emulator, size, hash)) {
+        publish(size, hash);
+    }
+}
+
+void BatterySaveService::requestFlush(FunkyBoy::Emulator &emulator) {
+    if (!attached) {
+        return;
+    }
+    framesSinceCheck = 0;
+    size_t size;
+    uint64_t hash;
+    if (capture(emulator, size, hash)) {
+        publish(size, hash);
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!dirty) {
+            return;
+        }
+        flushNow = true;
+    }
+    condition.notify_all();
+}
+
+void BatterySaveService::waitForFlush() {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (dirty) {
+        flushNow = true;
+        condition.notify_all();
+    }
+    condition.wait(lock, [this]{ return !dirty && !writing; });
+}
+
+void BatterySaveService::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (running || dirty) {
+        if (!dirty) {
+            condition.wait(lock);
+            continue;
+        }
+        if (running && !flushNow) {
+            auto deadline = dirtySince + std::chrono::milliseconds(FB_ANDROID_BATTERY_SAVE_FLUSH_DELAY_MS);
+            // Coalesce changes arriving within the flush delay into a single write
+            condition.wait_until(lock, deadline, [this]{ return flushNow || !running; });
+        }
+
+        std::swap(writeBuffer, pendingBuffer);
+        size_t size = pendingSize;
+        FunkyBoy::fs::path path = pendingPath;
+        writingHash = pendingHash;
+        dirty = false;
+        flushNow = false;
+        writing = true;
+
+        lock.unlock();
+        bool written = writeAtomically(path, writeBuffer, size);
+        if (written) {
+            LOGD("Cartridge RAM written to %s", path.c_str());
+        }
+        lock.lock();
+
+        if (written) {
+            lastHash = writingHash;
+        }
+        writing = false;
+        condition.notify_all();
+    }
+}
+
+bool BatterySaveService::writeAtomically(const FunkyBoy::fs::path &path, const char *data, size_t size) {
+    std::string tmpPath = path.string() + ".tmp";
+    int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        LOGW("Unable to open %s for writing: %s", tmpPath.c_str(), std::strerror(errno));
+        return false;
+    }
+    size_t written = 0;
+    while (written < size) {
+        ssize_t result = write(fd, data + written, size - written);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOGW("Unable to write cartridge RAM: %s", std::strerror(errno));
+            close(fd);
+            unlink(tmpPath.c_str());
+            return false;
+        }
+        written += result;
+    }
+    if (fsync(fd) != 0) {
+        // Renaming a file which may not be on disk could replace the old save by an empty one
+        LOGW("Unable to sync cartridge RAM: %s", std::strerror(errno));
+        close(fd);
+        unlink(tmpPath.c_str());
+        return false;
+    }
+    close(fd);
+    if (std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+        LOGW("Unable to replace %s: %s", path.c_str(), std::strerror(errno));
+        unlink(tmpPath.c_str());
+        return false;
+    }
+    // The rename itself only survives a power loss once the directory has been synced
+    std::string directory = path.parent_path().string();
+    int dirFd = open(directory.empty() ? "." : directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd < 0 || fsync(dirFd) != 0) {
+        LOGW("Unable to sync the directory of %s: %s", path.c_str(), std::strerror(errno));
+        if (dirFd >= 0) {
+            close(dirFd);
+        }
+        return false;
+    }
+    close(dirFd);
+    return true;
+}
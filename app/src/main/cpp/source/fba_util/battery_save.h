@@ -0,0 +1,121 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FB_ANDROID_UTIL_BATTERY_SAVE_H
+#define FB_ANDROID_UTIL_BATTERY_SAVE_H
+
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <emulator/emulator.h>
+#include <util/arena.h>
+
+// Upper bound of cartridge RAM sizes (MBC5 with 16 banks of 8 KiB)
+#define FB_ANDROID_CARTRIDGE_RAM_MAX_SIZE 0x20000
+
+// Amount of frames between two checks of the cartridge RAM for changes
+#define FB_ANDROID_BATTERY_SAVE_CHECK_INTERVAL 30
+
+// Delay after which a detected change gets written to disk, used to coalesce subsequent writes
+#define FB_ANDROID_BATTERY_SAVE_FLUSH_DELAY_MS 2000
+
+namespace FunkyBoyAndroid {
+
+    /**
+     * Persists the battery-backed cartridge RAM in the background.
+     *
+     * Changes are detected on the emulation thread by periodically hashing a snapshot of the
+     * cartridge RAM. Changed snapshots are handed over to a writer thread, which coalesces them and
+     * atomically replaces the save file (write to a temporary file, fsync, rename). A snapshot which
+     * could not be written is handed over again by the next check.
+     * No file I/O happens on the calling thread, except for waitForFlush().
+     */
+    class BatterySaveService {
+    private:
+        typedef std::chrono::steady_clock clock;
+
+        // Owned by the emulation thread
+        char *captureBuffer;
+        unsigned int framesSinceCheck;
+        bool attached;
+        FunkyBoy::fs::path savePath;
+
+        // Guarded by mutex
+        std::mutex mutex;
+        std::condition_variable condition;
+        char *pendingBuffer;
+        size_t pendingSize;
+        uint64_t pendingHash;
+        FunkyBoy::fs::path pendingPath;
+        // Content of the save file, only updated once a write has succeeded
+        uint64_t lastHash;
+        uint64_t writingHash;
+        clock::time_point dirtySince;
+        bool dirty;
+        bool flushNow;
+        bool writing;
+        bool running;
+
+        // Owned by the writer thread
+        char *writeBuffer;
+        std::thread writerThread;
+
+        bool capture(FunkyBoy::Emulator &emulator, size_t &size, uint64_t &hash);
+        void publish(size_t size, uint64_t hash);
+        void run();
+
+        static bool writeAtomically(const FunkyBoy::fs::path &path, const char *data, size_t size);
+
+    public:
+        /**
+         * Allocates the cartridge RAM buffers from the given arena, which has to outlive the service.
+         */
+        explicit BatterySaveService(Util::Arena &arena);
+        ~BatterySaveService();
+
+        /**
+         * Starts tracking the cartridge RAM of the currently loaded game.
+         * The current content is taken as baseline, so it will not be written back unless it changes.
+         */
+        void attach(FunkyBoy::Emulator &emulator, const FunkyBoy::fs::path &path);
+
+        /**
+         * Stops tracking the current game. Pending changes are still written in the background.
+         */
+        void detach(FunkyBoy::Emulator &emulator);
+
+        /**
+         * To be called after each emulated frame. Only every FB_ANDROID_BATTERY_SAVE_CHECK_INTERVAL
+         * frames the cartridge RAM is actually checked for changes.
+         */
+        void onFrame(FunkyBoy::Emulator &emulator);
+
+        /**
+         * Checks for changes immediately and asks the writer thread to persist them without delay.
+         */
+        void requestFlush(FunkyBoy::Emulator &emulator);
+
+        /**
+         * Blocks until all pending changes have been written.
+         */
+        void waitForFlush();
+    };
+
+}
+
+#endif //FB_ANDROID_UTIL_BATTERY_SAVE_H
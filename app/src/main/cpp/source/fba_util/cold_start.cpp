@@ -0,0 +1,169 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cold_start.h"
+
+#include <fba_util/logging.h>
+#include <fb_jni.h>
+#include <util/membuf.h>
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iterator>
+#include <unistd.h>
+
+using namespace FunkyBoyAndroid;
+
+namespace {
+
+    /**
+     * @return milliseconds since this process has been forked, or 0 if unknown
+     */
+    int64_t readProcessAge() {
+        FILE *file = std::fopen("/proc/self/stat", "re");
+        if (file == nullptr) {
+            return 0;
+        }
+        char line[512];
+        bool read = std::fgets(line, sizeof(line), file) != nullptr;
+        std::fclose(file);
+        // The command name may contain spaces, so fields are counted from its closing parenthesis
+        const char *fields = read ? std::strrchr(line, ')') : nullptr;
+        unsigned long long startTicks;
+        if (fields == nullptr || std::sscanf(fields + 1,
+                " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %*u %*u %*d %*d %*d %*d %*d %*d %llu",
+                &startTicks) != 1) {
+            return 0;
+        }
+        // The start time is given in clock ticks since boot
+        struct timespec now{};
+        clock_gettime(CLOCK_BOOTTIME, &now);
+        int64_t nowMillis = static_cast<int64_t>(now.tv_sec) * 1000 + now.tv_nsec / 1000000;
+        return nowMillis - static_cast<int64_t>(startTicks * 1000 / sysconf(_SC_CLK_TCK));
+    }
+
+}
+
+ColdStart::ColdStart()
+    : origin(std::chrono::steady_clock::now())
+    , processAge(readProcessAge())
+    , pool(FB_ANDROID_COLD_START_THREADS)
+    , graph(pool)
+    , sessionReady(FB_ANDROID_TASK_NONE)
+    , jvm(nullptr)
+    , stateValid(false)
+    , reported(false)
+{
+}
+
+void ColdStart::begin(JavaVM *vm, Session &session, SessionSnapshot &snapshot, Controller::AudioControllerAndroid &audio, const app_save_state *state) {
+    jvm = vm;
+
+    graph.add("audio", [&audio]() {
+        audio.open();
+    });
+
+    Util::TaskGraph::task_id rom;
+    Util::TaskGraph::task_id restore = FB_ANDROID_TASK_NONE;
+    if (state != nullptr) {
+        // The glue frees the saved state once the activity has been resumed, which may happen first
+        savedState = std::make_unique<app_save_state>(*state);
+        rom = graph.add("rom", [this, &session]() {
+            FunkyBoyAndroid::resumeFromState(session, savedState.get());
+        });
+    } else if (snapshot.isValid()) {
+        rom = graph.add("rom", [this, &session, &snapshot]() {
+            stateValid = snapshot.restoreROM(session);
+        });
+        restore = graph.add("state", [this, &session, &snapshot]() {
+            if (stateValid) {
+                snapshot.restoreState(session.getEmulator());
+            }
+        }, {rom});
+    } else {
+        // Nothing to resume, the status screen does not need to wait for anything
+        graph.start();
+        return;
+    }
+
+    auto read = graph.add("save read", [this, &session]() {
+        readSaveGame(session);
+    }, {rom});
+    // Loading the emulation state must not overwrite the cartridge RAM from the battery save
+    sessionReady = graph.add("save attach", [this, &session]() {
+        attachSaveGame(session);
+    }, {read, restore});
+
+    graph.start();
+}
+
+void ColdStart::readSaveGame(Session &session) {
+    // Only the ROM header and the cartridge type are read, which loading a state leaves untouched
+    auto &emulator = session.getEmulator();
+    if (!session.isLoaded()) {
+        return;
+    }
+
+    JNIEnv *env;
+    JavaVMAttachArgs vmAttachArgs;
+    vmAttachArgs.version = JNI_VERSION_1_6;
+    vmAttachArgs.name = "FBColdStart";
+    vmAttachArgs.group = nullptr;
+    if (jvm->AttachCurrentThread(&env, &vmAttachArgs) == JNI_ERR) {
+        LOGW("Could not attach cold start thread to JVM");
+        return;
+    }
+    savePath = getSavePath(env, emulator.getROMHeader());
+    jvm->DetachCurrentThread();
+
+    if (savePath.empty() || !emulator.supportsSaving()) {
+        return;
+    }
+    std::ifstream file(savePath, std::ios::binary | std::ios::in);
+    cartridgeRam.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+void ColdStart::attachSaveGame(Session &session) {
+    if (!session.isLoaded() || savePath.empty()) {
+        // Resolved again on the first frame, like for ROMs loaded later on
+        return;
+    }
+    FunkyBoy::Util::membuf membuf(cartridgeRam.data(), cartridgeRam.size(), true);
+    std::istream istream(&membuf);
+    session.attachSaveGame(savePath, istream);
+    cartridgeRam = std::vector<char>();
+}
+
+void ColdStart::waitForSession() {
+    graph.wait(sessionReady);
+}
+
+void ColdStart::onFramePresented(struct engine *engine, bool emulated) {
+    if (reported || isSessionPending()) {
+        return;
+    }
+    reported = true;
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - origin).count();
+    LOGI("Time to first %s frame: %lld ms, %lld ms since the process has been started",
+            emulated ? "emulated" : "status", static_cast<long long>(elapsed), static_cast<long long>(elapsed + processAge));
+#ifdef FB_DEBUG
+    graph.logTimings(origin);
+#endif
+    // Shows up as "Fully drawn" in the system log, also in release builds
+    reportFullyDrawn(engine);
+}
@@ -0,0 +1,95 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FB_ANDROID_UTIL_COLD_START_H
+#define FB_ANDROID_UTIL_COLD_START_H
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <jni.h>
+#include <controllers/audio_android.h>
+#include <engine/engine.h>
+#include <fba_util/app_state.h>
+#include <fba_util/session.h>
+#include <fba_util/session_snapshot.h>
+#include <util/task_graph.h>
+#include <util/work_stealing_pool.h>
+
+// Enough to open the audio stream, load the ROM and read the battery save at the same time
+#define FB_ANDROID_COLD_START_THREADS 3
+
+namespace FunkyBoyAndroid {
+
+    /**
+     * Prepares the session on launch, running the steps which do not depend on each other in
+     * parallel.
+     *
+     * Opening the audio stream is independent of everything else. Once the ROM has been loaded,
+     * the battery save gets read while the emulation state gets restored, and is attached
+     * afterwards. The first frame only waits for the session, the audio stream catches up on its own.
+     */
+    class ColdStart {
+    private:
+        std::chrono::steady_clock::time_point origin;
+        int64_t processAge;
+
+        // Declared before the graph, whose destructor waits for tasks still running on the pool
+        Util::WorkStealingPool pool;
+        Util::TaskGraph graph;
+        Util::TaskGraph::task_id sessionReady;
+
+        JavaVM *jvm;
+        std::unique_ptr<app_save_state> savedState;
+        bool stateValid;
+        std::string savePath;
+        std::vector<char> cartridgeRam;
+        bool reported;
+
+        void readSaveGame(Session &session);
+        void attachSaveGame(Session &session);
+
+    public:
+        ColdStart();
+
+        /**
+         * Starts preparing the given session, either from the state saved by the system or from the
+         * snapshot of the last session. The session must not be accessed until isSessionPending()
+         * returns false, and the session, the snapshot and the audio controller have to outlive
+         * this object.
+         */
+        void begin(JavaVM *jvm, Session &session, SessionSnapshot &snapshot, Controller::AudioControllerAndroid &audio, const app_save_state *savedState);
+
+        /**
+         * @return true as long as the session is still being prepared
+         */
+        inline bool isSessionPending() const {
+            return !graph.isDone(sessionReady);
+        }
+
+        void waitForSession();
+
+        /**
+         * Reports the time to the first frame presented once the session is ready, which is the
+         * first emulated frame if a session has been resumed.
+         */
+        void onFramePresented(struct engine *engine, bool emulated);
+    };
+
+}
+
+#endif //FB_ANDROID_UTIL_COLD_START_H
@@ -0,0 +1,126 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "command_channel.h"
+
+#include <fba_util/logging.h>
+
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+using namespace FunkyBoyAndroid;
+
+CommandChannel::CommandChannel()
+    : enqueuePos(0)
+    , dequeuePos(0)
+    , eventFd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK))
+    , looper(nullptr)
+    , onCommand(nullptr)
+    , handlerData(nullptr)
+{
+    for (size_t i = 0 ; i < FB_ANDROID_COMMAND_CHANNEL_CAPACITY ; i++) {
+        cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    if (eventFd < 0) {
+        LOGE("Unable to create command channel eventfd: %s", std::strerror(errno));
+    }
+}
+
+CommandChannel::~CommandChannel() {
+    detach();
+    if (eventFd >= 0) {
+        close(eventFd);
+    }
+}
+
+void CommandChannel::attach(ALooper *l, handler h, void *data) {
+    detach();
+    looper = l;
+    onCommand = h;
+    handlerData = data;
+    ALooper_addFd(looper, eventFd, ALOOPER_POLL_CALLBACK, ALOOPER_EVENT_INPUT, onWake, this);
+    // Commands sent while no consumer was attached are handled right away
+    drain();
+}
+
+void CommandChannel::detach() {
+    if (looper != nullptr) {
+        ALooper_removeFd(looper, eventFd);
+        looper = nullptr;
+    }
+}
+
+bool CommandChannel::send(const app_command &command) {
+    cell *c;
+    size_t pos = enqueuePos.load(std::memory_order_relaxed);
+    while (true) {
+        c = &cells[pos & mask];
+        size_t sequence = c->sequence.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+        if (diff == 0) {
+            if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            LOGW("Command channel is full, dropping command %d", command.type);
+            return false;
+        } else {
+            pos = enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+    c->command = command;
+    c->sequence.store(pos + 1, std::memory_order_release);
+
+    uint64_t one = 1;
+    if (write(eventFd, &one, sizeof(one)) != sizeof(one)) {
+        LOGW("Unable to signal command channel: %s", std::strerror(errno));
+    }
+    return true;
+}
+
+size_t CommandChannel::drain() {
+    size_t handled = 0;
+    while (true) {
+        cell *c = &cells[dequeuePos & mask];
+        size_t sequence = c->sequence.load(std::memory_order_acquire);
+        if (static_cast<intptr_t>(sequence) - static_cast<intptr_t>(dequeuePos + 1) < 0) {
+            // Empty, or a producer has claimed the slot but not yet published it. It will signal
+            // the eventfd again once done.
+            break;
+        }
+        if (onCommand != nullptr) {
+            onCommand(c->command, handlerData);
+        }
+        c->sequence.store(dequeuePos + FB_ANDROID_COMMAND_CHANNEL_CAPACITY, std::memory_order_release);
+        dequeuePos++;
+        handled++;
+    }
+    return handled;
+}
+
+int CommandChannel::onWake(int fd, int events, void *data) {
+    auto *channel = static_cast<CommandChannel *>(data);
+    uint64_t count;
+    // Resets the eventfd counter, however many commands have been signalled
+    read(fd, &count, sizeof(count));
+    size_t handled = channel->drain();
+    if (handled > 1) {
+        LOGD("Handled a batch of %zu commands", handled);
+    }
+    return 1;
+}
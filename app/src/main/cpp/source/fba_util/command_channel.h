@@ -0,0 +1,123 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FB_ANDROID_UTIL_COMMAND_CHANNEL_H
+#define FB_ANDROID_UTIL_COMMAND_CHANNEL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <android/looper.h>
+#include <fba_util/app_state.h>
+
+#define FB_ANDROID_COMMAND_CHANNEL_CAPACITY 16
+
+namespace FunkyBoyAndroid {
+
+    enum CommandType: uint8_t {
+        LoadROM,
+        SaveSlot,
+        LoadSlot,
+        SetPaused,
+        SetSpeed,
+        SetPalette,
+        RecordMovie,
+        StopMovie,
+        PlayMovie,
+        VerifyMovie,
+        MapKey,
+        StartCapture,
+        StopCapture,
+        TakeScreenshot,
+        SetRunAhead,
+    };
+
+    typedef struct {
+        CommandType type;
+        union {
+            int32_t slot;
+            int32_t palette;
+            bool paused;
+            float speed;
+            int32_t frames;
+            struct {
+                int32_t keyCode;
+                int32_t keys;
+            } mapping;
+        };
+        char path[FB_ANDROID_APP_STATE_ROM_PATH_BUFFER_SIZE];
+    } app_command;
+
+    /**
+     * Bounded multi-producer, single-consumer queue of preallocated commands.
+     * Producers on any thread enqueue without allocating or locking. The consumer is woken through
+     * an eventfd registered with its ALooper and drains all pending commands at once.
+     *
+     * The queue follows the bounded MPMC design by Dmitry Vyukov: each slot carries a sequence
+     * number which tells producers and the consumer whether the slot is ready for them.
+     */
+    class CommandChannel {
+    public:
+        typedef void (*handler)(const app_command &command, void *data);
+
+    private:
+        struct alignas(64) cell {
+            std::atomic<size_t> sequence;
+            app_command command;
+        };
+
+        static constexpr size_t mask = FB_ANDROID_COMMAND_CHANNEL_CAPACITY - 1;
+        static_assert((FB_ANDROID_COMMAND_CHANNEL_CAPACITY & mask) == 0, "Capacity must be a power of 2");
+
+        cell cells[FB_ANDROID_COMMAND_CHANNEL_CAPACITY];
+        alignas(64) std::atomic<size_t> enqueuePos;
+        alignas(64) size_t dequeuePos;
+
+        int eventFd;
+        ALooper *looper;
+        handler onCommand;
+        void *handlerData;
+
+        static int onWake(int fd, int events, void *data);
+
+    public:
+        CommandChannel();
+        ~CommandChannel();
+
+        /**
+         * Registers the channel with the looper of the calling thread, which becomes the consumer.
+         */
+        void attach(ALooper *looper, handler onCommand, void *data);
+        void detach();
+
+        /**
+         * Enqueues a command. Safe to call from any thread.
+         *
+         * @return false if the channel is full
+         */
+        bool send(const app_command &command);
+
+        /**
+         * Dequeues and handles all pending commands. Must only be called from the consumer thread.
+         *
+         * @return amount of handled commands
+         */
+        size_t drain();
+    };
+
+}
+
+#endif //FB_ANDROID_UTIL_COMMAND_CHANNEL_H
@@ -16,39 +16,75 @@
 
 #include "emulator_state.h"
 
-#include <fba_util/shared.h>
 #include <fba_util/logging.h>
+#include <engine/hit_map.h>
 #include <fb_jni.h>
 
 #include <fstream>
 
-FunkyBoy::CartridgeStatus FunkyBoyAndroid::loadROM(const char *inRomPath) {
-    auto result = State::emulator->loadGame(inRomPath);
-    LOGD("ROM load status: %d, loaded from %s", result, inRomPath);
-    if (result == FunkyBoy::CartridgeStatus::Loaded) {
-        State::romPath = inRomPath;
+void FunkyBoyAndroid::loadSaveGame(struct engine* engine, Session &session) {
+    session.attachSaveGame(getSavePath(engine, session.getEmulator().getROMHeader()));
+}
+
+void FunkyBoyAndroid::saveGame(Session &session) {
+    auto &emulator = session.getEmulator();
+    auto &saveGamePath = emulator.savePath;
+    if (!saveGamePath.empty() && emulator.supportsSaving() /*&& FunkyBoy::fs::exists(saveGamePath)*/) {
+        session.getBatterySave().requestFlush(emulator);
+        session.getBatterySave().waitForFlush();
+        LOGD("Cartridge RAM written to file");
+    } else {
+        LOGD("Game has no cartridge RAM");
     }
-    return result;
 }
 
-void FunkyBoyAndroid::loadSaveGame(struct engine* engine) {
-    FunkyBoy::fs::path saveGamePath = getSavePath(engine, State::emulator->getROMHeader());
-    State::emulator->savePath = saveGamePath;
-    State::initialSaveLoaded = true;
-    LOGD("Save path: %s", saveGamePath.c_str());
-    if (!saveGamePath.empty() && State::emulator->supportsSaving() /*&& FunkyBoy::fs::exists(saveGamePath)*/) {
-        std::ifstream file(saveGamePath, std::ios::binary | std::ios::in);
-        State::emulator->loadCartridgeRam(file);
+static std::string getStateSlotPath(FunkyBoy::Emulator &emulator, int slot) {
+    auto &saveGamePath = emulator.savePath;
+    if (saveGamePath.empty()) {
+        return std::string();
     }
+    return saveGamePath.string() + ".state" + std::to_string(slot);
 }
 
-void FunkyBoyAndroid::saveGame() {
-    auto &saveGamePath = State::emulator->savePath;
-    if (!saveGamePath.empty() && State::emulator->supportsSaving() /*&& FunkyBoy::fs::exists(saveGamePath)*/) {
-        std::ofstream file(saveGamePath, std::ios::binary | std::ios::out);
-        State::emulator->writeCartridgeRam(file);
-        LOGD("Cartridge RAM written to file");
-    } else {
-        LOGD("Game has no cartridge RAM");
+bool FunkyBoyAndroid::saveStateSlot(Session &session, int slot) {
+    auto &emulator = session.getEmulator();
+    if (emulator.getCartridgeStatus() != FunkyBoy::CartridgeStatus::Loaded) {
+        return false;
     }
-}
\ No newline at end of file
+    std::string path = getStateSlotPath(emulator, slot);
+    if (path.empty()) {
+        LOGW("No save path known, cannot save state to slot %d", slot);
+        return false;
+    }
+    std::ofstream file(path, std::ios::binary | std::ios::out);
+    emulator.saveState(file);
+    LOGD("State saved to slot %d", slot);
+    return file.good();
+}
+
+bool FunkyBoyAndroid::loadStateSlot(Session &session, int slot) {
+    auto &emulator = session.getEmulator();
+    if (emulator.getCartridgeStatus() != FunkyBoy::CartridgeStatus::Loaded) {
+        return false;
+    }
+    std::string path = getStateSlotPath(emulator, slot);
+    std::ifstream file(path, std::ios::binary | std::ios::in);
+    if (path.empty() || !file.is_open()) {
+        LOGW("No state found in slot %d", slot);
+        return false;
+    }
+    emulator.loadState(file);
+    LOGD("State loaded from slot %d", slot);
+    return true;
+}
+
+void FunkyBoyAndroid::applyJoypadState(FunkyBoy::Emulator &emulator, int keys) {
+    emulator.setInputState(FunkyBoy::Controller::JoypadKey::JOYPAD_A, keys & FBA_KEY_A);
+    emulator.setInputState(FunkyBoy::Controller::JoypadKey::JOYPAD_B, keys & FBA_KEY_B);
+    emulator.setInputState(FunkyBoy::Controller::JoypadKey::JOYPAD_START, keys & FBA_KEY_START);
+    emulator.setInputState(FunkyBoy::Controller::JoypadKey::JOYPAD_SELECT, keys & FBA_KEY_SELECT);
+    emulator.setInputState(FunkyBoy::Controller::JoypadKey::JOYPAD_LEFT, keys & FBA_KEY_LEFT);
+    emulator.setInputState(FunkyBoy::Controller::JoypadKey::JOYPAD_UP, keys & FBA_KEY_UP);
+    emulator.setInputState(FunkyBoy::Controller::JoypadKey::JOYPAD_RIGHT, keys & FBA_KEY_RIGHT);
+    emulator.setInputState(FunkyBoy::Controller::JoypadKey::JOYPAD_DOWN, keys & FBA_KEY_DOWN);
+}
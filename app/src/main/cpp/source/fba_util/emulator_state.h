@@ -18,12 +18,20 @@
 #define FB_ANDROID_UTIL_EMULATOR_STATE_H
 
 #include <cartridge/status.h>
+#include <emulator/emulator.h>
 #include <engine/engine.h>
+#include <fba_util/session.h>
 
 namespace FunkyBoyAndroid {
-    FunkyBoy::CartridgeStatus loadROM(const char *inRomPath);
-    void loadSaveGame(struct engine* engine);
-    void saveGame();
+    void loadSaveGame(struct engine* engine, Session &session);
+    void saveGame(Session &session);
+    bool saveStateSlot(Session &session, int slot);
+    bool loadStateSlot(Session &session, int slot);
+
+    /**
+     * Applies a joypad state given as a mask of FBA_KEY_* bits.
+     */
+    void applyJoypadState(FunkyBoy::Emulator &emulator, int keys);
 }
 
 #endif //FB_ANDROID_UTIL_EMULATOR_STATE_H
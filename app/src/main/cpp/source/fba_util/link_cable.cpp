@@ -0,0 +1,269 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "link_cable.h"
+
+#include <fba_util/logging.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+using namespace FunkyBoyAndroid;
+
+namespace {
+
+    inline uint64_t nowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+}
+
+SerialFIFO::SerialFIFO()
+    : bytes()
+    , head(0)
+    , count(0)
+{
+}
+
+bool SerialFIFO::push(FunkyBoy::u8 data) {
+    if (count == FB_ANDROID_LINK_FIFO_SIZE) {
+        return false;
+    }
+    bytes[(head + count) % FB_ANDROID_LINK_FIFO_SIZE] = data;
+    count++;
+    return true;
+}
+
+bool SerialFIFO::pop(FunkyBoy::u8 &data) {
+    if (count == 0) {
+        return false;
+    }
+    data = bytes[head];
+    head = (head + 1) % FB_ANDROID_LINK_FIFO_SIZE;
+    count--;
+    return true;
+}
+
+void SerialFIFO::clear() {
+    head = 0;
+    count = 0;
+}
+
+void SerialFIFO::saveState(std::ostream &ostream) const {
+    ostream.write(reinterpret_cast<const char *>(&count), sizeof(count));
+    uint32_t first = std::min(count, FB_ANDROID_LINK_FIFO_SIZE - head);
+    ostream.write(reinterpret_cast<const char *>(bytes + head), first);
+    ostream.write(reinterpret_cast<const char *>(bytes), count - first);
+}
+
+bool SerialFIFO::loadState(std::istream &istream) {
+    uint32_t size = 0;
+    clear();
+    istream.read(reinterpret_cast<char *>(&size), sizeof(size));
+    if (!istream.good() || size > FB_ANDROID_LINK_FIFO_SIZE) {
+        return false;
+    }
+    istream.read(reinterpret_cast<char *>(bytes), size);
+    if (!istream.good()) {
+        return false;
+    }
+    count = size;
+    return true;
+}
+
+LinkCable::Port::Port()
+    : droppedBytes(0)
+{
+}
+
+void LinkCable::Port::sendByte(FunkyBoy::u8 data) {
+    if (!outgoing.push(data)) {
+        droppedBytes++;
+    }
+}
+
+bool LinkCable::Port::receiveByte(FunkyBoy::u8 &data) {
+    return incoming.pop(data);
+}
+
+LinkCable::LinkCable(Session &first, Session &second)
+    : sessions{&first, &second}
+    , ports{std::make_shared<Port>(), std::make_shared<Port>()}
+    , minQuantum(FB_ANDROID_LINK_MIN_QUANTUM)
+    , maxQuantum(FB_ANDROID_LINK_MAX_QUANTUM)
+    , quantum(FB_ANDROID_LINK_MIN_QUANTUM)
+    , arrived(0)
+    , generation(0)
+    , stopping(false)
+    , stats{}
+{
+    first.setSerial(ports[0]);
+    second.setSerial(ports[1]);
+}
+
+LinkCable::~LinkCable() {
+    stop();
+    sessions[0]->setSerial(nullptr);
+    sessions[1]->setSerial(nullptr);
+}
+
+void LinkCable::setQuantum(uint32_t min, uint32_t max) {
+    if (min == 0 || min > max) {
+        LOGW("Invalid link quantum bounds %u to %u", min, max);
+        return;
+    }
+    minQuantum = min;
+    maxQuantum = max;
+    quantum = min;
+}
+
+bool LinkCable::start() {
+    if (sessions[0]->isRunning() || sessions[1]->isRunning()) {
+        LOGW("Linked sessions are already running");
+        return false;
+    }
+    stopping = false;
+    arrived = 0;
+    if (!sessions[0]->start([this](Session &) { return step(0); })) {
+        return false;
+    }
+    if (!sessions[1]->start([this](Session &) { return step(1); })) {
+        stop();
+        return false;
+    }
+    return true;
+}
+
+void LinkCable::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    condition.notify_all();
+    sessions[0]->stop();
+    sessions[1]->stop();
+}
+
+bool LinkCable::step(int side) {
+    uint64_t start = nowNs();
+    stats.frames[side] += sessions[side]->runTicks(quantum);
+    uint64_t ran = nowNs();
+    stats.runNs[side] += ran - start;
+    bool proceed = synchronize(side);
+    stats.waitNs[side] += nowNs() - ran;
+    return proceed;
+}
+
+bool LinkCable::synchronize(int side) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (stopping) {
+        return false;
+    }
+    if (++arrived == 2) {
+        // Both sides are waiting, so their ports can be accessed safely
+        arrived = 0;
+        exchange();
+        generation++;
+        condition.notify_all();
+        return true;
+    }
+    uint64_t current = generation;
+    condition.wait(lock, [this, current]() {
+        return generation != current || stopping;
+    });
+    return generation != current;
+}
+
+size_t LinkCable::deliver() {
+    size_t transferred = 0;
+    FunkyBoy::u8 data;
+    for (int side = 0 ; side < 2 ; side++) {
+        auto &outgoing = ports[side]->outgoing;
+        auto &receiver = *ports[1 - side];
+        while (outgoing.pop(data)) {
+            transferred++;
+            if (!receiver.incoming.push(data)) {
+                // The receiving side does not keep up, so the byte is lost like on a real cable
+                receiver.droppedBytes++;
+            }
+        }
+    }
+    collectDropped();
+    return transferred;
+}
+
+void LinkCable::collectDropped() {
+    for (auto &port : ports) {
+        stats.droppedBytes += port->droppedBytes;
+        port->droppedBytes = 0;
+    }
+}
+
+void LinkCable::exchange() {
+    size_t transferred = deliver();
+    stats.quanta++;
+    stats.ticks += quantum;
+    stats.bytes += transferred;
+    // Transfers usually come in bursts, so keep the latency low while they last
+    quantum = transferred > 0 ? minQuantum : std::min(quantum * 2, maxQuantum);
+}
+
+void LinkCable::stepFrame() {
+    for (int side = 0 ; side < 2 ; side++) {
+        uint64_t start = nowNs();
+        sessions[side]->runFrame();
+        stats.runNs[side] += nowNs() - start;
+        stats.frames[side]++;
+    }
+    stats.bytes += deliver();
+}
+
+void LinkCable::saveState(std::ostream &ostream) {
+    for (int side = 0 ; side < 2 ; side++) {
+        sessions[side]->getEmulator().saveState(ostream);
+    }
+    for (int side = 0 ; side < 2 ; side++) {
+        ports[side]->outgoing.saveState(ostream);
+        ports[side]->incoming.saveState(ostream);
+    }
+}
+
+bool LinkCable::loadState(std::istream &istream) {
+    for (int side = 0 ; side < 2 ; side++) {
+        sessions[side]->getEmulator().loadState(istream);
+    }
+    for (int side = 0 ; side < 2 ; side++) {
+        if (!ports[side]->outgoing.loadState(istream) || !ports[side]->incoming.loadState(istream)) {
+            LOGE("Link state of side %d is corrupt", side);
+            return false;
+        }
+    }
+    return true;
+}
+
+void LinkCable::logStats() const {
+    for (int side = 0 ; side < 2 ; side++) {
+        uint64_t total = stats.runNs[side] + stats.waitNs[side];
+        LOGI("Link side %d: %llu frames, %.1f %% of the time spent synchronizing", side,
+                static_cast<unsigned long long>(stats.frames[side]),
+                total > 0 ? stats.waitNs[side] * 100.0 / total : 0.0);
+    }
+    LOGI("Link: %llu bytes transferred (%llu dropped) in %llu quanta of %llu ticks on average",
+            static_cast<unsigned long long>(stats.bytes), static_cast<unsigned long long>(stats.droppedBytes),
+            static_cast<unsigned long long>(stats.quanta),
+            static_cast<unsigned long long>(stats.quanta > 0 ? stats.ticks / stats.quanta : 0));
+}
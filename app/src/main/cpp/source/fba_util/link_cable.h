@@ -0,0 +1,191 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FB_ANDROID_UTIL_LINK_CABLE_H
+#define FB_ANDROID_UTIL_LINK_CABLE_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <controllers/serial.h>
+#include <fba_util/session.h>
+
+// Bounds of the amount of ticks both sides run between two synchronizations
+#define FB_ANDROID_LINK_MIN_QUANTUM 256
+#define FB_ANDROID_LINK_MAX_QUANTUM 65536
+
+// Bytes in transit per direction. A Game Boy transfers at most about 550 bytes per frame in CGB
+// high speed mode, and receives one byte per transfer.
+#define FB_ANDROID_LINK_FIFO_SIZE 1024
+
+// Upper bound of the port state written by LinkCable::saveState, besides the emulator states
+#define FB_ANDROID_LINK_STATE_MAX_SIZE (2 * 2 * (sizeof(uint32_t) + FB_ANDROID_LINK_FIFO_SIZE))
+
+namespace FunkyBoyAndroid {
+
+    struct link_stats {
+        uint64_t quanta;
+        uint64_t ticks;
+        uint64_t bytes;
+        // Bytes which did not fit into the FIFO of the receiving port
+        uint64_t droppedBytes;
+        uint64_t frames[2];
+        uint64_t runNs[2];
+        uint64_t waitNs[2];
+    };
+
+    /**
+     * Fixed-size queue of serial bytes, so that a side which does not consume its bytes cannot
+     * make the link grow without bounds.
+     */
+    class SerialFIFO {
+    private:
+        FunkyBoy::u8 bytes[FB_ANDROID_LINK_FIFO_SIZE];
+        uint32_t head;
+        uint32_t count;
+
+    public:
+        SerialFIFO();
+
+        /**
+         * @return false if the FIFO is full, in which case the byte is dropped
+         */
+        bool push(FunkyBoy::u8 data);
+        bool pop(FunkyBoy::u8 &data);
+        void clear();
+
+        inline uint32_t size() const {
+            return count;
+        }
+
+        void saveState(std::ostream &ostream) const;
+
+        /**
+         * @return false if the state is truncated or exceeds the capacity
+         */
+        bool loadState(std::istream &istream);
+    };
+
+    /**
+     * Connects the serial ports of two sessions within the same process.
+     *
+     * Both sessions run on their own worker threads and advance in lock-step quanta of ticks. The
+     * sides only synchronize at the end of each quantum, where the bytes sent during the quantum
+     * get delivered to the other side. The quantum shrinks to its minimum while bytes are being
+     * transferred and doubles up to its maximum while the link is idle, so that idle links
+     * synchronize rarely.
+     *
+     * The serial controller of the core only reports sent bytes, so nothing calls receiveByte()
+     * yet and the app does not offer linking until the core can deliver incoming bytes.
+     */
+    class LinkCable {
+    public:
+        class Port: public FunkyBoy::Controller::SerialController {
+            friend class LinkCable;
+
+        private:
+            // Only accessed by the thread of the owning session, or at the synchronization point
+            SerialFIFO outgoing;
+            SerialFIFO incoming;
+            uint64_t droppedBytes;
+
+        public:
+            Port();
+
+            void sendByte(FunkyBoy::u8 data) override;
+
+            /**
+             * Takes the next byte received from the other side, to be called on the thread of the
+             * owning session.
+             */
+            bool receiveByte(FunkyBoy::u8 &data);
+        };
+
+    private:
+        Session *sessions[2];
+        std::shared_ptr<Port> ports[2];
+
+        uint32_t minQuantum;
+        uint32_t maxQuantum;
+        uint32_t quantum;
+
+        std::mutex mutex;
+        std::condition_variable condition;
+        unsigned int arrived;
+        uint64_t generation;
+        bool stopping;
+
+        link_stats stats;
+
+        bool step(int side);
+        bool synchronize(int side);
+        void exchange();
+        size_t deliver();
+        void collectDropped();
+
+    public:
+        LinkCable(Session &first, Session &second);
+        ~LinkCable();
+
+        /**
+         * Sets the bounds of the quantum in ticks, only while the link is stopped.
+         */
+        void setQuantum(uint32_t min, uint32_t max);
+
+        /**
+         * Starts running both sessions in lock-step on their worker threads.
+         */
+        bool start();
+        void stop();
+
+        inline Session &getSession(int side) {
+            return *sessions[side];
+        }
+
+        /**
+         * Advances both sessions by one frame on the calling thread and delivers the bytes sent
+         * meanwhile. As the result only depends on the inputs of both sides, stepping frame by frame
+         * can be replayed from a saved state. Only while the link is stopped.
+         */
+        void stepFrame();
+
+        /**
+         * Writes the state of both sessions and of the bytes in transit, only while the link is
+         * stopped. The bytes in transit take at most FB_ANDROID_LINK_STATE_MAX_SIZE.
+         */
+        void saveState(std::ostream &ostream);
+
+        /**
+         * @return false if the bytes in transit could not be restored
+         */
+        bool loadState(std::istream &istream);
+
+        /**
+         * Statistics of the link, only to be read while it is stopped.
+         */
+        inline const link_stats &getStats() const {
+            return stats;
+        }
+
+        void logStats() const;
+    };
+
+}
+
+#endif //FB_ANDROID_UTIL_LINK_CABLE_H
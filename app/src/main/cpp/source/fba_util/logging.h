@@ -17,13 +17,20 @@
 #ifndef FB_ANDROID_LOGGING_H
 #define FB_ANDROID_LOGGING_H
 
+#ifdef __ANDROID__
 #include <android/log.h>
+#define FB_ANDROID_LOG(priority, ...) ((void)__android_log_print(ANDROID_LOG_##priority, "funkyboy", __VA_ARGS__))
+#else
+// Host tools which share sources with the app log to stderr
+#include <cstdio>
+#define FB_ANDROID_LOG(priority, ...) ((void)std::fprintf(stderr, "funkyboy " #priority ": " __VA_ARGS__), (void)std::fputc('\n', stderr))
+#endif
 
 #ifdef FB_DEBUG
-#define LOGD(...) ((void)__android_log_print(ANDROID_LOG_DEBUG, "funkyboy", __VA_ARGS__))
-#define LOGI(...) ((void)__android_log_print(ANDROID_LOG_INFO, "funkyboy", __VA_ARGS__))
-#define LOGW(...) ((void)__android_log_print(ANDROID_LOG_WARN, "funkyboy", __VA_ARGS__))
-#define LOGE(...) ((void)__android_log_print(ANDROID_LOG_ERROR, "funkyboy", __VA_ARGS__))
+#define LOGD(...) FB_ANDROID_LOG(DEBUG, __VA_ARGS__)
+#define LOGI(...) FB_ANDROID_LOG(INFO, __VA_ARGS__)
+#define LOGW(...) FB_ANDROID_LOG(WARN, __VA_ARGS__)
+#define LOGE(...) FB_ANDROID_LOG(ERROR, __VA_ARGS__)
 #else
 #define LOGD(...) ((void)0)
 #define LOGI(...) ((void)0)
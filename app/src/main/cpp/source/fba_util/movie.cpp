@@ -0,0 +1,263 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "movie.h"
+
+#include <fba_util/emulator_state.h>
+#include <fba_util/logging.h>
+#include <fba_util/session.h>
+#include <util/byte_buffer.h>
+#include <util/membuf.h>
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+
+#define FB_ANDROID_MOVIE_MAX_RUN_LENGTH 0xFFFF
+
+using namespace FunkyBoyAndroid;
+
+namespace {
+
+    bool matchesROM(FunkyBoy::Emulator &emulator, const movie_header &header) {
+        auto romHeader = emulator.getROMHeader();
+        return romHeader->globalChecksum[0] == header.globalChecksum[0]
+            && romHeader->globalChecksum[1] == header.globalChecksum[1]
+            && romHeader->headerChecksum == header.headerChecksum;
+    }
+
+}
+
+MovieRecorder::MovieRecorder(FunkyBoy::Emulator &emulator, const std::string &romPath, std::string path)
+    : recording()
+    , path(std::move(path))
+{
+    auto &header = recording.header;
+    header.magic = FB_ANDROID_MOVIE_MAGIC;
+    header.version = FB_ANDROID_MOVIE_VERSION;
+    auto romHeader = emulator.getROMHeader();
+    header.globalChecksum[0] = romHeader->globalChecksum[0];
+    header.globalChecksum[1] = romHeader->globalChecksum[1];
+    header.headerChecksum = romHeader->headerChecksum;
+    std::strncpy(header.romPath, romPath.c_str(), FB_ANDROID_APP_STATE_ROM_PATH_BUFFER_SIZE - 1);
+
+    recording.state.resize(FB_SAVE_STATE_MAX_BUFFER_SIZE);
+    Util::byte_buffer buffer(recording.state.data(), recording.state.size());
+    std::ostream ostream(&buffer);
+    emulator.saveState(ostream);
+    recording.state.resize(buffer.size());
+    header.stateSize = buffer.size();
+
+    LOGD("Started recording movie to %s", this->path.c_str());
+}
+
+void MovieRecorder::recordFrame(uint8_t keys, uint64_t hash) {
+    auto &runs = recording.runs;
+    if (runs.empty() || runs.back().keys != keys || runs.back().length == FB_ANDROID_MOVIE_MAX_RUN_LENGTH) {
+        runs.push_back({0, keys});
+    }
+    runs.back().length++;
+    recording.hashes.push_back(hash);
+    recording.header.frameCount++;
+}
+
+bool MovieRecorder::finish() {
+    auto &header = recording.header;
+    header.runCount = recording.runs.size();
+
+    std::ofstream file(path, std::ios::binary | std::ios::out | std::ios::trunc);
+    if (!file.is_open()) {
+        LOGW("Unable to open movie file %s for writing", path.c_str());
+        return false;
+    }
+    file.write(reinterpret_cast<const char *>(&header), sizeof(movie_header));
+    file.write(recording.state.data(), recording.state.size());
+    for (auto &run : recording.runs) {
+        uint8_t bytes[3] = {
+                static_cast<uint8_t>(run.length & 0xFFu),
+                static_cast<uint8_t>(run.length >> 8u),
+                run.keys,
+        };
+        file.write(reinterpret_cast<const char *>(bytes), sizeof(bytes));
+    }
+    file.write(reinterpret_cast<const char *>(recording.hashes.data()), recording.hashes.size() * sizeof(uint64_t));
+    LOGI("Recorded movie of %u frames in %u input runs to %s", header.frameCount, header.runCount, path.c_str());
+    return file.good();
+}
+
+MoviePlayer::MoviePlayer()
+    : playback()
+    , run(0)
+    , runOffset(0)
+    , frame(0)
+    , firstDivergence(0)
+    , divergences(0)
+{
+}
+
+bool MoviePlayer::load(const std::string &path) {
+    std::ifstream file(path, std::ios::binary | std::ios::in);
+    if (!file.is_open()) {
+        LOGW("Unable to open movie file %s", path.c_str());
+        return false;
+    }
+    auto &header = playback.header;
+    file.read(reinterpret_cast<char *>(&header), sizeof(movie_header));
+    if (!file.good() || header.magic != FB_ANDROID_MOVIE_MAGIC || header.version != FB_ANDROID_MOVIE_VERSION) {
+        LOGW("%s is not a supported movie file", path.c_str());
+        return false;
+    }
+    if (header.stateSize > FB_SAVE_STATE_MAX_BUFFER_SIZE) {
+        LOGW("Movie %s has an invalid initial state size of %u bytes", path.c_str(), header.stateSize);
+        return false;
+    }
+    header.romPath[FB_ANDROID_APP_STATE_ROM_PATH_BUFFER_SIZE - 1] = '\0';
+
+    // Counts are checked against the file before anything gets allocated for them
+    file.seekg(0, std::ios::end);
+    uint64_t fileSize = static_cast<uint64_t>(file.tellg());
+    file.seekg(sizeof(movie_header), std::ios::beg);
+    uint64_t expectedSize = sizeof(movie_header) + static_cast<uint64_t>(header.stateSize)
+            + static_cast<uint64_t>(header.runCount) * 3 + static_cast<uint64_t>(header.frameCount) * sizeof(uint64_t);
+    if (!file.good() || fileSize != expectedSize) {
+        LOGW("Movie %s is corrupt, it has %llu bytes instead of %llu", path.c_str(),
+                static_cast<unsigned long long>(fileSize), static_cast<unsigned long long>(expectedSize));
+        return false;
+    }
+
+    playback.state.resize(header.stateSize);
+    file.read(playback.state.data(), header.stateSize);
+    if (!file.good()) {
+        LOGW("Movie %s is truncated", path.c_str());
+        return false;
+    }
+
+    uint64_t frames = 0;
+    playback.runs.resize(header.runCount);
+    for (auto &r : playback.runs) {
+        uint8_t bytes[3];
+        file.read(reinterpret_cast<char *>(bytes), sizeof(bytes));
+        if (!file.good()) {
+            LOGW("Movie %s is truncated", path.c_str());
+            return false;
+        }
+        r.length = bytes[0] | (bytes[1] << 8u);
+        r.keys = bytes[2];
+        frames += r.length;
+    }
+    if (frames != header.frameCount) {
+        LOGW("Movie %s is corrupt, input runs cover %llu of %u frames", path.c_str(), static_cast<unsigned long long>(frames), header.frameCount);
+        return false;
+    }
+
+    playback.hashes.resize(header.frameCount);
+    file.read(reinterpret_cast<char *>(playback.hashes.data()), header.frameCount * sizeof(uint64_t));
+    if (!file.good()) {
+        LOGW("Movie %s is truncated", path.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool MoviePlayer::start(FunkyBoy::Emulator &emulator) {
+    if (!matchesROM(emulator, playback.header)) {
+        LOGW("Movie was recorded with a different ROM");
+        return false;
+    }
+    FunkyBoy::Util::membuf membuf(playback.state.data(), playback.state.size(), true);
+    std::istream istream(&membuf);
+    emulator.loadState(istream);
+    run = 0;
+    runOffset = 0;
+    frame = 0;
+    firstDivergence = 0;
+    divergences = 0;
+    return true;
+}
+
+bool MoviePlayer::nextFrame(uint8_t &keys) {
+    while (run < playback.runs.size() && runOffset >= playback.runs[run].length) {
+        run++;
+        runOffset = 0;
+    }
+    if (run >= playback.runs.size()) {
+        return false;
+    }
+    keys = playback.runs[run].keys;
+    runOffset++;
+    frame++;
+    return true;
+}
+
+void MoviePlayer::verifyFrame(uint64_t hash) {
+    if (frame == 0 || frame > playback.hashes.size()) {
+        return;
+    }
+    if (playback.hashes[frame - 1] != hash) {
+        if (divergences == 0) {
+            firstDivergence = frame;
+            LOGW("Replay diverged from the recording at frame %u", frame);
+        }
+        divergences++;
+    }
+}
+
+void MoviePlayer::logResult() const {
+    if (divergences == 0) {
+        LOGI("Replayed %u frames, all frames match the recording", frame);
+    } else {
+        LOGW("Replayed %u frames, %u frames diverged from the recording starting at frame %u", frame, divergences, firstDivergence);
+    }
+}
+
+#ifdef FB_ANDROID_BENCHMARK
+int FunkyBoyAndroid::verifyMovieHeadless(const std::string &path) {
+    MoviePlayer player;
+    if (!player.load(path)) {
+        return -1;
+    }
+
+    Session session;
+    const char *romPath = player.getROMPath();
+    auto status = session.loadROM(romPath);
+    if (status != FunkyBoy::CartridgeStatus::Loaded) {
+        LOGW("Unable to load ROM %s of movie %s: %d", romPath, path.c_str(), status);
+        return -1;
+    }
+    auto &emulator = session.getEmulator();
+    if (!player.start(emulator)) {
+        return -1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    uint8_t keys;
+    while (player.nextFrame(keys)) {
+        applyJoypadState(emulator, keys);
+        session.runFrame();
+        player.verifyFrame(session.getHeadlessDisplay().getFrameHash());
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    double fps = elapsed > 0 ? player.getFrame() * 1000.0 / elapsed : 0.0;
+    LOGI("Headless replay of %s took %lld ms (%.1f frames/s)", path.c_str(), static_cast<long long>(elapsed), fps);
+    player.logResult();
+
+    // Logging is compiled out of release builds, so benchmarks read the result from here
+    std::ofstream result(path + ".result", std::ios::out | std::ios::trunc);
+    result << "frames=" << player.getFrame() << " elapsed_ms=" << elapsed << " fps=" << fps
+           << " divergences=" << player.getDivergences() << std::endl;
+    return static_cast<int>(player.getDivergences());
+}
+#endif
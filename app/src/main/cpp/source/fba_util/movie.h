@@ -0,0 +1,153 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FB_ANDROID_UTIL_MOVIE_H
+#define FB_ANDROID_UTIL_MOVIE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <emulator/emulator.h>
+#include <fba_util/app_state.h>
+
+#define FB_ANDROID_MOVIE_MAGIC 0x564d4246 // "FBMV"
+#define FB_ANDROID_MOVIE_VERSION 1
+
+namespace FunkyBoyAndroid {
+
+    typedef struct {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t frameCount;
+        uint32_t runCount;
+        uint32_t stateSize;
+        uint8_t globalChecksum[2];
+        uint8_t headerChecksum;
+        uint8_t reserved;
+        char romPath[FB_ANDROID_APP_STATE_ROM_PATH_BUFFER_SIZE];
+    } movie_header;
+
+    /**
+     * Run of consecutive frames during which the joypad state did not change.
+     * Joypad states are stored as FBA_KEY_* masks.
+     */
+    typedef struct {
+        uint16_t length;
+        uint8_t keys;
+    } movie_run;
+
+    /**
+     * Movie file layout: movie_header, followed by the initial save state, the input runs and one
+     * framebuffer hash per frame.
+     */
+    typedef struct {
+        movie_header header;
+        std::vector<char> state;
+        std::vector<movie_run> runs;
+        std::vector<uint64_t> hashes;
+    } movie;
+
+    /**
+     * Records the joypad state of every emulated frame, starting from a save state of the moment
+     * the recording began.
+     */
+    class MovieRecorder {
+    private:
+        movie recording;
+        std::string path;
+
+    public:
+        MovieRecorder(FunkyBoy::Emulator &emulator, const std::string &romPath, std::string path);
+
+        /**
+         * @param keys joypad state which has been applied before emulating the frame
+         * @param hash framebuffer hash after the frame has been emulated
+         */
+        void recordFrame(uint8_t keys, uint64_t hash);
+
+        /**
+         * Writes the movie to its file.
+         */
+        bool finish();
+    };
+
+    /**
+     * Feeds the inputs of a recorded movie back into an emulator, frame by frame, and compares
+     * the resulting framebuffer hashes with the recorded ones.
+     */
+    class MoviePlayer {
+    private:
+        movie playback;
+        size_t run;
+        uint32_t runOffset;
+        uint32_t frame;
+        uint32_t firstDivergence;
+        uint32_t divergences;
+
+    public:
+        MoviePlayer();
+
+        bool load(const std::string &path);
+
+        inline const char *getROMPath() const {
+            return playback.header.romPath;
+        }
+
+        /**
+         * Loads the initial state of the movie into the given emulator, which must already have
+         * the movie's ROM loaded.
+         */
+        bool start(FunkyBoy::Emulator &emulator);
+
+        /**
+         * Advances to the next frame.
+         *
+         * @param keys receives the joypad state to apply before emulating the frame
+         * @return false once all frames have been played
+         */
+        bool nextFrame(uint8_t &keys);
+
+        /**
+         * Compares the framebuffer hash of the frame emulated last with the recorded one.
+         */
+        void verifyFrame(uint64_t hash);
+
+        inline uint32_t getFrame() const {
+            return frame;
+        }
+
+        inline uint32_t getDivergences() const {
+            return divergences;
+        }
+
+        void logResult() const;
+    };
+
+#ifdef FB_ANDROID_BENCHMARK
+    /**
+     * Replays a movie on a separate emulator instance without display or audio output, as fast
+     * as possible. The outcome is written to a file next to the movie, with the suffix ".result".
+     * Only available to benchmark builds, which accept a movie to replay from the launch intent.
+     *
+     * @return the amount of frames whose framebuffer diverged from the recording, or -1 if the
+     *         movie could not be replayed
+     */
+    int verifyMovieHeadless(const std::string &path);
+#endif
+
+}
+
+#endif //FB_ANDROID_UTIL_MOVIE_H
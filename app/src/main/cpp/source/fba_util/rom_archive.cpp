@@ -0,0 +1,328 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "rom_archive.h"
+
+#include <fba_util/logging.h>
+
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+#include <zlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+
+#define ZIP_LOCAL_HEADER_SIGNATURE 0x04034b50
+#define ZIP_CENTRAL_HEADER_SIGNATURE 0x02014b50
+#define ZIP_END_OF_CENTRAL_DIRECTORY_SIGNATURE 0x06054b50
+#define ZIP_LOCAL_HEADER_SIZE 30
+#define ZIP_CENTRAL_HEADER_SIZE 46
+#define ZIP_END_OF_CENTRAL_DIRECTORY_SIZE 22
+#define ZIP_METHOD_STORED 0
+#define ZIP_METHOD_DEFLATED 8
+
+// Upper bound for ROM sizes, protects against archives announcing absurd sizes
+#define FB_ANDROID_ROM_ARCHIVE_MAX_SIZE (8 * 1024 * 1024)
+
+using namespace FunkyBoyAndroid;
+
+namespace {
+
+    inline uint16_t readLE16(const uint8_t *p) {
+        return p[0] | (p[1] << 8);
+    }
+
+    inline uint32_t readLE32(const uint8_t *p) {
+        return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+    }
+
+    bool hasROMExtension(const uint8_t *name, size_t len) {
+        static const char *extensions[] = { ".gb", ".gbc", ".bin" };
+        for (auto ext : extensions) {
+            size_t extLen = std::strlen(ext);
+            if (len >= extLen && strncasecmp(reinterpret_cast<const char *>(name) + len - extLen, ext, extLen) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    typedef struct {
+        const uint8_t *data;
+        size_t compressedSize;
+        size_t uncompressedSize;
+        uint16_t method;
+    } archive_entry;
+
+    bool findZipEntry(const uint8_t *archive, size_t size, archive_entry &entry) {
+        if (size < ZIP_END_OF_CENTRAL_DIRECTORY_SIZE) {
+            return false;
+        }
+        // The end of central directory record is followed by a comment of at most 64 KiB
+        const uint8_t *eocd = nullptr;
+        size_t minOffset = size > 0xFFFF + ZIP_END_OF_CENTRAL_DIRECTORY_SIZE ? size - 0xFFFF - ZIP_END_OF_CENTRAL_DIRECTORY_SIZE : 0;
+        for (size_t offset = size - ZIP_END_OF_CENTRAL_DIRECTORY_SIZE + 1 ; offset-- > minOffset ; ) {
+            if (readLE32(archive + offset) == ZIP_END_OF_CENTRAL_DIRECTORY_SIGNATURE) {
+                eocd = archive + offset;
+                break;
+            }
+        }
+        if (eocd == nullptr) {
+            LOGW("Zip end of central directory not found");
+            return false;
+        }
+        uint16_t entries = readLE16(eocd + 10);
+        size_t offset = readLE32(eocd + 16);
+        const uint8_t *fallback = nullptr;
+        for (uint16_t i = 0 ; i < entries ; i++) {
+            if (offset + ZIP_CENTRAL_HEADER_SIZE > size || readLE32(archive + offset) != ZIP_CENTRAL_HEADER_SIGNATURE) {
+                LOGW("Corrupt zip central directory");
+                return false;
+            }
+            const uint8_t *central = archive + offset;
+            uint16_t nameLen = readLE16(central + 28);
+            uint16_t extraLen = readLE16(central + 30);
+            uint16_t commentLen = readLE16(central + 32);
+            // The name is read below, and the record as a whole is skipped to reach the next one
+            size_t headerSize = ZIP_CENTRAL_HEADER_SIZE + nameLen + extraLen + commentLen;
+            if (offset + headerSize > size) {
+                LOGW("Zip central directory exceeds archive size");
+                return false;
+            }
+            if (hasROMExtension(central + ZIP_CENTRAL_HEADER_SIZE, nameLen)) {
+                fallback = central;
+                break;
+            } else if (fallback == nullptr && readLE32(central + 24) > 0) {
+                fallback = central;
+            }
+            offset += headerSize;
+        }
+        if (fallback == nullptr) {
+            LOGW("No ROM found in zip archive");
+            return false;
+        }
+        // Sizes are taken from the central directory, as local headers may defer them to a data descriptor
+        entry.method = readLE16(fallback + 10);
+        entry.compressedSize = readLE32(fallback + 20);
+        entry.uncompressedSize = readLE32(fallback + 24);
+        size_t localOffset = readLE32(fallback + 42);
+        if (localOffset + ZIP_LOCAL_HEADER_SIZE > size || readLE32(archive + localOffset) != ZIP_LOCAL_HEADER_SIGNATURE) {
+            LOGW("Corrupt zip local header");
+            return false;
+        }
+        size_t dataOffset = localOffset + ZIP_LOCAL_HEADER_SIZE + readLE16(archive + localOffset + 26) + readLE16(archive + localOffset + 28);
+        if (dataOffset > size || entry.compressedSize > size - dataOffset) {
+            LOGW("Zip entry exceeds archive size");
+            return false;
+        }
+        entry.data = archive + dataOffset;
+        return true;
+    }
+
+    bool findGzipStream(const uint8_t *archive, size_t size, archive_entry &entry) {
+        if (size < 18) {
+            return false;
+        }
+        // The header is parsed by zlib, the uncompressed size (modulo 2^32) is stored in the trailer
+        entry.data = archive;
+        entry.compressedSize = size;
+        entry.uncompressedSize = readLE32(archive + size - 4);
+        entry.method = ZIP_METHOD_DEFLATED;
+        return true;
+    }
+
+    bool inflateEntry(const archive_entry &entry, uint8_t *out, int windowBits) {
+        z_stream stream{};
+        if (inflateInit2(&stream, windowBits) != Z_OK) {
+            return false;
+        }
+        stream.next_in = const_cast<Bytef *>(entry.data);
+        stream.avail_in = entry.compressedSize;
+        stream.next_out = out;
+        stream.avail_out = entry.uncompressedSize;
+        int result = inflate(&stream, Z_FINISH);
+        inflateEnd(&stream);
+        if (result != Z_STREAM_END || stream.total_out != entry.uncompressedSize) {
+            LOGW("Inflating ROM failed: %d (%s)", result, stream.msg != nullptr ? stream.msg : "size mismatch");
+            return false;
+        }
+        return true;
+    }
+
+    int createMemoryFile(const char *name) {
+#ifdef __NR_memfd_create
+        return static_cast<int>(syscall(__NR_memfd_create, name, MFD_CLOEXEC));
+#else
+        errno = ENOSYS;
+        return -1;
+#endif
+    }
+
+}
+
+bool ROMArchive::isCompressed(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    uint8_t magic[4]{};
+    ssize_t len = read(fd, magic, sizeof(magic));
+    close(fd);
+    if (len < 2) {
+        return false;
+    }
+    return (len == 4 && readLE32(magic) == ZIP_LOCAL_HEADER_SIGNATURE) || (magic[0] == 0x1f && magic[1] == 0x8b);
+}
+
+int ROMArchive::inflateToMemoryFile(const char *path, size_t &romSize) {
+    auto start = std::chrono::steady_clock::now();
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        LOGW("Unable to open archive %s: %s", path, std::strerror(errno));
+        return -1;
+    }
+    struct stat st{};
+    if (fstat(fd, &st) != 0 || st.st_size < 4) {
+        close(fd);
+        return -1;
+    }
+    void *mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        LOGW("Unable to map archive %s: %s", path, std::strerror(errno));
+        return -1;
+    }
+    madvise(mapping, st.st_size, MADV_SEQUENTIAL);
+    auto *archive = static_cast<const uint8_t *>(mapping);
+
+    archive_entry entry{};
+    bool isZip = readLE32(archive) == ZIP_LOCAL_HEADER_SIGNATURE;
+    bool found = isZip ? findZipEntry(archive, st.st_size, entry) : findGzipStream(archive, st.st_size, entry);
+    if (!found || entry.uncompressedSize == 0 || entry.uncompressedSize > FB_ANDROID_ROM_ARCHIVE_MAX_SIZE
+            || (entry.method != ZIP_METHOD_STORED && entry.method != ZIP_METHOD_DEFLATED)) {
+        LOGW("Archive %s does not contain a supported ROM", path);
+        munmap(mapping, st.st_size);
+        return -1;
+    }
+
+    int memFd = createMemoryFile("funkyboy-rom");
+    if (memFd < 0) {
+        LOGW("Unable to create memory file: %s", std::strerror(errno));
+        munmap(mapping, st.st_size);
+        return -1;
+    }
+    void *out = MAP_FAILED;
+    if (ftruncate(memFd, entry.uncompressedSize) == 0) {
+        out = mmap(nullptr, entry.uncompressedSize, PROT_READ | PROT_WRITE, MAP_SHARED, memFd, 0);
+    }
+    if (out == MAP_FAILED) {
+        LOGW("Unable to map memory file: %s", std::strerror(errno));
+        close(memFd);
+        munmap(mapping, st.st_size);
+        return -1;
+    }
+
+    bool success;
+    if (entry.method == ZIP_METHOD_STORED) {
+        success = entry.compressedSize == entry.uncompressedSize;
+        if (success) {
+            std::memcpy(out, entry.data, entry.uncompressedSize);
+        }
+    } else {
+        // Raw deflate for zip entries, automatic gzip header detection otherwise
+        success = inflateEntry(entry, static_cast<uint8_t *>(out), isZip ? -MAX_WBITS : 16 + MAX_WBITS);
+    }
+    munmap(out, entry.uncompressedSize);
+    munmap(mapping, st.st_size);
+    if (!success) {
+        close(memFd);
+        return -1;
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    LOGI("Inflated %zu bytes from %s in %lld us (%.1f MiB/s)", entry.uncompressedSize, path,
+         static_cast<long long>(elapsed), elapsed > 0 ? (entry.uncompressedSize / 1048576.0) / (elapsed / 1000000.0) : 0.0);
+    romSize = entry.uncompressedSize;
+    return memFd;
+}
+
+int ROMArchive::readToMemoryFile(const char *path, size_t &romSize) {
+    auto start = std::chrono::steady_clock::now();
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        LOGW("Unable to open ROM %s: %s", path, std::strerror(errno));
+        return -1;
+    }
+    struct stat st{};
+    if (fstat(fd, &st) != 0 || st.st_size <= 0 || st.st_size > FB_ANDROID_ROM_ARCHIVE_MAX_SIZE) {
+        LOGW("ROM %s is empty or too big", path);
+        close(fd);
+        return -1;
+    }
+    size_t size = st.st_size;
+
+    int memFd = createMemoryFile("funkyboy-rom");
+    if (memFd < 0) {
+        LOGW("Unable to create memory file: %s", std::strerror(errno));
+        close(fd);
+        return -1;
+    }
+    void *out = MAP_FAILED;
+    if (ftruncate(memFd, size) == 0) {
+        out = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, memFd, 0);
+    }
+    if (out == MAP_FAILED) {
+        LOGW("Unable to map memory file: %s", std::strerror(errno));
+        close(memFd);
+        close(fd);
+        return -1;
+    }
+
+    size_t offset = 0;
+    while (offset < size) {
+        ssize_t result = pread(fd, static_cast<char *>(out) + offset, size - offset, offset);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            break;
+        }
+        offset += result;
+    }
+    munmap(out, size);
+    close(fd);
+    if (offset != size) {
+        LOGW("Unable to read ROM %s: %s", path, offset < size ? std::strerror(errno) : "size mismatch");
+        close(memFd);
+        return -1;
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    LOGI("Read %zu bytes from %s in %lld us", size, path, static_cast<long long>(elapsed));
+    romSize = size;
+    return memFd;
+}
+
+std::string ROMArchive::fdPath(int fd) {
+    return "/proc/self/fd/" + std::to_string(fd);
+}
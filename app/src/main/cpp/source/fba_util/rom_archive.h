@@ -0,0 +1,58 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FB_ANDROID_UTIL_ROM_ARCHIVE_H
+#define FB_ANDROID_UTIL_ROM_ARCHIVE_H
+
+#include <string>
+#include <cstddef>
+
+namespace FunkyBoyAndroid {
+
+    namespace ROMArchive {
+
+        /**
+         * @return true if the file is a zip archive or a gzip stream, determined by its magic bytes
+         */
+        bool isCompressed(const char *path);
+
+        /**
+         * Inflates the ROM contained in a zip archive or a gzip stream in a single streaming pass
+         * into an anonymous, memory-backed file (memfd). No temporary file is written to storage.
+         * For zip archives, the first entry with a .gb, .gbc or .bin extension is used.
+         *
+         * @return the file descriptor of the memfd, or -1 on failure. Ownership is passed to the caller.
+         */
+        int inflateToMemoryFile(const char *path, size_t &romSize);
+
+        /**
+         * Reads an uncompressed ROM into an anonymous, memory-backed file (memfd), so that loading it
+         * afterwards does not wait for storage.
+         *
+         * @return the file descriptor of the memfd, or -1 on failure. Ownership is passed to the caller.
+         */
+        int readToMemoryFile(const char *path, size_t &romSize);
+
+        /**
+         * @return a path which can be passed to FunkyBoy::Emulator::loadGame to read from the given file descriptor
+         */
+        std::string fdPath(int fd);
+
+    }
+
+}
+
+#endif //FB_ANDROID_UTIL_ROM_ARCHIVE_H
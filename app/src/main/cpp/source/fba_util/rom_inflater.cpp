@@ -0,0 +1,93 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "rom_inflater.h"
+
+#include <fba_util/logging.h>
+#include <fba_util/rom_archive.h>
+
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+
+using namespace FunkyBoyAndroid;
+
+ROMInflater::ROMInflater(ALooper *looper, callback onInflated)
+    : looper(looper)
+    , wakePipe{-1, -1}
+    , resultFd(-1)
+    , busy(false)
+    , onInflated(std::move(onInflated))
+{
+    if (pipe(wakePipe) != 0) {
+        LOGE("Unable to create ROM inflater pipe: %s", std::strerror(errno));
+        return;
+    }
+    ALooper_addFd(looper, wakePipe[0], ALOOPER_POLL_CALLBACK, ALOOPER_EVENT_INPUT, onWake, this);
+}
+
+ROMInflater::~ROMInflater() {
+    if (worker.joinable()) {
+        worker.join();
+    }
+    if (resultFd >= 0) {
+        close(resultFd);
+    }
+    if (wakePipe[0] >= 0) {
+        ALooper_removeFd(looper, wakePipe[0]);
+        close(wakePipe[0]);
+        close(wakePipe[1]);
+    }
+}
+
+bool ROMInflater::start(const std::string &romPath) {
+    if (busy) {
+        LOGW("Still preparing %s, ignoring %s", path.c_str(), romPath.c_str());
+        return false;
+    }
+    if (wakePipe[0] < 0) {
+        return false;
+    }
+    busy = true;
+    path = romPath;
+    worker = std::thread([this]() {
+        size_t romSize;
+        if (ROMArchive::isCompressed(path.c_str())) {
+            resultFd = ROMArchive::inflateToMemoryFile(path.c_str(), romSize);
+        } else {
+            resultFd = ROMArchive::readToMemoryFile(path.c_str(), romSize);
+        }
+        char signal = 1;
+        write(wakePipe[1], &signal, sizeof(signal));
+    });
+    return true;
+}
+
+int ROMInflater::onWake(int fd, int events, void *data) {
+    auto *inflater = static_cast<ROMInflater *>(data);
+    char signal;
+    if (read(fd, &signal, sizeof(signal)) != sizeof(signal) || !inflater->busy) {
+        return 1;
+    }
+    if (inflater->worker.joinable()) {
+        inflater->worker.join();
+    }
+    inflater->busy = false;
+    int romFd = inflater->resultFd;
+    inflater->resultFd = -1;
+    inflater->onInflated(romFd, inflater->path);
+    return 1;
+}
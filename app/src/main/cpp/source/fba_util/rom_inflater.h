@@ -0,0 +1,65 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FB_ANDROID_UTIL_ROM_INFLATER_H
+#define FB_ANDROID_UTIL_ROM_INFLATER_H
+
+#include <string>
+#include <thread>
+#include <functional>
+#include <android/looper.h>
+
+namespace FunkyBoyAndroid {
+
+    /**
+     * Inflates compressed ROMs, and reads plain ones, into memory on a background thread and calls
+     * back on the looper thread once done, so that the looper never waits for storage.
+     */
+    class ROMInflater {
+    public:
+        typedef std::function<void(int fd, const std::string &path)> callback;
+
+    private:
+        ALooper *looper;
+        int wakePipe[2];
+        std::thread worker;
+        std::string path;
+        int resultFd;
+        // Set from start() until the result has been handed to the callback
+        bool busy;
+        callback onInflated;
+
+        static int onWake(int fd, int events, void *data);
+
+    public:
+        ROMInflater(ALooper *looper, callback onInflated);
+        ~ROMInflater();
+
+        /**
+         * Starts inflating or reading the given ROM on the background thread.
+         *
+         * @return false if the previous ROM is still being prepared, in which case nothing is started
+         */
+        bool start(const std::string &path);
+
+        inline bool isBusy() const {
+            return busy;
+        }
+    };
+
+}
+
+#endif //FB_ANDROID_UTIL_ROM_INFLATER_H
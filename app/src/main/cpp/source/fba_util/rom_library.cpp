@@ -0,0 +1,267 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "rom_library.h"
+
+#include <fba_util/logging.h>
+#include <util/work_stealing_pool.h>
+
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace FunkyBoyAndroid;
+
+namespace {
+
+    typedef struct {
+        std::string path;
+        rom_library_entry entry;
+    } scanned_rom;
+
+    bool isROMFile(const char *name) {
+        const char *ext = std::strrchr(name, '.');
+        return ext != nullptr && (strcasecmp(ext, ".gb") == 0 || strcasecmp(ext, ".gbc") == 0 || strcasecmp(ext, ".bin") == 0);
+    }
+
+    bool readHeader(const std::string &path, rom_library_entry &entry) {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return false;
+        }
+        // Only the header is read, not the whole ROM
+        uint8_t header[FB_ANDROID_ROM_HEADER_END - FB_ANDROID_ROM_HEADER_TITLE];
+        ssize_t len = pread(fd, header, sizeof(header), FB_ANDROID_ROM_HEADER_TITLE);
+        close(fd);
+        if (len != sizeof(header)) {
+            return false;
+        }
+        auto at = [&header](size_t offset) { return header[offset - FB_ANDROID_ROM_HEADER_TITLE]; };
+        std::memcpy(entry.title, header, FB_ROM_HEADER_TITLE_BYTES);
+        entry.destinationCode = at(FB_ANDROID_ROM_HEADER_DESTINATION_CODE);
+        entry.cartridgeType = at(FB_ANDROID_ROM_HEADER_CARTRIDGE_TYPE);
+        entry.romSize = at(FB_ANDROID_ROM_HEADER_ROM_SIZE);
+        entry.ramSize = at(FB_ANDROID_ROM_HEADER_RAM_SIZE);
+        entry.headerChecksum = at(FB_ANDROID_ROM_HEADER_CHECKSUM);
+        entry.globalChecksum[0] = at(FB_ANDROID_ROM_HEADER_GLOBAL_CHECKSUM);
+        entry.globalChecksum[1] = at(FB_ANDROID_ROM_HEADER_GLOBAL_CHECKSUM + 1);
+        return true;
+    }
+
+}
+
+ROMLibrary::ROMLibrary(std::string indexPath)
+    : indexPath(std::move(indexPath))
+    , mapping(nullptr)
+    , mappingSize(0)
+    , header(nullptr)
+    , entries(nullptr)
+    , stringPool(nullptr)
+{
+}
+
+ROMLibrary::~ROMLibrary() {
+    unmap();
+}
+
+void ROMLibrary::unmap() {
+    if (mapping != nullptr) {
+        munmap(mapping, mappingSize);
+    }
+    mapping = nullptr;
+    mappingSize = 0;
+    header = nullptr;
+    entries = nullptr;
+    stringPool = nullptr;
+}
+
+bool ROMLibrary::open() {
+    unmap();
+    int fd = ::open(indexPath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st{};
+    if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(rom_library_header))) {
+        close(fd);
+        return false;
+    }
+    void *m = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED) {
+        LOGW("Unable to map ROM library index: %s", std::strerror(errno));
+        return false;
+    }
+    auto *h = static_cast<const rom_library_header *>(m);
+    // Counts are checked against the file size first, so that neither the sum nor a record overflows
+    size_t available = st.st_size - sizeof(rom_library_header);
+    bool valid = h->magic == FB_ANDROID_ROM_LIBRARY_MAGIC && h->version == FB_ANDROID_ROM_LIBRARY_VERSION
+            && h->entryCount <= available / sizeof(rom_library_entry)
+            && h->stringPoolSize == available - h->entryCount * sizeof(rom_library_entry);
+    auto *e = reinterpret_cast<const rom_library_entry *>(h + 1);
+    for (uint32_t i = 0 ; valid && i < h->entryCount ; i++) {
+        valid = e[i].pathOffset <= h->stringPoolSize && e[i].pathLength <= h->stringPoolSize - e[i].pathOffset;
+    }
+    if (!valid) {
+        LOGW("Discarding invalid ROM library index");
+        munmap(m, st.st_size);
+        return false;
+    }
+    mapping = m;
+    mappingSize = st.st_size;
+    header = h;
+    entries = e;
+    stringPool = reinterpret_cast<const char *>(entries + h->entryCount);
+    return true;
+}
+
+size_t ROMLibrary::scan(const std::vector<std::string> &directories) {
+    auto start = std::chrono::steady_clock::now();
+
+    // Index of the previous scan, used to skip unchanged files
+    std::unordered_map<std::string, const rom_library_entry *> previous;
+    for (size_t i = 0 ; i < size() ; i++) {
+        previous.emplace(getPath(i), &entries[i]);
+    }
+
+    std::mutex resultMutex;
+    std::vector<scanned_rom> results;
+    // Directories are identified by device and inode, so that symlink cycles are only entered once
+    std::set<std::pair<dev_t, ino_t>> visitedDirectories;
+    std::atomic<size_t> filesVisited(0);
+    std::atomic<size_t> headersRead(0);
+
+    std::function<void(Util::WorkStealingPool &, size_t, const std::string &)> scanDirectory;
+    scanDirectory = [&](Util::WorkStealingPool &pool, size_t worker, const std::string &directory) {
+        DIR *dir = opendir(directory.c_str());
+        if (dir == nullptr) {
+            return;
+        }
+        struct stat dirStat{};
+        if (fstat(dirfd(dir), &dirStat) != 0) {
+            closedir(dir);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(resultMutex);
+            if (!visitedDirectories.emplace(dirStat.st_dev, dirStat.st_ino).second) {
+                closedir(dir);
+                return;
+            }
+        }
+        std::vector<scanned_rom> found;
+        struct dirent *dirEntry;
+        while ((dirEntry = readdir(dir)) != nullptr) {
+            if (dirEntry->d_name[0] == '.') {
+                continue;
+            }
+            std::string childPath = directory + "/" + dirEntry->d_name;
+            struct stat st{};
+            if (stat(childPath.c_str(), &st) != 0) {
+                continue;
+            }
+            if (S_ISDIR(st.st_mode)) {
+                pool.push([&scanDirectory, childPath](Util::WorkStealingPool &p, size_t w) {
+                    scanDirectory(p, w, childPath);
+                }, worker);
+                continue;
+            }
+            if (!S_ISREG(st.st_mode) || !isROMFile(dirEntry->d_name)) {
+                continue;
+            }
+            filesVisited.fetch_add(1, std::memory_order_relaxed);
+            scanned_rom rom{childPath, {}};
+            auto it = previous.find(childPath);
+            if (it != previous.end() && it->second->mtime == st.st_mtime && it->second->size == st.st_size) {
+                rom.entry = *it->second;
+            } else if (readHeader(childPath, rom.entry)) {
+                headersRead.fetch_add(1, std::memory_order_relaxed);
+                rom.entry.mtime = st.st_mtime;
+                rom.entry.size = st.st_size;
+            } else {
+                continue;
+            }
+            found.push_back(std::move(rom));
+        }
+        closedir(dir);
+        std::lock_guard<std::mutex> lock(resultMutex);
+        std::move(found.begin(), found.end(), std::back_inserter(results));
+    };
+
+    {
+        Util::WorkStealingPool pool(FB_ANDROID_ROM_LIBRARY_SCAN_THREADS);
+        for (auto &directory : directories) {
+            pool.push([&scanDirectory, directory](Util::WorkStealingPool &p, size_t w) {
+                scanDirectory(p, w, directory);
+            });
+        }
+        pool.wait();
+    }
+    previous.clear();
+
+    std::sort(results.begin(), results.end(), [](const scanned_rom &a, const scanned_rom &b) {
+        return a.path < b.path;
+    });
+
+    rom_library_header newHeader{};
+    newHeader.magic = FB_ANDROID_ROM_LIBRARY_MAGIC;
+    newHeader.version = FB_ANDROID_ROM_LIBRARY_VERSION;
+    newHeader.entryCount = results.size();
+    std::string pool;
+    for (auto &rom : results) {
+        rom.entry.pathOffset = pool.size();
+        rom.entry.pathLength = rom.path.size();
+        pool += rom.path;
+    }
+    newHeader.stringPoolSize = pool.size();
+
+    std::string tmpPath = indexPath + ".tmp";
+    FILE *file = std::fopen(tmpPath.c_str(), "wb");
+    if (file == nullptr) {
+        LOGW("Unable to write ROM library index: %s", std::strerror(errno));
+        return results.size();
+    }
+    std::fwrite(&newHeader, sizeof(newHeader), 1, file);
+    for (auto &rom : results) {
+        std::fwrite(&rom.entry, sizeof(rom_library_entry), 1, file);
+    }
+    std::fwrite(pool.data(), 1, pool.size(), file);
+    bool written = std::fflush(file) == 0 && fsync(fileno(file)) == 0;
+    std::fclose(file);
+
+    // The old mapping stays valid until replaced, readers never see a partially written index
+    if (written && std::rename(tmpPath.c_str(), indexPath.c_str()) == 0) {
+        open();
+    } else {
+        LOGW("Unable to replace ROM library index");
+        unlink(tmpPath.c_str());
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    LOGI("Scanned %zu ROMs (%zu headers read) in %lld us, %.0f files/s", filesVisited.load(), headersRead.load(),
+         static_cast<long long>(elapsed), elapsed > 0 ? filesVisited.load() * 1000000.0 / elapsed : 0.0);
+    return results.size();
+}
@@ -0,0 +1,116 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FB_ANDROID_UTIL_ROM_LIBRARY_H
+#define FB_ANDROID_UTIL_ROM_LIBRARY_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <util/typedefs.h>
+
+#define FB_ANDROID_ROM_LIBRARY_MAGIC 0x4C424246 // "FBBL"
+#define FB_ANDROID_ROM_LIBRARY_VERSION 1
+#define FB_ANDROID_ROM_LIBRARY_SCAN_THREADS 4
+
+// Offsets within the cartridge header
+#define FB_ANDROID_ROM_HEADER_TITLE 0x134
+#define FB_ANDROID_ROM_HEADER_CARTRIDGE_TYPE 0x147
+#define FB_ANDROID_ROM_HEADER_ROM_SIZE 0x148
+#define FB_ANDROID_ROM_HEADER_RAM_SIZE 0x149
+#define FB_ANDROID_ROM_HEADER_DESTINATION_CODE 0x14A
+#define FB_ANDROID_ROM_HEADER_CHECKSUM 0x14D
+#define FB_ANDROID_ROM_HEADER_GLOBAL_CHECKSUM 0x14E
+#define FB_ANDROID_ROM_HEADER_END 0x150
+
+namespace FunkyBoyAndroid {
+
+    typedef struct {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t entryCount;
+        uint32_t stringPoolSize;
+    } rom_library_header;
+
+    /**
+     * Fixed-size index record. Paths are stored in a string pool following the records.
+     */
+    typedef struct {
+        int64_t mtime;
+        int64_t size;
+        uint32_t pathOffset;
+        uint16_t pathLength;
+        uint8_t title[FB_ROM_HEADER_TITLE_BYTES];
+        uint8_t destinationCode;
+        uint8_t cartridgeType;
+        uint8_t romSize;
+        uint8_t ramSize;
+        uint8_t headerChecksum;
+        uint8_t globalChecksum[2];
+    } rom_library_entry;
+
+    /**
+     * Index of the ROMs found in a set of directories, persisted as a compact binary file. The
+     * previous index is memory-mapped on open, so that a rescan only reads the headers of new or
+     * changed files.
+     */
+    class ROMLibrary {
+    private:
+        std::string indexPath;
+        void *mapping;
+        size_t mappingSize;
+        const rom_library_header *header;
+        const rom_library_entry *entries;
+        const char *stringPool;
+
+        void unmap();
+
+    public:
+        explicit ROMLibrary(std::string indexPath);
+        ~ROMLibrary();
+
+        /**
+         * Maps the index file, if present and valid, for the next scan to take over its records.
+         */
+        bool open();
+
+        /**
+         * Scans the given directories in parallel and replaces the index file, which is then mapped
+         * in place of the previous one.
+         * Files whose size and mtime match their current index record are not read again. Symlinked
+         * directories are followed, but every directory is only scanned once.
+         *
+         * @return amount of ROMs found
+         */
+        size_t scan(const std::vector<std::string> &directories);
+
+        inline size_t size() const {
+            return header != nullptr ? header->entryCount : 0;
+        }
+
+        inline const rom_library_entry &getEntry(size_t index) const {
+            return entries[index];
+        }
+
+        inline std::string getPath(size_t index) const {
+            return std::string(stringPool + entries[index].pathOffset, entries[index].pathLength);
+        }
+    };
+
+}
+
+#endif //FB_ANDROID_UTIL_ROM_LIBRARY_H
@@ -0,0 +1,164 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "run_ahead.h"
+
+#include <fba_util/logging.h>
+#include <chrono>
+
+using namespace FunkyBoyAndroid;
+
+namespace {
+
+    inline uint64_t nowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    inline uint64_t average(uint64_t current, uint64_t sample) {
+        return current == 0 ? sample : (current * 7 + sample) / 8;
+    }
+
+}
+
+RunAhead::RunAhead(Util::Arena &arena)
+    : buffer(arena.allocateArray<char>(FB_SAVE_STATE_MAX_BUFFER_SIZE, Util::ArenaTag::Snapshot), FB_SAVE_STATE_MAX_BUFFER_SIZE)
+    , ostream(&buffer)
+    , istream(&buffer)
+    , requestedFrames(0)
+    , activeFrames(0)
+    , averageFrameNs(0)
+    , averageSnapshotNs(0)
+    , overBudgetFrames(0)
+    , retryCountdown(0)
+    , stats()
+{
+}
+
+void RunAhead::setFrames(uint32_t frames) {
+    if (frames > FB_ANDROID_RUN_AHEAD_MAX_FRAMES) {
+        LOGW("Cannot run ahead %u frames, limiting to %d", frames, FB_ANDROID_RUN_AHEAD_MAX_FRAMES);
+        frames = FB_ANDROID_RUN_AHEAD_MAX_FRAMES;
+    }
+    requestedFrames = frames;
+    activeFrames = frames;
+    overBudgetFrames = 0;
+    retryCountdown = 0;
+    stats = {};
+    LOGD("Running %u frames ahead", frames);
+}
+
+void RunAhead::runFrame(Session &session, Controller::DisplayControllerAndroid &display,
+                        Controller::AudioControllerAndroid &audio, ANativeWindow *window) {
+    uint64_t start = nowNs();
+    if (activeFrames == 0) {
+        // Fell back to regular emulation, which still tells whether running ahead became affordable
+        display.setWindow(window);
+        session.runFrame();
+        uint64_t frameNs = nowNs() - start;
+        stats.frames++;
+        stats.emulationNs += frameNs;
+        adapt(frameNs, frameNs);
+        return;
+    }
+
+    display.setRendering(false);
+    display.setWindow(nullptr);
+    session.runFrame();
+    uint64_t emulated = nowNs();
+
+    auto &emulator = session.getEmulator();
+    buffer.rewindWrite();
+    ostream.clear();
+    emulator.saveState(ostream);
+    uint64_t saved = nowNs();
+    if (buffer.overflowed()) {
+        LOGE("Emulation state exceeds %d bytes, cannot run ahead", FB_SAVE_STATE_MAX_BUFFER_SIZE);
+        display.setRendering(true);
+        setFrames(0);
+        return;
+    }
+
+    audio.setMuted(true);
+    for (uint32_t i = 1 ; i <= activeFrames ; i++) {
+        bool last = i == activeFrames;
+        display.setRendering(last);
+        display.setWindow(last ? window : nullptr);
+        session.runFrameAhead();
+    }
+    audio.setMuted(false);
+    display.setWindow(nullptr);
+    uint64_t ahead = nowNs();
+
+    buffer.rewindRead();
+    istream.clear();
+    emulator.loadState(istream);
+    uint64_t restored = nowNs();
+
+    stats.frames++;
+    stats.emulationNs += emulated - start;
+    stats.snapshotNs += saved - emulated;
+    stats.aheadNs += ahead - saved;
+    stats.restoreNs += restored - ahead;
+    averageSnapshotNs = average(averageSnapshotNs, (saved - emulated) + (restored - ahead));
+    adapt(emulated - start, restored - start);
+}
+
+void RunAhead::adapt(uint64_t frameNs, uint64_t totalNs) {
+    averageFrameNs = average(averageFrameNs, frameNs);
+    if (totalNs > FB_ANDROID_RUN_AHEAD_BUDGET_NS) {
+        stats.overBudgetFrames++;
+        if (activeFrames > 0 && ++overBudgetFrames >= FB_ANDROID_RUN_AHEAD_FALLBACK_FRAMES) {
+            activeFrames--;
+            overBudgetFrames = 0;
+            retryCountdown = FB_ANDROID_RUN_AHEAD_RETRY_FRAMES;
+            stats.fallbacks++;
+            LOGW("Device cannot keep up with running ahead, falling back to %u frames", activeFrames);
+        }
+    } else {
+        overBudgetFrames = 0;
+    }
+
+    if (stats.frames % FB_ANDROID_RUN_AHEAD_REPORT_INTERVAL == 0) {
+        log();
+    }
+
+    if (activeFrames >= requestedFrames) {
+        return;
+    }
+    if (retryCountdown > 0) {
+        retryCountdown--;
+        return;
+    }
+    // Only retry with some headroom, so that the amount of frames does not flip back and forth
+    uint64_t predictedNs = averageFrameNs * (activeFrames + 2) + averageSnapshotNs;
+    if (predictedNs < FB_ANDROID_RUN_AHEAD_BUDGET_NS * 3 / 4) {
+        activeFrames++;
+        LOGI("Running %u frames ahead again", activeFrames);
+    }
+    retryCountdown = FB_ANDROID_RUN_AHEAD_RETRY_FRAMES;
+}
+
+void RunAhead::log() const {
+    if (stats.frames == 0) {
+        return;
+    }
+    double frames = static_cast<double>(stats.frames);
+    LOGI("Run-ahead: %u of %u frames, per frame %.3f ms emulation, %.3f ms snapshot, %.3f ms ahead, %.3f ms restore, %llu of %llu frames over budget, %u fallbacks",
+         activeFrames, requestedFrames, stats.emulationNs / 1e6 / frames, stats.snapshotNs / 1e6 / frames,
+         stats.aheadNs / 1e6 / frames, stats.restoreNs / 1e6 / frames,
+         static_cast<unsigned long long>(stats.overBudgetFrames), static_cast<unsigned long long>(stats.frames),
+         stats.fallbacks);
+}
@@ -0,0 +1,128 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FB_ANDROID_UTIL_RUN_AHEAD_H
+#define FB_ANDROID_UTIL_RUN_AHEAD_H
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <android/native_window.h>
+#include <controllers/audio_android.h>
+#include <controllers/display_android.h>
+#include <fba_util/session.h>
+#include <util/arena.h>
+#include <util/state_buffer.h>
+#include <util/typedefs.h>
+
+// Each frame run ahead costs a whole frame of emulation on top of the regular one
+#define FB_ANDROID_RUN_AHEAD_MAX_FRAMES 4
+
+// Share of a frame which running ahead may take, leaving the rest for presenting and handling input
+#define FB_ANDROID_RUN_AHEAD_BUDGET_NS 12000000
+
+// Frames over budget in a row after which one frame less is run ahead
+#define FB_ANDROID_RUN_AHEAD_FALLBACK_FRAMES 30
+
+// Frames after falling back until running one frame further ahead is considered again
+#define FB_ANDROID_RUN_AHEAD_RETRY_FRAMES 1800
+
+// Amount of frames after which the cost of running ahead gets logged
+#define FB_ANDROID_RUN_AHEAD_REPORT_INTERVAL 600
+
+namespace FunkyBoyAndroid {
+
+    struct run_ahead_stats {
+        uint64_t frames;
+        uint64_t overBudgetFrames;
+        uint32_t fallbacks;
+        // Sums over all frames, in nanoseconds
+        uint64_t emulationNs;
+        uint64_t snapshotNs;
+        uint64_t aheadNs;
+        uint64_t restoreNs;
+    };
+
+    /**
+     * Hides input lag which games add on their own. Each frame gets emulated as usual, with audio
+     * but without being presented. Then the emulation state is saved, the configured amount of
+     * frames are emulated without audio, of which only the last one is presented, and the state
+     * is restored. The player thereby sees the outcome of their input that many frames earlier.
+     *
+     * The snapshot stays in a buffer from the arena of the session, which is bound to the same
+     * streams all the time. As running ahead multiplies the emulation cost, the amount of frames
+     * run ahead is reduced while the device cannot sustain it, and increased again once it can.
+     * Movies rely on every emulated frame being the one that counts, so they cannot be combined
+     * with running ahead.
+     */
+    class RunAhead {
+    private:
+        Util::state_buffer buffer;
+        std::ostream ostream;
+        std::istream istream;
+
+        uint32_t requestedFrames;
+        uint32_t activeFrames;
+
+        // Moving averages, predicting the cost of running further ahead
+        uint64_t averageFrameNs;
+        uint64_t averageSnapshotNs;
+        uint32_t overBudgetFrames;
+        uint32_t retryCountdown;
+
+        run_ahead_stats stats;
+
+        void adapt(uint64_t frameNs, uint64_t totalNs);
+
+    public:
+        /**
+         * Allocates the snapshot buffer from the given arena, which has to outlive this instance.
+         */
+        explicit RunAhead(Util::Arena &arena);
+
+        /**
+         * @param frames amount of frames to run ahead, 0 disables running ahead
+         */
+        void setFrames(uint32_t frames);
+
+        inline uint32_t getFrames() const {
+            return requestedFrames;
+        }
+
+        /**
+         * @return amount of frames currently run ahead, which may be below the configured one
+         */
+        inline uint32_t getActiveFrames() const {
+            return activeFrames;
+        }
+
+        /**
+         * Emulates the next frame of the session, and presents the frame the configured amount of
+         * frames ahead of it to the given window.
+         */
+        void runFrame(Session &session, Controller::DisplayControllerAndroid &display,
+                      Controller::AudioControllerAndroid &audio, ANativeWindow *window);
+
+        inline const run_ahead_stats &getStats() const {
+            return stats;
+        }
+
+        void log() const;
+    };
+
+}
+
+#endif //FB_ANDROID_UTIL_RUN_AHEAD_H
@@ -0,0 +1,207 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "session.h"
+
+#include <fba_util/logging.h>
+#include <fba_util/rom_archive.h>
+
+#include <fstream>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace FunkyBoyAndroid;
+
+Session::Session(FunkyBoy::GameBoyType type)
+    : arena(FB_ANDROID_SESSION_ARENA_SIZE)
+    , emulator(std::make_unique<FunkyBoy::Emulator>(type))
+    , headlessDisplay(std::make_shared<Controller::DisplayControllerHashing>())
+    , headlessAudio(std::make_shared<Controller::AudioControllerNull>())
+    , display(headlessDisplay)
+    , audio(headlessAudio)
+    , batterySave(arena)
+    , saveGameAttached(false)
+    , firstFramePending(false)
+    , running(false)
+{
+    applyControllers();
+}
+
+Session::~Session() {
+    stop();
+    if (saveGameAttached) {
+        batterySave.requestFlush(*emulator);
+        batterySave.detach(*emulator);
+    }
+}
+
+void Session::applyControllers() {
+    FunkyBoy::Controller::Controllers controllers;
+    controllers.withDisplay(display).withAudio(audio);
+    if (serial != nullptr) {
+        controllers.withSerial(serial);
+    }
+    emulator->setControllers(controllers);
+}
+
+void Session::bindOutput(std::shared_ptr<FunkyBoy::Controller::DisplayController> d, std::shared_ptr<FunkyBoy::Controller::AudioController> a) {
+    display = std::move(d);
+    audio = std::move(a);
+    applyControllers();
+}
+
+void Session::unbindOutput() {
+    display = headlessDisplay;
+    audio = headlessAudio;
+    applyControllers();
+}
+
+void Session::setSerial(std::shared_ptr<FunkyBoy::Controller::SerialController> s) {
+    serial = std::move(s);
+    applyControllers();
+}
+
+void Session::beginROMLoad() {
+    romLoadStart = std::chrono::steady_clock::now();
+}
+
+FunkyBoy::CartridgeStatus Session::loadROM(const char *inRomPath) {
+    beginROMLoad();
+
+    if (ROMArchive::isCompressed(inRomPath)) {
+        size_t romSize;
+        return loadInflatedROM(ROMArchive::inflateToMemoryFile(inRomPath, romSize), inRomPath);
+    }
+
+    if (saveGameAttached) {
+        batterySave.detach(*emulator);
+        saveGameAttached = false;
+    }
+    auto result = emulator->loadGame(inRomPath);
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - romLoadStart);
+    LOGD("ROM load status: %d, loaded from %s in %lld us", result, inRomPath, static_cast<long long>(elapsed.count()));
+    struct stat st{};
+    stat(inRomPath, &st);
+    onROMLoaded(result, inRomPath, st.st_size);
+    return result;
+}
+
+FunkyBoy::CartridgeStatus Session::loadInflatedROM(int fd, const char *inRomPath) {
+    if (fd < 0) {
+        // Keep the running game, the caller reports the failure
+        LOGE("Unable to read ROM %s", inRomPath);
+        return FunkyBoy::CartridgeStatus::ROMFileNotReadable;
+    }
+    if (saveGameAttached) {
+        batterySave.detach(*emulator);
+        saveGameAttached = false;
+    }
+    auto result = emulator->loadGame(ROMArchive::fdPath(fd));
+    struct stat st{};
+    fstat(fd, &st);
+    close(fd);
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - romLoadStart);
+    LOGD("ROM load status: %d, inflated from %s in %lld us", result, inRomPath, static_cast<long long>(elapsed.count()));
+    onROMLoaded(result, inRomPath, st.st_size);
+    return result;
+}
+
+void Session::onROMLoaded(FunkyBoy::CartridgeStatus status, const char *inRomPath, size_t romSize) {
+    if (status == FunkyBoy::CartridgeStatus::Loaded) {
+        romPath = inRomPath;
+        // The ROM is buffered by the core
+        arena.setExternal(Util::ArenaTag::ROM, romSize);
+        firstFramePending = true;
+    }
+}
+
+void Session::attachSaveGame(const FunkyBoy::fs::path &saveGamePath) {
+    std::ifstream file;
+    if (!saveGamePath.empty() && emulator->supportsSaving()) {
+        file.open(saveGamePath, std::ios::binary | std::ios::in);
+    }
+    attachSaveGame(saveGamePath, file);
+}
+
+void Session::attachSaveGame(const FunkyBoy::fs::path &saveGamePath, std::istream &cartridgeRam) {
+    emulator->savePath = saveGamePath;
+    saveGameAttached = true;
+    LOGD("Save path: %s", saveGamePath.c_str());
+    if (!saveGamePath.empty() && emulator->supportsSaving() /*&& FunkyBoy::fs::exists(saveGamePath)*/) {
+        emulator->loadCartridgeRam(cartridgeRam);
+    }
+    batterySave.attach(*emulator, saveGamePath);
+}
+
+void Session::runFrame() {
+    while ((emulator->doTick() & FB_RET_NEW_FRAME) == 0);
+    onFrameCompleted();
+}
+
+void Session::runFrameAhead() {
+    while ((emulator->doTick() & FB_RET_NEW_FRAME) == 0);
+}
+
+uint32_t Session::runTicks(uint32_t ticks) {
+    uint32_t frames = 0;
+    for (uint32_t i = 0 ; i < ticks ; i++) {
+        if (emulator->doTick() & FB_RET_NEW_FRAME) {
+            onFrameCompleted();
+            frames++;
+        }
+    }
+    return frames;
+}
+
+void Session::onFrameCompleted() {
+    if (firstFramePending) {
+        firstFramePending = false;
+        auto latency = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - romLoadStart);
+        LOGI("First frame emulated %lld ms after loading the ROM", static_cast<long long>(latency.count()));
+#ifdef FB_DEBUG
+        arena.logUsage("session");
+#endif
+    }
+    if (saveGameAttached) {
+        batterySave.onFrame(*emulator);
+    }
+}
+
+bool Session::start(step_callback step) {
+    if (running || worker.joinable()) {
+        LOGW("Session is already running");
+        return false;
+    }
+    running = true;
+    worker = std::thread([this](step_callback callback) {
+        pthread_setname_np(pthread_self(), "FBSession");
+        while (running && callback(*this));
+        running = false;
+    }, std::move(step));
+    return true;
+}
+
+void Session::stop() {
+    running = false;
+    join();
+}
+
+void Session::join() {
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
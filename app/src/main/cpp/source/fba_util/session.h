@@ -0,0 +1,205 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FB_ANDROID_UTIL_SESSION_H
+#define FB_ANDROID_UTIL_SESSION_H
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <emulator/emulator.h>
+#include <controllers/display_hashing.h>
+#include <controllers/audio_null.h>
+#include <fba_util/battery_save.h>
+#include <util/arena.h>
+
+// Address space reserved per session, of which only the buffers actually allocated take up memory
+#define FB_ANDROID_SESSION_ARENA_SIZE (4 * 1024 * 1024)
+
+namespace FunkyBoyAndroid {
+
+    /**
+     * One emulated Game Boy, owning its emulator, its controllers and its battery save.
+     *
+     * Sessions do not share any mutable state, so several of them can run in parallel. Each session
+     * is driven by one thread at a time: either by its owner through runFrame(), or by its own
+     * worker thread between start() and stop(). At most one session is bound to the window and the
+     * audio output, all others render into headless controllers.
+     */
+    class Session {
+    public:
+        /**
+         * Called repeatedly on the worker thread, returning false ends the worker.
+         */
+        typedef std::function<bool(Session &)> step_callback;
+
+    private:
+        // Declared first, so that it outlives everything allocated from it
+        Util::Arena arena;
+
+        std::unique_ptr<FunkyBoy::Emulator> emulator;
+
+        std::shared_ptr<Controller::DisplayControllerHashing> headlessDisplay;
+        std::shared_ptr<Controller::AudioControllerNull> headlessAudio;
+        std::shared_ptr<FunkyBoy::Controller::DisplayController> display;
+        std::shared_ptr<FunkyBoy::Controller::AudioController> audio;
+        std::shared_ptr<FunkyBoy::Controller::SerialController> serial;
+
+        BatterySaveService batterySave;
+        bool saveGameAttached;
+
+        std::string romPath;
+        std::chrono::steady_clock::time_point romLoadStart;
+        bool firstFramePending;
+
+        std::thread worker;
+        std::atomic<bool> running;
+
+        void applyControllers();
+        void onFrameCompleted();
+        void onROMLoaded(FunkyBoy::CartridgeStatus status, const char *inRomPath, size_t romSize);
+
+    public:
+        explicit Session(FunkyBoy::GameBoyType type = FunkyBoy::GameBoyType::GameBoyDMG);
+        ~Session();
+
+        Session(const Session &) = delete;
+        Session &operator=(const Session &) = delete;
+
+        /**
+         * Arena for the fixed-size buffers of this session and of the outputs bound to it.
+         */
+        inline Util::Arena &getArena() {
+            return arena;
+        }
+
+        inline FunkyBoy::Emulator &getEmulator() {
+            return *emulator;
+        }
+
+        inline bool isLoaded() {
+            return emulator->getCartridgeStatus() == FunkyBoy::CartridgeStatus::Loaded;
+        }
+
+        inline const std::string &getROMPath() const {
+            return romPath;
+        }
+
+        /**
+         * Display controller receiving the frames while the session is not bound to an output.
+         */
+        inline const Controller::DisplayControllerHashing &getHeadlessDisplay() const {
+            return *headlessDisplay;
+        }
+
+        /**
+         * Routes the frames and samples of this session to the given controllers. Unbinding switches
+         * back to the headless controllers.
+         */
+        void bindOutput(std::shared_ptr<FunkyBoy::Controller::DisplayController> display, std::shared_ptr<FunkyBoy::Controller::AudioController> audio);
+        void unbindOutput();
+
+        inline bool isBound() const {
+            return display != headlessDisplay;
+        }
+
+        /**
+         * Connects the serial port of this session, nullptr disconnects it.
+         */
+        void setSerial(std::shared_ptr<FunkyBoy::Controller::SerialController> serial);
+
+        /**
+         * Marks the start of a ROM load, for loads which are prepared asynchronously before
+         * loadInflatedROM gets called.
+         */
+        void beginROMLoad();
+
+        /**
+         * Loads the given ROM, inflating it first if it is compressed. The battery save of the
+         * previous game is detached. Waits for storage, so the looper thread prepares ROMs with a
+         * ROMInflater and loads them with loadInflatedROM instead.
+         */
+        FunkyBoy::CartridgeStatus loadROM(const char *inRomPath);
+
+        /**
+         * Loads a ROM which has been inflated or read into the memory file fd, which gets closed.
+         * A negative fd yields ROMFileNotReadable and leaves the running game untouched.
+         */
+        FunkyBoy::CartridgeStatus loadInflatedROM(int fd, const char *inRomPath);
+
+        inline BatterySaveService &getBatterySave() {
+            return batterySave;
+        }
+
+        inline bool hasSaveGame() const {
+            return saveGameAttached;
+        }
+
+        /**
+         * Loads the cartridge RAM from the given path and keeps it in sync from now on.
+         */
+        void attachSaveGame(const FunkyBoy::fs::path &saveGamePath);
+
+        /**
+         * Like attachSaveGame(saveGamePath), with the cartridge RAM having been read beforehand.
+         */
+        void attachSaveGame(const FunkyBoy::fs::path &saveGamePath, std::istream &cartridgeRam);
+
+        /**
+         * Emulates until the next frame has been completed.
+         */
+        void runFrame();
+
+        /**
+         * Emulates until the next frame has been completed, without anything outside of the
+         * emulator taking note of it, as the frame is going to be rolled back.
+         */
+        void runFrameAhead();
+
+        /**
+         * Emulates the given amount of ticks.
+         * @return amount of frames completed meanwhile
+         */
+        uint32_t runTicks(uint32_t ticks);
+
+        /**
+         * Drives the session from its own worker thread, calling step until it returns false or
+         * until stop() gets called. Nothing else may access the session in the meantime.
+         */
+        bool start(step_callback step);
+
+        /**
+         * Asks the worker thread to end after the current step and waits for it.
+         */
+        void stop();
+
+        /**
+         * Waits for the worker thread to end by itself.
+         */
+        void join();
+
+        inline bool isRunning() const {
+            return running;
+        }
+    };
+
+}
+
+#endif //FB_ANDROID_UTIL_SESSION_H
@@ -0,0 +1,183 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "session_snapshot.h"
+
+#include <fba_util/logging.h>
+#include <fba_util/rom_archive.h>
+#include <fba_util/rom_library.h>
+#include <fba_util/session.h>
+#include <util/membuf.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+using namespace FunkyBoyAndroid;
+
+namespace {
+
+    /**
+     * Compares the checksums in the cartridge header of the given ROM file to the stored ones.
+     */
+    bool matchesHeader(int fd, const session_snapshot &snapshot) {
+        uint8_t checksums[FB_ANDROID_ROM_HEADER_END - FB_ANDROID_ROM_HEADER_CHECKSUM];
+        if (pread(fd, checksums, sizeof(checksums), FB_ANDROID_ROM_HEADER_CHECKSUM) != sizeof(checksums)) {
+            return false;
+        }
+        return checksums[0] == snapshot.headerChecksum
+            && checksums[1] == snapshot.globalChecksum[0]
+            && checksums[2] == snapshot.globalChecksum[1];
+    }
+
+}
+
+SessionSnapshot::SessionSnapshot(const std::string &directory)
+    : path(directory + "/" FB_ANDROID_SESSION_SNAPSHOT_FILE_NAME)
+    , snapshot(nullptr)
+{
+    map();
+}
+
+void SessionSnapshot::map() {
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        LOGW("Unable to open session snapshot %s: %s", path.c_str(), std::strerror(errno));
+        return;
+    }
+    if (ftruncate(fd, sizeof(session_snapshot)) != 0) {
+        LOGW("Unable to resize session snapshot: %s", std::strerror(errno));
+        close(fd);
+        return;
+    }
+    void *mapping = mmap(nullptr, sizeof(session_snapshot), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        LOGW("Unable to map session snapshot: %s", std::strerror(errno));
+        return;
+    }
+    snapshot = static_cast<session_snapshot *>(mapping);
+    if (snapshot->magic != FB_ANDROID_SESSION_SNAPSHOT_MAGIC || snapshot->version != FB_ANDROID_SESSION_SNAPSHOT_VERSION) {
+        // Either a new file (filled with zeros) or an incompatible layout
+        snapshot->valid = 0;
+        snapshot->magic = FB_ANDROID_SESSION_SNAPSHOT_MAGIC;
+        snapshot->version = FB_ANDROID_SESSION_SNAPSHOT_VERSION;
+    }
+}
+
+SessionSnapshot::~SessionSnapshot() {
+    if (snapshot != nullptr) {
+        munmap(snapshot, sizeof(session_snapshot));
+    }
+}
+
+void SessionSnapshot::discard() {
+    if (snapshot == nullptr) {
+        return;
+    }
+    snapshot->valid = 0;
+    munmap(snapshot, sizeof(session_snapshot));
+    snapshot = nullptr;
+    if (unlink(path.c_str()) != 0) {
+        LOGW("Unable to delete session snapshot: %s", std::strerror(errno));
+    }
+    // Start over with an empty file, so that the current session can still be stored
+    map();
+}
+
+void SessionSnapshot::store(FunkyBoy::Emulator &emulator, const std::string &romPath, const uint32_t *frame) {
+    if (snapshot == nullptr || emulator.getCartridgeStatus() != FunkyBoy::CartridgeStatus::Loaded) {
+        return;
+    }
+    if (romPath.size() >= FB_ANDROID_APP_STATE_ROM_PATH_BUFFER_SIZE) {
+        LOGW("ROM path size is too large, session snapshot cannot be stored");
+        return;
+    }
+
+    // Invalidate first, so that a process death in the middle of the store is detected on next launch
+    snapshot->valid = 0;
+    std::atomic_thread_fence(std::memory_order_release);
+
+    std::strcpy(snapshot->romPath, romPath.c_str());
+    auto header = emulator.getROMHeader();
+    snapshot->globalChecksum[0] = header->globalChecksum[0];
+    snapshot->globalChecksum[1] = header->globalChecksum[1];
+    snapshot->headerChecksum = header->headerChecksum;
+
+    FunkyBoy::Util::membuf membuf(snapshot->state, FB_SAVE_STATE_MAX_BUFFER_SIZE, false);
+    std::ostream ostream(&membuf);
+    emulator.saveState(ostream);
+
+    std::memcpy(snapshot->frame, frame, sizeof(snapshot->frame));
+
+    std::atomic_thread_fence(std::memory_order_release);
+    snapshot->valid = 1;
+
+    // Ask the kernel to start writing back, without waiting for it
+    msync(snapshot, sizeof(session_snapshot), MS_ASYNC);
+    LOGD("Session snapshot stored");
+}
+
+bool SessionSnapshot::restoreROM(Session &session) {
+    if (!isValid()) {
+        return false;
+    }
+    // The ROM is verified before loading it, as a loaded ROM cannot be unloaded anymore
+    const char *romPath = snapshot->romPath;
+    bool compressed = ROMArchive::isCompressed(romPath);
+    int fd;
+    if (compressed) {
+        size_t romSize;
+        session.beginROMLoad();
+        fd = ROMArchive::inflateToMemoryFile(romPath, romSize);
+    } else {
+        fd = open(romPath, O_RDONLY | O_CLOEXEC);
+    }
+    if (fd < 0 || !matchesHeader(fd, *snapshot)) {
+        LOGW("ROM of last session is missing or has changed, discarding the session snapshot");
+        if (fd >= 0) {
+            close(fd);
+        }
+        discard();
+        return false;
+    }
+    FunkyBoy::CartridgeStatus status;
+    if (compressed) {
+        status = session.loadInflatedROM(fd, romPath);
+    } else {
+        close(fd);
+        status = session.loadROM(romPath);
+    }
+    if (status != FunkyBoy::CartridgeStatus::Loaded) {
+        LOGW("ROM of last session could not be loaded, discarding the session snapshot");
+        discard();
+        return false;
+    }
+    return true;
+}
+
+void SessionSnapshot::restoreState(FunkyBoy::Emulator &emulator) {
+    auto start = std::chrono::steady_clock::now();
+    FunkyBoy::Util::membuf membuf(snapshot->state, FB_SAVE_STATE_MAX_BUFFER_SIZE, true);
+    std::istream istream(&membuf);
+    emulator.loadState(istream);
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    LOGD("Resumed emulation from session snapshot in %lld us", static_cast<long long>(elapsed.count()));
+}
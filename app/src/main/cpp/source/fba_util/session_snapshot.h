@@ -0,0 +1,97 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FB_ANDROID_UTIL_SESSION_SNAPSHOT_H
+#define FB_ANDROID_UTIL_SESSION_SNAPSHOT_H
+
+#include <string>
+#include <util/typedefs.h>
+#include <emulator/emulator.h>
+#include <fba_util/app_state.h>
+
+#define FB_ANDROID_SESSION_SNAPSHOT_MAGIC 0x53424246 // "FBBS"
+#define FB_ANDROID_SESSION_SNAPSHOT_VERSION 1
+#define FB_ANDROID_SESSION_SNAPSHOT_FILE_NAME "last_session.bin"
+
+namespace FunkyBoyAndroid {
+
+    typedef struct {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t valid;
+        uint8_t globalChecksum[2];
+        uint8_t headerChecksum;
+        char romPath[FB_ANDROID_APP_STATE_ROM_PATH_BUFFER_SIZE];
+        char state[FB_SAVE_STATE_MAX_BUFFER_SIZE];
+        uint32_t frame[FB_GB_DISPLAY_WIDTH * FB_GB_DISPLAY_HEIGHT];
+    } session_snapshot;
+
+    class Session;
+
+    /**
+     * Memory-mapped snapshot of the last session, stored in the app's internal data directory.
+     *
+     * As the file is mapped shared, stores only touch the page cache and survive the process being
+     * killed. On cold start, the stored frame can be presented immediately while the ROM gets loaded
+     * and the emulation state gets restored in the background.
+     */
+    class SessionSnapshot {
+    private:
+        std::string path;
+        session_snapshot *snapshot;
+
+        void map();
+
+        /**
+         * Invalidates and deletes the snapshot file, replacing it with an empty one.
+         */
+        void discard();
+
+    public:
+        explicit SessionSnapshot(const std::string &directory);
+        ~SessionSnapshot();
+
+        inline bool isValid() const {
+            return snapshot != nullptr && snapshot->valid != 0;
+        }
+
+        inline const uint32_t *getFrame() const {
+            return snapshot->frame;
+        }
+
+        /**
+         * Stores the current session. Does nothing if no ROM is loaded.
+         */
+        void store(FunkyBoy::Emulator &emulator, const std::string &romPath, const uint32_t *frame);
+
+        /**
+         * Loads the ROM of the stored session into the given session, after verifying that it is
+         * unchanged since the snapshot was stored. Otherwise, nothing is loaded and the snapshot
+         * gets discarded, so that the app starts without resuming.
+         *
+         * @return true if the ROM has been loaded, so that restoreState() may be called
+         */
+        bool restoreROM(Session &session);
+
+        /**
+         * Loads the stored emulation state, after restoreROM() has succeeded.
+         */
+        void restoreState(FunkyBoy::Emulator &emulator);
+    };
+
+}
+
+#endif //FB_ANDROID_UTIL_SESSION_SNAPSHOT_H
@@ -0,0 +1,40 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FB_ANDROID_KERNELS_KERNEL_VARIANTS_H
+#define FB_ANDROID_KERNELS_KERNEL_VARIANTS_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Instruction set specific kernels, only to be called through the dispatch in kernels.cpp
+
+namespace FunkyBoyAndroid::Kernels {
+
+    void paletteLineScalar(const uint8_t *indices, const uint32_t *palette, uint32_t *out, size_t count);
+
+#if defined(__aarch64__) || defined(__arm__)
+    void paletteLineNEON(const uint8_t *indices, const uint32_t *palette, uint32_t *out, size_t count);
+#endif
+
+#if defined(__i386__) || defined(__x86_64__)
+    void paletteLineSSSE3(const uint8_t *indices, const uint32_t *palette, uint32_t *out, size_t count);
+    void paletteLineAVX2(const uint8_t *indices, const uint32_t *palette, uint32_t *out, size_t count);
+#endif
+
+}
+
+#endif //FB_ANDROID_KERNELS_KERNEL_VARIANTS_H
@@ -0,0 +1,131 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kernels.h"
+#include "kernel_variants.h"
+
+#include <fba_util/logging.h>
+#include <util/cpu_features.h>
+#include <cstring>
+#include <memory>
+
+using namespace FunkyBoyAndroid::Kernels;
+
+namespace {
+
+    // Ordered from the most to the least preferred set
+    const kernel_set kernelSets[] = {
+#if defined(__i386__) || defined(__x86_64__)
+            {"avx2", FB_ANDROID_CPU_AVX2, paletteLineAVX2},
+            {"ssse3", FB_ANDROID_CPU_SSSE3, paletteLineSSSE3},
+#endif
+#if defined(__aarch64__) || defined(__arm__)
+            {"neon", FB_ANDROID_CPU_NEON, paletteLineNEON},
+#endif
+            {"scalar", 0, paletteLineScalar},
+    };
+
+    // Covers the vectorized loops as well as their scalar tails
+    const size_t selfCheckLengths[] = {0, 1, 3, 7, 8, 15, 16, 17, 31, 32, 33, 63, 160, 173};
+
+    bool isSupported(const kernel_set &set) {
+        return (FunkyBoyAndroid::Util::getCpuFeatures() & set.requiredFeatures) == set.requiredFeatures;
+    }
+
+    void bindKernelSet(const kernel_set &set) {
+        paletteLine = set.paletteLine;
+    }
+
+}
+
+palette_line_fn FunkyBoyAndroid::Kernels::paletteLine = paletteLineScalar;
+
+void FunkyBoyAndroid::Kernels::paletteLineScalar(const uint8_t *indices, const uint32_t *palette, uint32_t *out, size_t count) {
+    for (size_t i = 0 ; i < count ; i++) {
+        out[i] = palette[indices[i] & 3];
+    }
+}
+
+bool FunkyBoyAndroid::Kernels::selfCheck(const kernel_set &set) {
+    const size_t maxLength = 173;
+    std::unique_ptr<uint8_t[]> indices(new uint8_t[maxLength + 1]);
+    std::unique_ptr<uint32_t[]> expected(new uint32_t[maxLength + 1]);
+    std::unique_ptr<uint32_t[]> actual(new uint32_t[maxLength + 1]);
+    uint32_t palette[4];
+
+    // Deterministic pseudo random input, using all byte values to check that indices get masked
+    uint32_t seed = 0x2545F491u;
+    auto next = [&seed]() {
+        seed = seed * 1664525u + 1013904223u;
+        return seed >> 8u;
+    };
+    for (uint32_t &color : palette) {
+        color = next();
+    }
+
+    for (size_t length : selfCheckLengths) {
+        // Start at an odd address to check unaligned loads and stores
+        for (size_t offset = 0 ; offset <= 1 ; offset++) {
+            if (length + offset > maxLength + 1) {
+                continue;
+            }
+            for (size_t i = 0 ; i < length + offset ; i++) {
+                indices[i] = static_cast<uint8_t>(next());
+            }
+            std::memset(expected.get(), 0xAB, (maxLength + 1) * sizeof(uint32_t));
+            std::memset(actual.get(), 0xAB, (maxLength + 1) * sizeof(uint32_t));
+            paletteLineScalar(indices.get() + offset, palette, expected.get() + offset, length);
+            set.paletteLine(indices.get() + offset, palette, actual.get() + offset, length);
+            // Also compares the guard values behind the output, which must not be overwritten
+            if (std::memcmp(expected.get(), actual.get(), (maxLength + 1) * sizeof(uint32_t)) != 0) {
+                LOGE("Kernel set %s: paletteLine differs from the scalar reference for %zu pixels", set.name, length);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+const char *FunkyBoyAndroid::Kernels::bindKernels(const char *forced) {
+    if (forced != nullptr && *forced != 0) {
+        for (const kernel_set &set : kernelSets) {
+            if (std::strcmp(set.name, forced) != 0) {
+                continue;
+            }
+            if (!isSupported(set)) {
+                break;
+            }
+            // Forced sets are bound even if they fail the self-check, which will be logged
+            selfCheck(set);
+            bindKernelSet(set);
+            LOGI("Using forced kernel set %s", set.name);
+            return set.name;
+        }
+        if (std::strcmp(forced, "auto") != 0) {
+            LOGW("Ignoring unknown or unsupported kernel set %s", forced);
+        }
+    }
+    for (const kernel_set &set : kernelSets) {
+        if (isSupported(set) && selfCheck(set)) {
+            bindKernelSet(set);
+            LOGI("Using kernel set %s (CPU features 0x%x)", set.name, FunkyBoyAndroid::Util::getCpuFeatures());
+            return set.name;
+        }
+    }
+    // The scalar reference always passes its own self-check, so this should never be reached
+    bindKernelSet(kernelSets[sizeof(kernelSets) / sizeof(kernelSets[0]) - 1]);
+    return "scalar";
+}
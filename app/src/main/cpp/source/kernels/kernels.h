@@ -0,0 +1,60 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FB_ANDROID_KERNELS_KERNELS_H
+#define FB_ANDROID_KERNELS_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace FunkyBoyAndroid::Kernels {
+
+    /**
+     * Converts count 2 bit palette indices into pixels. Only the lower 2 bits of each index are
+     * used.
+     */
+    typedef void (*palette_line_fn)(const uint8_t *indices, const uint32_t *palette, uint32_t *out, size_t count);
+
+    /**
+     * Implementations of the hot kernels for one instruction set
+     */
+    struct kernel_set {
+        const char *name;
+        // FB_ANDROID_CPU_* features needed to run this set
+        uint32_t requiredFeatures;
+        palette_line_fn paletteLine;
+    };
+
+    /**
+     * Kernels bound to the fastest set supported by the CPU, scalar until bindKernels is called.
+     */
+    extern palette_line_fn paletteLine;
+
+    /**
+     * Binds the fastest kernel set that is supported by the CPU and passes the self-check. A set
+     * can be forced by name for testing ("scalar", "neon", "ssse3" or "avx2"), which is ignored if
+     * the CPU does not support it. Returns the name of the bound set.
+     */
+    const char *bindKernels(const char *forced = nullptr);
+
+    /**
+     * Compares the output of the given set against the scalar reference for a range of inputs.
+     */
+    bool selfCheck(const kernel_set &set);
+
+}
+
+#endif //FB_ANDROID_KERNELS_KERNELS_H
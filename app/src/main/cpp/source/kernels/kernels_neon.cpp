@@ -0,0 +1,64 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#if defined(__aarch64__) || defined(__arm__)
+
+// On ARMv7, this file is compiled with -mfpu=neon. It must not include headers with inline
+// functions that are also used elsewhere, as the linker could otherwise pick a NEON copy of them
+// for the whole library.
+#include "kernel_variants.h"
+
+#include <arm_neon.h>
+
+namespace {
+
+    inline uint8x16_t lookupBytes(uint8x16_t table, uint8x16_t offsets) {
+#if defined(__aarch64__)
+        return vqtbl1q_u8(table, offsets);
+#else
+        uint8x8x2_t halves = {{vget_low_u8(table), vget_high_u8(table)}};
+        return vcombine_u8(vtbl2_u8(halves, vget_low_u8(offsets)), vtbl2_u8(halves, vget_high_u8(offsets)));
+#endif
+    }
+
+}
+
+void FunkyBoyAndroid::Kernels::paletteLineNEON(const uint8_t *indices, const uint32_t *palette, uint32_t *out, size_t count) {
+    // The 4 colors fit into one register and get looked up byte wise
+    const uint8x16_t table = vld1q_u8(reinterpret_cast<const uint8_t *>(palette));
+    const uint8x16_t mask = vdupq_n_u8(3);
+    static const uint8_t colorByteValues[16] = {0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3};
+    const uint8x16_t colorBytes = vld1q_u8(colorByteValues);
+    size_t i = 0;
+    for ( ; i + 16 <= count ; i += 16) {
+        // Byte offset of the color in the table
+        uint8x16_t offsets = vshlq_n_u8(vandq_u8(vld1q_u8(indices + i), mask), 2);
+        // Repeat each offset 4 times, once per color byte
+        uint8x16x2_t pairs = vzipq_u8(offsets, offsets);
+        uint8x16x2_t low = vzipq_u8(pairs.val[0], pairs.val[0]);
+        uint8x16x2_t high = vzipq_u8(pairs.val[1], pairs.val[1]);
+        auto *dst = reinterpret_cast<uint8_t *>(out + i);
+        vst1q_u8(dst, lookupBytes(table, vaddq_u8(low.val[0], colorBytes)));
+        vst1q_u8(dst + 16, lookupBytes(table, vaddq_u8(low.val[1], colorBytes)));
+        vst1q_u8(dst + 32, lookupBytes(table, vaddq_u8(high.val[0], colorBytes)));
+        vst1q_u8(dst + 48, lookupBytes(table, vaddq_u8(high.val[1], colorBytes)));
+    }
+    for ( ; i < count ; i++) {
+        out[i] = palette[indices[i] & 3];
+    }
+}
+
+#endif
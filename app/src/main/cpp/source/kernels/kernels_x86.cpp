@@ -0,0 +1,71 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#if defined(__i386__) || defined(__x86_64__)
+
+#include "kernel_variants.h"
+
+#include <immintrin.h>
+
+// Each kernel enables its instruction set through a target attribute, so that the rest of the
+// library keeps running on CPUs without it
+
+__attribute__((target("ssse3")))
+void FunkyBoyAndroid::Kernels::paletteLineSSSE3(const uint8_t *indices, const uint32_t *palette, uint32_t *out, size_t count) {
+    // The 4 colors fit into one register and get looked up byte wise with pshufb
+    const __m128i table = _mm_loadu_si128(reinterpret_cast<const __m128i *>(palette));
+    const __m128i mask = _mm_set1_epi8(3);
+    const __m128i colorBytes = _mm_setr_epi8(0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3);
+    const __m128i spread[4] = {
+            _mm_setr_epi8(0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3),
+            _mm_setr_epi8(4, 4, 4, 4, 5, 5, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7),
+            _mm_setr_epi8(8, 8, 8, 8, 9, 9, 9, 9, 10, 10, 10, 10, 11, 11, 11, 11),
+            _mm_setr_epi8(12, 12, 12, 12, 13, 13, 13, 13, 14, 14, 14, 14, 15, 15, 15, 15),
+    };
+    size_t i = 0;
+    for ( ; i + 16 <= count ; i += 16) {
+        __m128i offsets = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(indices + i)), mask);
+        // Byte offset of the color in the table, the indices are small enough to not carry over
+        offsets = _mm_slli_epi16(offsets, 2);
+        for (int j = 0 ; j < 4 ; j++) {
+            __m128i lookup = _mm_add_epi8(_mm_shuffle_epi8(offsets, spread[j]), colorBytes);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i + (j * 4)), _mm_shuffle_epi8(table, lookup));
+        }
+    }
+    for ( ; i < count ; i++) {
+        out[i] = palette[indices[i] & 3];
+    }
+}
+
+__attribute__((target("avx2")))
+void FunkyBoyAndroid::Kernels::paletteLineAVX2(const uint8_t *indices, const uint32_t *palette, uint32_t *out, size_t count) {
+    // vpermd looks up 8 colors at once, only the lower half of the table is ever addressed
+    const __m256i table = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(palette)));
+    const __m256i mask = _mm256_set1_epi32(3);
+    size_t i = 0;
+    for ( ; i + 16 <= count ; i += 16) {
+        __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i *>(indices + i));
+        __m256i low = _mm256_and_si256(_mm256_cvtepu8_epi32(packed), mask);
+        __m256i high = _mm256_and_si256(_mm256_cvtepu8_epi32(_mm_srli_si128(packed, 8)), mask);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), _mm256_permutevar8x32_epi32(table, low));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i + 8), _mm256_permutevar8x32_epi32(table, high));
+    }
+    for ( ; i < count ; i++) {
+        out[i] = palette[indices[i] & 3];
+    }
+}
+
+#endif
@@ -29,8 +29,10 @@
 #include <algorithm>
 #include <ctime>
 #include <fstream>
+#include <thread>
 
 #include <android_native_app_glue.h>
+#include <sys/system_properties.h>
 
 #include <emulator/emulator.h>
 #include <unistd.h>
@@ -38,40 +40,60 @@
 #include <controllers/audio_android.h>
 #include <fba_util/logging.h>
 #include <fba_util/app_state.h>
+#include <fba_util/cold_start.h>
 #include <fba_util/emulator_state.h>
-#include <fba_util/shared.h>
+#include <fba_util/run_ahead.h>
+#include <fba_util/session.h>
+#include <fba_util/session_snapshot.h>
+#include <fba_util/rom_inflater.h>
+#include <fba_util/movie.h>
+#include <capture/recorder.h>
+#include <engine/choreographer_vsync.h>
 #include <engine/engine.h>
+#include <engine/frame_pacer.h>
 #include <engine/init_display.h>
+#include <engine/hit_map.h>
+#include <engine/input_map.h>
+#include <engine/input_latency.h>
+#include <kernels/kernels.h>
 #include <ui/draw_controls.h>
 #include <ui/draw_text.h>
 #include <util/frame_executor.h>
 #include <util/membuf.h>
 #include <fb_app_strings.h>
+#include <fb_app_textures.h>
+#include <fb_jni_bindings.h>
 
 #include "fb_jni.h"
 
-#define FBA_KEY_A 0b00000001
-#define FBA_KEY_B 0b00000010
-#define FBA_KEY_START 0b00000100
-#define FBA_KEY_SELECT 0b00001000
-#define FBA_KEY_LEFT 0b00010000
-#define FBA_KEY_UP 0b00100000
-#define FBA_KEY_RIGHT 0b01000000
-#define FBA_KEY_DOWN 0b10000000
-
 using namespace FunkyBoyAndroid;
 
-int fbMsgPipe[2];
-struct timeval tp;
-
-namespace FunkyBoyAndroid::State {
-    std::unique_ptr<FunkyBoy::Emulator> emulator;
-    std::shared_ptr<FunkyBoy::Controller::DisplayController> emuDisplayController;
-    std::shared_ptr<FunkyBoy::Controller::AudioController> emuAudioController;
-
-    bool initialSaveLoaded = false;
-    std::string romPath;
-}
+#ifdef FB_ANDROID_PGO_GENERATE
+// Provided by the profiling runtime of instrumented builds
+extern "C" int __llvm_profile_write_file(void);
+#endif
+
+FunkyBoyAndroid::CommandChannel fbCommandChannel;
+
+static std::unique_ptr<FunkyBoyAndroid::ROMInflater> romInflater;
+static std::unique_ptr<FunkyBoyAndroid::MovieRecorder> movieRecorder;
+static std::unique_ptr<FunkyBoyAndroid::MoviePlayer> moviePlayer;
+#ifdef FB_ANDROID_BENCHMARK
+static std::thread movieVerifier;
+#endif
+static FunkyBoyAndroid::Engine::InputLatency inputLatency;
+static FunkyBoyAndroid::Engine::ChoreographerVsync choreographer;
+static FunkyBoyAndroid::Engine::FramePacer framePacer;
+
+// The session bound to the window and the audio output
+static std::unique_ptr<FunkyBoyAndroid::Session> session;
+static std::shared_ptr<FunkyBoyAndroid::Controller::DisplayControllerAndroid> displayController;
+static std::shared_ptr<FunkyBoyAndroid::Controller::AudioControllerAndroid> audioController;
+static std::unique_ptr<FunkyBoyAndroid::SessionSnapshot> sessionSnapshot;
+static std::unique_ptr<FunkyBoyAndroid::ColdStart> coldStart;
+// Created on first use, as its buffers stay allocated in the arena of the session
+static std::unique_ptr<FunkyBoyAndroid::Capture::Recorder> recorder;
+static std::unique_ptr<FunkyBoyAndroid::RunAhead> runAhead;
 
 struct {
     std::string noRomLoaded;
@@ -87,38 +109,135 @@ struct {
 
 namespace FunkyBoyAndroid {
 
-    void reloadStrings(JNIEnv *env, ANativeActivity *nativeActivity) {
-        fb_strings.noRomLoaded = FunkyBoyAndroid::R::getString(env, nativeActivity, FunkyBoyAndroid::R::String::no_rom_loaded);
-        fb_strings.romNotReadable = FunkyBoyAndroid::R::getString(env, nativeActivity, FunkyBoyAndroid::R::String::rom_not_readable);
-        fb_strings.romNotParsable = FunkyBoyAndroid::R::getString(env, nativeActivity, FunkyBoyAndroid::R::String::rom_not_parsable);
-        fb_strings.romTooBig = FunkyBoyAndroid::R::getString(env, nativeActivity, FunkyBoyAndroid::R::String::rom_too_big);
-        fb_strings.romSizeMismatch = FunkyBoyAndroid::R::getString(env, nativeActivity, FunkyBoyAndroid::R::String::rom_size_mismatch);
-        fb_strings.unsupportedMBC = FunkyBoyAndroid::R::getString(env, nativeActivity, FunkyBoyAndroid::R::String::unsupported_mbc);
-        fb_strings.unsupportedRAMSize = FunkyBoyAndroid::R::getString(env, nativeActivity, FunkyBoyAndroid::R::String::unsupported_ram_size);
-        fb_strings.unknownStatus = FunkyBoyAndroid::R::getString(env, nativeActivity, FunkyBoyAndroid::R::String::unknown_status);
-        fb_strings.pressStart = FunkyBoyAndroid::R::getString(env, nativeActivity, FunkyBoyAndroid::R::String::press_start);
+    void reloadStrings(JNIEnv *env, AConfiguration *config) {
+        // The default strings are compiled in, only languages overriding them need JNI round trips
+        bool overridden = FunkyBoyAndroid::R::hasOverrides(config);
+        auto getString = [env, overridden](FunkyBoyAndroid::R::String strId) {
+            return overridden ? FunkyBoyAndroid::R::getString(env, strId) : std::string(FunkyBoyAndroid::R::getDefaultString(strId));
+        };
+        fb_strings.noRomLoaded = getString(FunkyBoyAndroid::R::String::no_rom_loaded);
+        fb_strings.romNotReadable = getString(FunkyBoyAndroid::R::String::rom_not_readable);
+        fb_strings.romNotParsable = getString(FunkyBoyAndroid::R::String::rom_not_parsable);
+        fb_strings.romTooBig = getString(FunkyBoyAndroid::R::String::rom_too_big);
+        fb_strings.romSizeMismatch = getString(FunkyBoyAndroid::R::String::rom_size_mismatch);
+        fb_strings.unsupportedMBC = getString(FunkyBoyAndroid::R::String::unsupported_mbc);
+        fb_strings.unsupportedRAMSize = getString(FunkyBoyAndroid::R::String::unsupported_ram_size);
+        fb_strings.unknownStatus = getString(FunkyBoyAndroid::R::String::unknown_status);
+        fb_strings.pressStart = getString(FunkyBoyAndroid::R::String::press_start);
+    }
+
+    static void storeSession() {
+        sessionSnapshot->store(session->getEmulator(), session->getROMPath(), displayController->getPixels());
+    }
+
+    static void stopMovie(struct engine *engine) {
+        if (movieRecorder != nullptr) {
+            movieRecorder->finish();
+            movieRecorder.reset();
+        }
+        if (moviePlayer != nullptr) {
+            moviePlayer->logResult();
+            moviePlayer.reset();
+            // Hand control back to the touch input
+            applyJoypadState(session->getEmulator(), engine->keyLatch);
+        }
+        displayController->setFrameHashing(false);
     }
 
 }
 
+// The "press start" text blinks with this period
+#define FB_ANDROID_BLINK_PERIOD_MS 1000
+
+static int64_t uptimeMillis() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool isEmulating() {
+    return coldStart->isSessionPending()
+        || session->isLoaded();
+}
+
+/**
+ * @return how long the looper may sleep before the next frame has to be drawn, -1 meaning until an event arrives
+ */
+static int frameTimeout(const struct engine *engine) {
+    if (!engine->animating || engine->paused) {
+        return -1;
+    }
+    if (isEmulating() && choreographer.isAvailable()) {
+        // Frames are emulated from the vsync callback, which wakes up the looper by itself
+        return choreographer.isPending() ? -1 : 0;
+    }
+    if (engine->statusScreenDirty || isEmulating()) {
+        return 0;
+    }
+    // The status screen only changes by itself when the blink phase toggles
+    return FB_ANDROID_BLINK_PERIOD_MS - static_cast<int>(uptimeMillis() % FB_ANDROID_BLINK_PERIOD_MS);
+}
+
 /**
  * Just the current frame in the display.
+ *
+ * @param frames amount of frames to emulate at normal speed, of which the last one gets presented
  */
-static void engine_draw_frame(struct engine* engine) {
+static void engine_draw_frame(struct engine* engine, uint32_t frames = 1) {
     ANativeWindow *window = engine->app->window;
-    auto controller = dynamic_cast<FunkyBoyAndroid::Controller::DisplayControllerAndroid *>(FunkyBoyAndroid::State::emuDisplayController.get());
+    auto controller = displayController.get();
 
-    if (FunkyBoyAndroid::State::emulator->getCartridgeStatus() == FunkyBoy::CartridgeStatus::Loaded) {
-        if (!FunkyBoyAndroid::State::initialSaveLoaded) {
-            loadSaveGame(engine);
-        }
+    if (coldStart->isSessionPending()) {
+        // Keep presenting the last frame of the previous session until it has been restored
         controller->setWindow(window);
-        FunkyBoy::ret_code retCode;
-        do {
-            retCode = FunkyBoyAndroid::State::emulator->doTick();
-        } while ((retCode & FB_RET_NEW_FRAME) == 0);
+        controller->drawScreen();
+        controller->setWindow(nullptr);
+        return;
+    }
+
+    if (session->isLoaded()) {
+        if (!session->hasSaveGame()) {
+            loadSaveGame(engine, *session);
+        }
+        // Emulation speeds other than 1 are realized by emulating more or less frames per display frame
+        engine->frameBudget += engine->emulationSpeed * static_cast<float>(frames);
+        if (engine->frameBudget >= 1.0f) {
+            inputLatency.onFrameStart();
+        }
+        while (engine->frameBudget >= 1.0f) {
+            engine->frameBudget -= 1.0f;
+            uint8_t keys = engine->keyLatch;
+            if (moviePlayer != nullptr) {
+                if (moviePlayer->nextFrame(keys)) {
+                    FunkyBoyAndroid::applyJoypadState(session->getEmulator(), keys);
+                } else {
+                    FunkyBoyAndroid::stopMovie(engine);
+                }
+            }
+            // Only the last emulated frame gets presented
+            bool present = engine->frameBudget < 1.0f;
+            if (present && runAhead != nullptr && runAhead->getFrames() > 0) {
+                runAhead->runFrame(*session, *controller, *audioController, window);
+            } else {
+                controller->setWindow(present ? window : nullptr);
+                session->runFrame();
+            }
+            if (movieRecorder != nullptr) {
+                movieRecorder->recordFrame(keys, controller->getFrameHash());
+            } else if (moviePlayer != nullptr) {
+                moviePlayer->verifyFrame(controller->getFrameHash());
+            }
+            if (engine->frameBudget < 1.0f) {
+                coldStart->onFramePresented(engine, true);
+            }
+        }
         controller->setWindow(nullptr);
     } else {
+        auto status = session->getEmulator().getCartridgeStatus();
+        bool blink = (uptimeMillis() / FB_ANDROID_BLINK_PERIOD_MS) % 2 == 1;
+        if (!engine->statusScreenDirty && engine->statusScreenStatus == status && engine->statusScreenBlink == blink) {
+            // Nothing has changed since the last time the status screen has been presented
+            return;
+        }
+
         ANativeWindow_acquire(window);
         ANativeWindow_Buffer buffer;
         if (ANativeWindow_lock(window, &buffer, nullptr) < 0) {
@@ -133,7 +252,7 @@ static void engine_draw_frame(struct engine* engine) {
         const char *text;
 
         // Draw ROM status
-        switch (FunkyBoyAndroid::State::emulator->getCartridgeStatus()) {
+        switch (status) {
             case FunkyBoy::NoROMLoaded:
                 text = fb_strings.noRomLoaded.c_str();
                 break;
@@ -163,14 +282,13 @@ static void engine_draw_frame(struct engine* engine) {
                 break;
         }
         size_t text_width = measureTextWidth(text, 0);
-        drawTextAt(engine->env, buffer, engine->bitmapFontsUppercase, text, 0, (FB_GB_DISPLAY_WIDTH - text_width) / 2, 32);
+        drawTextAt(buffer, R::Drawable::fontUppercase, text, 0, (FB_GB_DISPLAY_WIDTH - text_width) / 2, 32);
 
         // Draw headline
-        gettimeofday(&tp, nullptr);
-        if (tp.tv_sec % 2 == 1) {
+        if (blink) {
             text = fb_strings.pressStart.c_str();
             text_width = measureTextWidth(text, 0);
-            drawTextAt(engine->env, buffer, engine->bitmapFontsUppercase, text, 0, (FB_GB_DISPLAY_WIDTH - text_width) / 2, 110);
+            drawTextAt(buffer, R::Drawable::fontUppercase, text, 0, (FB_GB_DISPLAY_WIDTH - text_width) / 2, 110);
         }
 
         // Draw controls
@@ -178,134 +296,167 @@ static void engine_draw_frame(struct engine* engine) {
 
         if (ANativeWindow_unlockAndPost(window) < 0) {
             LOGW("Unable to unlock and post to native window");
+        } else {
+            engine->statusScreenDirty = false;
+            engine->statusScreenStatus = status;
+            engine->statusScreenBlink = blink;
+            coldStart->onFramePresented(engine, false);
         }
         ANativeWindow_release(window);
     }
 }
 
+/**
+ * Emulates the frames which the frame pacer considers due at this vsync.
+ */
+static void onVsync(int64_t vsyncNs, void *data) {
+    auto engine = static_cast<struct engine*>(data);
+    if (!engine->animating || engine->paused || !isEmulating()) {
+        // Pacing starts over once the emulation continues
+        framePacer.reset();
+        return;
+    }
+    uint32_t frames = framePacer.onVsync(vsyncNs);
+    if (framePacer.getSpeed() != engine->pacingSpeed) {
+        engine->pacingSpeed = framePacer.getSpeed();
+        audioController->setResampleRatio(static_cast<float>(1.0 / engine->pacingSpeed));
+    }
+    if (frames > 0) {
+        engine_draw_frame(engine, frames);
+    }
+    choreographer.request(onVsync, engine);
+}
+
 /**
  * Tear down the EGL context currently associated with the display.
  */
 static void engine_term_display(struct engine* engine) {
     LOGD("engine_term_display");
-    if (engine->bitmapButtons != nullptr) {
-        engine->env->DeleteGlobalRef(engine->bitmapButtons);
-        engine->bitmapButtons = nullptr;
-    }
-    if (engine->bitmapFontsUppercase != nullptr) {
-        engine->env->DeleteGlobalRef(engine->bitmapFontsUppercase);
-        engine->bitmapFontsUppercase = nullptr;
-    }
+    Engine::freeHitMap(engine);
     engine->animating = false;
 }
 
-static bool isTouched(const ui_obj &obj, float scaledX, float scaledY) {
-    return scaledX >= obj.x && scaledX < obj.x + obj.width
-        && scaledY >= obj.y && scaledY < obj.y + obj.height;
+static void clearInputs(struct engine *engine) {
+    engine->activePointers = 0;
+    engine->touchKeys = 0;
+    engine->padKeys = 0;
+    engine->axisKeys = 0;
 }
 
-static void handleInputPointer(int index, AInputEvent* event, struct engine *engine, int &latch) {
-    float scaledX = AMotionEvent_getX(event, index) * engine->uiScale;
-    float scaledY = AMotionEvent_getY(event, index) * engine->uiScale;
-    bool touched = isTouched(engine->keyA, scaledX, scaledY);
-    if (touched) {
-        latch |= FBA_KEY_A;
+static inline void updatePointer(struct engine *engine, const AInputEvent* event, size_t index) {
+    uint32_t id = AMotionEvent_getPointerId(event, index);
+    if (id < FB_ANDROID_MAX_POINTERS) {
+        engine->pointerKeys[id] = Engine::hitTest(engine, AMotionEvent_getX(event, index) * engine->uiScale, AMotionEvent_getY(event, index) * engine->uiScale);
     }
-    touched = isTouched(engine->keyB, scaledX, scaledY);
-    if (touched) {
-        latch |= FBA_KEY_B;
-    }
-    touched = isTouched(engine->keyLeft, scaledX, scaledY);
-    if (touched) {
-        latch |= FBA_KEY_LEFT;
+}
+
+/**
+ * Combines the keys of all input sources and applies them to the emulator right away.
+ */
+static void updateKeyLatch(struct engine *engine, FunkyBoyAndroid::Engine::InputSource source, int64_t eventTime) {
+    int keyLatch = engine->touchKeys | engine->padKeys | engine->axisKeys;
+    if (keyLatch == engine->keyLatch) {
+        return;
     }
-    touched = isTouched(engine->keyUp, scaledX, scaledY);
-    if (touched) {
-        latch |= FBA_KEY_UP;
+    engine->keyLatch = keyLatch;
+    // While a movie is being replayed, the joypad state is driven by the movie
+    if (moviePlayer == nullptr) {
+        FunkyBoyAndroid::applyJoypadState(session->getEmulator(), keyLatch);
     }
-    touched = isTouched(engine->keyRight, scaledX, scaledY);
-    if (touched) {
-        latch |= FBA_KEY_RIGHT;
+    inputLatency.onApplied(source, eventTime);
+}
+
+static int32_t handleKeyEvent(struct engine *engine, const AInputEvent *event) {
+    uint8_t keys = Engine::lookupKey(engine, AKeyEvent_getKeyCode(event));
+    if (keys == 0) {
+        // Leave unmapped keys like BACK to the system
+        return 0;
     }
-    touched = isTouched(engine->keyDown, scaledX, scaledY);
-    if (touched) {
-        latch |= FBA_KEY_DOWN;
+    if (coldStart->isSessionPending()) {
+        return 1;
     }
-    touched = isTouched(engine->keyStart, scaledX, scaledY);
-    if (touched) {
-        latch |= FBA_KEY_START;
+    int32_t action = AKeyEvent_getAction(event);
+    if (!session->isLoaded()) {
+        if (action == AKEY_EVENT_ACTION_DOWN && AKeyEvent_getRepeatCount(event) == 0 && (keys & FBA_KEY_START)) {
+            requestPickRom(engine);
+        }
+        return 1;
     }
-    touched = isTouched(engine->keySelect, scaledX, scaledY);
-    if (touched) {
-        latch |= FBA_KEY_SELECT;
+    if (action == AKEY_EVENT_ACTION_DOWN) {
+        engine->padKeys |= keys;
+    } else if (action == AKEY_EVENT_ACTION_UP) {
+        engine->padKeys &= ~keys;
     }
+    updateKeyLatch(engine, FunkyBoyAndroid::Engine::InputSource::Gamepad, AKeyEvent_getEventTime(event));
+    return 1;
 }
 
-static int findPointerIndex(const AInputEvent* event, size_t id) {
-    int count = AMotionEvent_getPointerCount(event);
-    for (int i = 0; i < count; i++) {
-        if (id == AMotionEvent_getPointerId(event, i)) {
-            return i;
-        }
+static int32_t handleAxisEvent(struct engine *engine, const AInputEvent *event) {
+    if (coldStart->isSessionPending()
+            || !session->isLoaded()) {
+        return 1;
     }
-    return -1;
+    engine->axisKeys = Engine::readAxes(event);
+    updateKeyLatch(engine, FunkyBoyAndroid::Engine::InputSource::Gamepad, AMotionEvent_getEventTime(event));
+    return 1;
 }
 
 /**
  * Process the next input event.
  */
 static int32_t engine_handle_input(struct android_app* app, AInputEvent* event) {
-    if (AInputEvent_getType(event) != AINPUT_EVENT_TYPE_MOTION) {
+    auto* engine = (struct engine*)app->userData;
+    int32_t type = AInputEvent_getType(event);
+    if (type == AINPUT_EVENT_TYPE_KEY) {
+        return handleKeyEvent(engine, event);
+    }
+    if (type != AINPUT_EVENT_TYPE_MOTION) {
         return 0;
     }
-    auto* engine = (struct engine*)app->userData;
+    if ((AInputEvent_getSource(event) & AINPUT_SOURCE_CLASS_JOYSTICK) != 0) {
+        return handleAxisEvent(engine, event);
+    }
+    if (coldStart->isSessionPending()) {
+        return 1;
+    }
     int action = AMotionEvent_getAction(event);
     uint flags = action & AMOTION_EVENT_ACTION_MASK;
 
-    if (FunkyBoyAndroid::State::emulator->getCartridgeStatus() != FunkyBoy::CartridgeStatus::Loaded) {
+    if (!session->isLoaded()) {
         if (flags == AMOTION_EVENT_ACTION_DOWN) {
             float scaledX = AMotionEvent_getX(event, 0) * engine->uiScale;
             float scaledY = AMotionEvent_getY(event, 0) * engine->uiScale;
-            bool touched = isTouched(engine->keyStart, scaledX, scaledY);
-            if (touched) {
+            if (Engine::hitTest(engine, scaledX, scaledY) & FBA_KEY_START) {
                 requestPickRom(engine);
             }
         }
         return 1;
     }
 
-    auto &activePointerIds = engine->activePointerIds;
     switch (flags) {
         case AMOTION_EVENT_ACTION_DOWN:
-            // For AMOTION_EVENT_ACTION_DOWN, only the primary pointer is involved
-            if (activePointerIds.empty()) {
-                // For some reason, it may happen that AMOTION_EVENT_ACTION_DOWN is called
-                // sequentially without a AMOTION_EVENT_ACTION_UP.
-                // With this we do some basic deduplication to avoid sticky inputs
-                activePointerIds.push_back(AMotionEvent_getPointerId(event, 0));
-            }
-            break;
+            // For AMOTION_EVENT_ACTION_DOWN, only the primary pointer is involved.
+            // It may happen that AMOTION_EVENT_ACTION_DOWN is called sequentially without a
+            // AMOTION_EVENT_ACTION_UP, so start over to avoid sticky inputs.
+            engine->activePointers = 0;
+            // fall through
         case AMOTION_EVENT_ACTION_POINTER_DOWN: {
             uint32_t pointerIndex = (action & AMOTION_EVENT_ACTION_POINTER_INDEX_MASK) >> AMOTION_EVENT_ACTION_POINTER_INDEX_SHIFT;
-            activePointerIds.push_back(AMotionEvent_getPointerId(event, pointerIndex));
+            uint32_t pointerId = AMotionEvent_getPointerId(event, pointerIndex);
+            if (pointerId < FB_ANDROID_MAX_POINTERS) {
+                engine->activePointers |= 1u << pointerId;
+            }
             break;
         }
         case AMOTION_EVENT_ACTION_UP:
-            // FILO: First in, last out (primary pointer)
-            if (!activePointerIds.empty()) {
-                activePointerIds.pop_back();
-            }
+        case AMOTION_EVENT_ACTION_CANCEL:
+            engine->activePointers = 0;
             break;
         case AMOTION_EVENT_ACTION_POINTER_UP: {
-            uint pointerId = (action & AMOTION_EVENT_ACTION_POINTER_INDEX_MASK) >> AMOTION_EVENT_ACTION_POINTER_INDEX_SHIFT;
-            pointerId = AMotionEvent_getPointerId(event, pointerId);
-            auto it = activePointerIds.begin();
-            auto it_end = activePointerIds.end();
-            for (; it != it_end; ++it) {
-                if (*it == pointerId) {
-                    activePointerIds.erase(it);
-                    break;
-                }
+            uint32_t pointerIndex = (action & AMOTION_EVENT_ACTION_POINTER_INDEX_MASK) >> AMOTION_EVENT_ACTION_POINTER_INDEX_SHIFT;
+            uint32_t pointerId = AMotionEvent_getPointerId(event, pointerIndex);
+            if (pointerId < FB_ANDROID_MAX_POINTERS) {
+                engine->activePointers &= ~(1u << pointerId);
             }
             break;
         }
@@ -313,28 +464,18 @@ static int32_t engine_handle_input(struct android_app* app, AInputEvent* event)
             break;
     }
 
-    int keyLatch = 0;
-
-    auto it = activePointerIds.begin();
-    auto it_end = activePointerIds.end();
-    for (; it != it_end; ++it) {
-        auto pointerIndex = findPointerIndex(event, *it);
-        if (pointerIndex != -1) {
-            handleInputPointer(pointerIndex, event, engine, keyLatch);
-        }
+    // Each pointer of the event resolves to its keys with a single hit map lookup
+    size_t pointerCount = AMotionEvent_getPointerCount(event);
+    for (size_t i = 0 ; i < pointerCount ; i++) {
+        updatePointer(engine, event, i);
     }
 
-    if (keyLatch != engine->keyLatch) {
-        FunkyBoyAndroid::State::emulator->setInputState(FunkyBoy::Controller::JoypadKey::JOYPAD_A, keyLatch & FBA_KEY_A);
-        FunkyBoyAndroid::State::emulator->setInputState(FunkyBoy::Controller::JoypadKey::JOYPAD_B, keyLatch & FBA_KEY_B);
-        FunkyBoyAndroid::State::emulator->setInputState(FunkyBoy::Controller::JoypadKey::JOYPAD_START, keyLatch & FBA_KEY_START);
-        FunkyBoyAndroid::State::emulator->setInputState(FunkyBoy::Controller::JoypadKey::JOYPAD_SELECT, keyLatch & FBA_KEY_SELECT);
-        FunkyBoyAndroid::State::emulator->setInputState(FunkyBoy::Controller::JoypadKey::JOYPAD_LEFT, keyLatch & FBA_KEY_LEFT);
-        FunkyBoyAndroid::State::emulator->setInputState(FunkyBoy::Controller::JoypadKey::JOYPAD_UP, keyLatch & FBA_KEY_UP);
-        FunkyBoyAndroid::State::emulator->setInputState(FunkyBoy::Controller::JoypadKey::JOYPAD_RIGHT, keyLatch & FBA_KEY_RIGHT);
-        FunkyBoyAndroid::State::emulator->setInputState(FunkyBoy::Controller::JoypadKey::JOYPAD_DOWN, keyLatch & FBA_KEY_DOWN);
-        engine->keyLatch = keyLatch;
+    int touchKeys = 0;
+    for (uint32_t active = engine->activePointers ; active != 0 ; active &= active - 1) {
+        touchKeys |= engine->pointerKeys[__builtin_ctz(active)];
     }
+    engine->touchKeys = touchKeys;
+    updateKeyLatch(engine, FunkyBoyAndroid::Engine::InputSource::Touch, AMotionEvent_getEventTime(event));
 
     return 1;
 }
@@ -348,10 +489,13 @@ static void engine_handle_cmd(struct android_app* app, int32_t cmd) {
         case APP_CMD_SAVE_STATE: {
             LOGD("CMD: APP_CMD_SAVE_STATE");
             // The system has asked us to save our current state.  Do so.
+            coldStart->waitForSession();
+            FunkyBoyAndroid::storeSession();
+            session->getBatterySave().requestFlush(session->getEmulator());
             auto *state = static_cast<app_save_state *>(calloc(
                     sizeof(FunkyBoyAndroid::app_save_state), sizeof(char)));
 
-            FunkyBoyAndroid::serializeState(state);
+            FunkyBoyAndroid::serializeState(*session, state);
 
             engine->app->savedState = state;
             engine->app->savedStateSize = sizeof(FunkyBoyAndroid::app_save_state);
@@ -362,29 +506,39 @@ static void engine_handle_cmd(struct android_app* app, int32_t cmd) {
         case APP_CMD_INIT_WINDOW:
             // The window is being shown, get it ready.
             LOGD("CMD: APP_CMD_INIT_WINDOW");
-            engine->activePointerIds.clear();
+            clearInputs(engine);
             if (engine->app->window != nullptr) {
+                Engine::setContentFrameRate(engine->app->window, 1e9f / FB_ANDROID_GB_FRAME_NS);
                 Engine::initDisplay(engine);
+                engine->statusScreenDirty = true;
                 engine_draw_frame(engine);
             }
             break;
+        case APP_CMD_WINDOW_RESIZED:
+        case APP_CMD_WINDOW_REDRAW_NEEDED:
+        case APP_CMD_CONTENT_RECT_CHANGED:
+            engine->statusScreenDirty = true;
+            break;
         case APP_CMD_TERM_WINDOW:
             LOGD("CMD: APP_CMD_TERM_WINDOW");
-            engine->activePointerIds.clear();
+            clearInputs(engine);
             // The window is being hidden or closed, clean it up.
             engine_term_display(engine);
             break;
         case APP_CMD_GAINED_FOCUS:
             LOGD("CMD: APP_CMD_GAINED_FOCUS");
-            engine->activePointerIds.clear();
+            clearInputs(engine);
             // When our app gains focus, we start animating again.
-            dynamic_cast<FunkyBoyAndroid::Controller::AudioControllerAndroid*>(FunkyBoyAndroid::State::emuAudioController.get())->setPlaying(true);
+            audioController->setPlaying(!engine->paused);
             engine->animating = true;
             break;
         case APP_CMD_LOST_FOCUS:
             LOGD("CMD: APP_CMD_LOST_FOCUS");
-            engine->activePointerIds.clear();
-            dynamic_cast<FunkyBoyAndroid::Controller::AudioControllerAndroid*>(FunkyBoyAndroid::State::emuAudioController.get())->setPlaying(false);
+            clearInputs(engine);
+            audioController->setPlaying(false);
+            coldStart->waitForSession();
+            FunkyBoyAndroid::storeSession();
+            session->getBatterySave().requestFlush(session->getEmulator());
             engine->animating = false;
             engine_draw_frame(engine);
             break;
@@ -395,20 +549,167 @@ static void engine_handle_cmd(struct android_app* app, int32_t cmd) {
 
 namespace FunkyBoyAndroid {
 
-    static int handleCustomMessage(int fd, int events, void *data) {
-        size_t strln;
-        read(fd, reinterpret_cast<char *>(&strln), sizeof(size_t));
+    static void loadPickedROM(struct engine *engine, const char *inRomPath) {
+        LOGD("RECV rom path: %s", inRomPath);
+        coldStart->waitForSession();
+        stopMovie(engine);
+        // Read or inflate in the background, loading continues in onROMInflated
+        if (romInflater->start(inRomPath)) {
+            session->beginROMLoad();
+        }
+    }
 
-        char *inRomPath = (char *) calloc(strln + 1, sizeof(char));
-        read(fd, inRomPath, strln);
+    static void setPaused(struct engine *engine, bool paused) {
+        engine->paused = paused;
+        audioController->setPlaying(!paused && engine->animating);
+    }
 
-        LOGD("RECV rom path: %s", inRomPath);
-        loadROM(inRomPath);
+    static void setSpeed(struct engine *engine, float speed) {
+        if (speed <= 0.0f) {
+            LOGW("Invalid emulation speed %f", speed);
+            return;
+        }
+        engine->emulationSpeed = speed;
+        engine->frameBudget = 0.0f;
+        audioController->setDropWhenFull(speed > 1.0f);
+    }
 
-        State::initialSaveLoaded = false;
+    static void setRunAhead(struct engine *engine, int32_t frames) {
+        if (frames < 0) {
+            LOGW("Invalid amount of frames to run ahead: %d", frames);
+            return;
+        }
+        if (frames > 0 && (movieRecorder != nullptr || moviePlayer != nullptr)) {
+            // Movies verify the frame hash of every frame, which run-ahead does not render
+            LOGW("Running ahead is not available while a movie is active");
+            return;
+        }
+        if (runAhead == nullptr) {
+            runAhead = std::make_unique<RunAhead>(session->getArena());
+        }
+        runAhead->setFrames(static_cast<uint32_t>(frames));
+    }
 
-        free(inRomPath);
-        return 1;
+    static void startMovie(struct engine *engine, const app_command &command) {
+        if (!session->isLoaded()) {
+            LOGW("No ROM loaded, cannot start a movie");
+            return;
+        }
+        stopMovie(engine);
+        if (runAhead != nullptr && runAhead->getFrames() > 0) {
+            LOGI("Stopping to run ahead for the movie");
+            runAhead->setFrames(0);
+        }
+        if (command.type == CommandType::RecordMovie) {
+            movieRecorder = std::make_unique<MovieRecorder>(session->getEmulator(), session->getROMPath(), command.path);
+        } else {
+            auto player = std::make_unique<MoviePlayer>();
+            if (!player->load(command.path) || !player->start(session->getEmulator())) {
+                return;
+            }
+            moviePlayer = std::move(player);
+        }
+        displayController->setFrameHashing(true);
+    }
+
+#ifdef FB_ANDROID_BENCHMARK
+    static void verifyMovie(const char *path) {
+        if (movieVerifier.joinable()) {
+            movieVerifier.join();
+        }
+        movieVerifier = std::thread([](const std::string &moviePath) {
+            verifyMovieHeadless(moviePath);
+#ifdef FB_ANDROID_PGO_GENERATE
+            // The process usually gets killed rather than exiting, so write the profile right away
+            __llvm_profile_write_file();
+#endif
+        }, std::string(path));
+    }
+#endif
+
+    static Capture::Recorder &getRecorder() {
+        if (recorder == nullptr) {
+            recorder = std::make_unique<Capture::Recorder>(session->getArena());
+            displayController->setCapture(recorder.get());
+            audioController->setCapture(recorder.get());
+        }
+        return *recorder;
+    }
+
+    static void handleCommand(const app_command &command, void *data) {
+        auto *engine = static_cast<struct engine *>(data);
+        coldStart->waitForSession();
+        switch (command.type) {
+            case CommandType::LoadROM:
+                loadPickedROM(engine, command.path);
+                break;
+            case CommandType::SaveSlot:
+                saveStateSlot(*session, command.slot);
+                break;
+            case CommandType::LoadSlot:
+                // Loading a state breaks the continuity of a movie
+                stopMovie(engine);
+                loadStateSlot(*session, command.slot);
+                break;
+            case CommandType::SetPaused:
+                setPaused(engine, command.paused);
+                break;
+            case CommandType::SetSpeed:
+                setSpeed(engine, command.speed);
+                break;
+            case CommandType::SetPalette:
+                displayController->setPalette(command.palette);
+                break;
+            case CommandType::RecordMovie:
+            case CommandType::PlayMovie:
+                startMovie(engine, command);
+                break;
+            case CommandType::StopMovie:
+                stopMovie(engine);
+                break;
+#ifdef FB_ANDROID_BENCHMARK
+            case CommandType::VerifyMovie:
+                verifyMovie(command.path);
+                break;
+#endif
+            case CommandType::SetRunAhead:
+                setRunAhead(engine, command.frames);
+                break;
+            case CommandType::StartCapture:
+                if (!session->isLoaded()) {
+                    LOGW("No ROM loaded, cannot start capturing");
+                    break;
+                }
+                getRecorder().start(command.path);
+                break;
+            case CommandType::StopCapture:
+                if (recorder != nullptr) {
+                    recorder->stop();
+                }
+                break;
+            case CommandType::TakeScreenshot:
+                getRecorder().requestScreenshot(command.path);
+                break;
+            case CommandType::MapKey:
+                if (!Engine::mapKey(engine, command.mapping.keyCode, command.mapping.keys)) {
+                    LOGW("Cannot map key code %d", command.mapping.keyCode);
+                }
+                break;
+            default:
+                LOGW("Unknown command %d", command.type);
+                break;
+        }
+    }
+
+    static void onROMInflated(struct engine *engine, int fd, const std::string &path) {
+        if (fd < 0) {
+            // The running game, if any, is kept
+            LOGE("Unable to read ROM %s", path.c_str());
+            reportROMNotReadable(engine, path);
+            return;
+        }
+        stopMovie(engine);
+        session->loadInflatedROM(fd, path.c_str());
     }
 
 }
@@ -419,6 +720,9 @@ namespace FunkyBoyAndroid {
  * event loop for receiving input events and doing other things.
  */
 void android_main(struct android_app* state) {
+    // Time to the first frame is measured from here
+    coldStart = std::make_unique<FunkyBoyAndroid::ColdStart>();
+
     struct engine engine{};
 
     memset(&engine, 0, sizeof(engine));
@@ -441,24 +745,45 @@ void android_main(struct android_app* state) {
     }
     engine.env = env;
 
-    FunkyBoyAndroid::reloadStrings(env, state->activity);
+    // "clazz" is misnamed, this is the actual activity instance
+    if (!FunkyBoyAndroid::JNI::init(env, state->activity->clazz)) {
+        LOGW("Could not bind to the activity");
+        jvm->DetachCurrentThread();
+        return;
+    }
 
-    FunkyBoyAndroid::State::emuDisplayController = std::make_shared<FunkyBoyAndroid::Controller::DisplayControllerAndroid>(&engine);
-    FunkyBoyAndroid::State::emuAudioController = std::make_shared<FunkyBoyAndroid::Controller::AudioControllerAndroid>();
+    session = std::make_unique<FunkyBoyAndroid::Session>(FunkyBoy::GameBoyType::GameBoyDMG);
+    displayController = std::make_shared<FunkyBoyAndroid::Controller::DisplayControllerAndroid>(&engine, session->getArena());
+    audioController = std::make_shared<FunkyBoyAndroid::Controller::AudioControllerAndroid>(session->getArena());
+    session->bindOutput(displayController, audioController);
 
-    FunkyBoyAndroid::State::emulator = std::make_unique<FunkyBoy::Emulator>(FunkyBoy::GameBoyType::GameBoyDMG);
-    FunkyBoyAndroid::State::emulator->setControllers(FunkyBoy::Controller::Controllers()
-            .withDisplay(FunkyBoyAndroid::State::emuDisplayController)
-            .withAudio(FunkyBoyAndroid::State::emuAudioController));
+    sessionSnapshot = std::make_unique<FunkyBoyAndroid::SessionSnapshot>(state->activity->internalDataPath);
 
-    if (state->savedState != nullptr) {
-        // We are starting with a previous saved state; restore from it.
-        auto savedState = static_cast<FunkyBoyAndroid::app_save_state*>(state->savedState);
-        FunkyBoyAndroid::resumeFromState(savedState);
+    // We may be starting with a previous saved state, otherwise the last session gets resumed
+    auto savedState = static_cast<const FunkyBoyAndroid::app_save_state*>(state->savedState);
+    if (savedState == nullptr && sessionSnapshot->isValid()) {
+        // Show the last frame of the previous session right away
+        displayController->loadPixels(sessionSnapshot->getFrame());
     }
-
-    pipe(fbMsgPipe);
-    ALooper_addFd(state->looper, fbMsgPipe[0], ALOOPER_POLL_CALLBACK , ALOOPER_EVENT_INPUT, handleCustomMessage, state);
+    // The audio stream, the ROM and the battery save get loaded in the background from here on
+    coldStart->begin(jvm, *session, *sessionSnapshot, *audioController, savedState);
+
+    // Meanwhile, everything else the first frame needs is prepared on this thread
+    FunkyBoyAndroid::reloadStrings(env, state->config);
+
+    // A kernel set can be forced for testing, e.g. with "adb shell setprop debug.funkyboy.kernels scalar"
+    char forcedKernels[PROP_VALUE_MAX] = {0};
+    __system_property_get("debug.funkyboy.kernels", forcedKernels);
+    FunkyBoyAndroid::Kernels::bindKernels(forcedKernels);
+
+    engine.emulationSpeed = 1.0f;
+    engine.pacingSpeed = 1.0;
+    FunkyBoyAndroid::Engine::resetKeyMap(&engine);
+    fbCommandChannel.attach(state->looper, FunkyBoyAndroid::handleCommand, &engine);
+    romInflater = std::make_unique<FunkyBoyAndroid::ROMInflater>(state->looper, [&engine](int fd, const std::string &path) {
+        FunkyBoyAndroid::onROMInflated(&engine, fd, path);
+    });
+    choreographer.init();
 
     FunkyBoy::Util::FrameExecutor executeFrame([&engine](){
         engine_draw_frame(&engine);
@@ -473,7 +798,8 @@ void android_main(struct android_app* state) {
         // If not animating, we will block forever waiting for events.
         // If animating, we loop until all events are read, then continue
         // to draw the next frame of animation.
-        while ((ident=ALooper_pollAll(engine.animating ? 0 : -1, nullptr, &events,
+        // On the status screen, the looper sleeps until the screen has to change.
+        while ((ident=ALooper_pollAll(frameTimeout(&engine), nullptr, &events,
                                       (void**)&source)) >= 0) {
 
             // Process this event.
@@ -484,12 +810,45 @@ void android_main(struct android_app* state) {
             // Check if we are exiting.
             if (state->destroyRequested != 0) {
                 engine_term_display(&engine);
+                fbCommandChannel.detach();
+                romInflater.reset();
+                FunkyBoyAndroid::stopMovie(&engine);
+#ifdef FB_ANDROID_BENCHMARK
+                if (movieVerifier.joinable()) {
+                    movieVerifier.join();
+                }
+#endif
+                coldStart->waitForSession();
+                FunkyBoyAndroid::storeSession();
+                session->getBatterySave().requestFlush(session->getEmulator());
+                session->getBatterySave().waitForFlush();
+                // Waits for the audio stream, which may still be opening
+                coldStart.reset();
+                if (recorder != nullptr) {
+                    displayController->setCapture(nullptr);
+                    audioController->setCapture(nullptr);
+                    recorder.reset();
+                }
+                runAhead.reset();
+                // The outputs live in the arena of the session, so they have to go first
+                displayController.reset();
+                audioController.reset();
+                session.reset();
+                sessionSnapshot.reset();
+                FunkyBoyAndroid::JNI::release(env);
                 return;
             }
         }
 
-        if (engine.animating) {
-            executeFrame();
+        if (engine.animating && !engine.paused) {
+            if (isEmulating()) {
+                // Without a choreographer, frames are paced by a timer
+                if (!choreographer.request(onVsync, &engine)) {
+                    executeFrame();
+                }
+            } else {
+                engine_draw_frame(&engine);
+            }
         }
     }
 
@@ -0,0 +1,49 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "link_simulation.h"
+
+#include <fba_util/emulator_state.h>
+
+using namespace FunkyBoyAndroid::Netplay;
+
+LinkSimulation::LinkSimulation(LinkCable &cable, Controller::AudioControllerAndroid *audio)
+    : cable(cable)
+    , audio(audio)
+{
+}
+
+void LinkSimulation::setInput(int player, uint8_t keys) {
+    applyJoypadState(cable.getSession(player).getEmulator(), keys);
+}
+
+void LinkSimulation::stepFrame() {
+    cable.stepFrame();
+}
+
+void LinkSimulation::saveState(std::ostream &ostream) {
+    cable.saveState(ostream);
+}
+
+bool LinkSimulation::loadState(std::istream &istream) {
+    return cable.loadState(istream);
+}
+
+void LinkSimulation::setMuted(bool muted) {
+    if (audio != nullptr) {
+        audio->setMuted(muted);
+    }
+}
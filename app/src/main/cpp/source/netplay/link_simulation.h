@@ -0,0 +1,51 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FB_ANDROID_NETPLAY_LINK_SIMULATION_H
+#define FB_ANDROID_NETPLAY_LINK_SIMULATION_H
+
+#include <controllers/audio_android.h>
+#include <fba_util/link_cable.h>
+#include <netplay/simulation.h>
+#include <util/typedefs.h>
+
+// Both consoles and the bytes in transit on the link cable, which are bounded by its serial FIFOs
+#define FB_ANDROID_NETPLAY_SNAPSHOT_SIZE (2 * FB_SAVE_STATE_MAX_BUFFER_SIZE + FB_ANDROID_LINK_STATE_MAX_SIZE)
+
+namespace FunkyBoyAndroid::Netplay {
+
+    /**
+     * Both consoles of a link cable, player n controlling console n.
+     */
+    class LinkSimulation: public Simulation {
+    private:
+        LinkCable &cable;
+        // Output of the local console, may be nullptr
+        Controller::AudioControllerAndroid *audio;
+
+    public:
+        LinkSimulation(LinkCable &cable, Controller::AudioControllerAndroid *audio);
+
+        void setInput(int player, uint8_t keys) override;
+        void stepFrame() override;
+        void saveState(std::ostream &ostream) override;
+        bool loadState(std::istream &istream) override;
+        void setMuted(bool muted) override;
+    };
+
+}
+
+#endif //FB_ANDROID_NETPLAY_LINK_SIMULATION_H
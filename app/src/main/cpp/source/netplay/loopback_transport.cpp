@@ -0,0 +1,78 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "loopback_transport.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+using namespace FunkyBoyAndroid::Netplay;
+
+namespace {
+
+    inline uint64_t nowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+}
+
+LoopbackTransport::LoopbackTransport(std::shared_ptr<channel> outbound, std::shared_ptr<channel> inbound)
+    : outbound(std::move(outbound))
+    , inbound(std::move(inbound))
+{
+}
+
+std::pair<std::unique_ptr<LoopbackTransport>, std::unique_ptr<LoopbackTransport>> LoopbackTransport::createPair(const loopback_conditions &conditions, uint32_t seed) {
+    auto forward = std::make_shared<channel>();
+    auto backward = std::make_shared<channel>();
+    forward->random.seed(seed);
+    forward->conditions = conditions;
+    backward->random.seed(seed + 1);
+    backward->conditions = conditions;
+    return std::make_pair(
+            std::unique_ptr<LoopbackTransport>(new LoopbackTransport(forward, backward)),
+            std::unique_ptr<LoopbackTransport>(new LoopbackTransport(backward, forward)));
+}
+
+bool LoopbackTransport::send(const uint8_t *data, size_t size) {
+    std::lock_guard<std::mutex> lock(outbound->mutex);
+    auto &conditions = outbound->conditions;
+    if (conditions.lossPercent > 0 && outbound->random() % 100 < conditions.lossPercent) {
+        // Lost datagrams still count as sent, as with a real network
+        return true;
+    }
+    int64_t delayMs = conditions.delayMs;
+    if (conditions.jitterMs > 0) {
+        delayMs += static_cast<int64_t>(outbound->random() % (2 * conditions.jitterMs + 1)) - conditions.jitterMs;
+    }
+    uint64_t arrival = nowNs() + std::max<int64_t>(delayMs, 0) * 1000000;
+    outbound->inTransit.emplace(arrival, std::vector<uint8_t>(data, data + size));
+    return true;
+}
+
+size_t LoopbackTransport::receive(uint8_t *buffer, size_t capacity) {
+    std::lock_guard<std::mutex> lock(inbound->mutex);
+    auto next = inbound->inTransit.begin();
+    if (next == inbound->inTransit.end() || next->first > nowNs()) {
+        return 0;
+    }
+    // Like UDP, datagrams which do not fit get truncated
+    size_t size = std::min(next->second.size(), capacity);
+    std::memcpy(buffer, next->second.data(), size);
+    inbound->inTransit.erase(next);
+    return size;
+}
@@ -0,0 +1,71 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FB_ANDROID_NETPLAY_LOOPBACK_TRANSPORT_H
+#define FB_ANDROID_NETPLAY_LOOPBACK_TRANSPORT_H
+
+#include <netplay/transport.h>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace FunkyBoyAndroid::Netplay {
+
+    struct loopback_conditions {
+        // One-way delay of each datagram
+        uint32_t delayMs;
+        // Maximum deviation from the delay in both directions, which may reorder datagrams
+        uint32_t jitterMs;
+        // Share of datagrams which get dropped
+        uint32_t lossPercent;
+    };
+
+    /**
+     * In-memory transport between two peers of the same process, simulating the given network
+     * conditions. Used to exercise netplay offline.
+     */
+    class LoopbackTransport: public Transport {
+    private:
+        struct channel {
+            std::mutex mutex;
+            std::mt19937 random;
+            loopback_conditions conditions;
+            // Datagrams in transit, ordered by the time at which they arrive
+            std::multimap<uint64_t, std::vector<uint8_t>> inTransit;
+        };
+
+        std::shared_ptr<channel> outbound;
+        std::shared_ptr<channel> inbound;
+
+        LoopbackTransport(std::shared_ptr<channel> outbound, std::shared_ptr<channel> inbound);
+
+    public:
+        /**
+         * Creates both ends of a loopback connection. The seed makes losses and jitter repeatable.
+         */
+        static std::pair<std::unique_ptr<LoopbackTransport>, std::unique_ptr<LoopbackTransport>> createPair(const loopback_conditions &conditions, uint32_t seed);
+
+        bool send(const uint8_t *data, size_t size) override;
+        size_t receive(uint8_t *buffer, size_t capacity) override;
+    };
+
+}
+
+#endif //FB_ANDROID_NETPLAY_LOOPBACK_TRANSPORT_H
@@ -0,0 +1,279 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "rollback.h"
+
+#include <fba_util/logging.h>
+
+#include <algorithm>
+#include <chrono>
+#include <istream>
+#include <ostream>
+
+// "FBNP" in little endian
+#define FB_ANDROID_NETPLAY_MAGIC 0x504e4246u
+
+// Magic, acknowledged frame, first frame and input count
+#define FB_ANDROID_NETPLAY_HEADER_SIZE 13
+
+#define FB_ANDROID_NETPLAY_MAX_PACKET_INPUTS 32
+#define FB_ANDROID_NETPLAY_MAX_PACKET_SIZE (FB_ANDROID_NETPLAY_HEADER_SIZE + FB_ANDROID_NETPLAY_MAX_PACKET_INPUTS)
+
+#define FB_ANDROID_NETPLAY_NO_ROLLBACK UINT32_MAX
+
+using namespace FunkyBoyAndroid::Netplay;
+
+namespace {
+
+    inline uint64_t nowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    inline void write32(uint8_t *data, uint32_t value) {
+        data[0] = value & 0xffu;
+        data[1] = (value >> 8u) & 0xffu;
+        data[2] = (value >> 16u) & 0xffu;
+        data[3] = (value >> 24u) & 0xffu;
+    }
+
+    inline uint32_t read32(const uint8_t *data) {
+        return data[0] | (data[1] << 8u) | (data[2] << 16u) | (static_cast<uint32_t>(data[3]) << 24u);
+    }
+
+    inline uint32_t historyIndex(uint32_t frame) {
+        return frame & (FB_ANDROID_NETPLAY_INPUT_HISTORY - 1);
+    }
+
+}
+
+RollbackNetplay::RollbackNetplay(Simulation &simulation, Transport &transport, Util::Arena &arena, size_t snapshotSize, int localPlayer)
+    : simulation(simulation)
+    , transport(transport)
+    , localPlayer(localPlayer)
+    , frame(0)
+    , remoteConfirmed(0)
+    , remoteAcknowledged(0)
+    , rollbackFrom(FB_ANDROID_NETPLAY_NO_ROLLBACK)
+    , rollbackLimit(FB_ANDROID_NETPLAY_MAX_ROLLBACK)
+    , averageFrameNs(0)
+    , failed(false)
+    , localInput{}
+    , remoteInput{}
+    , simulatedRemoteInput{}
+    , lastFrame{}
+    , stats{}
+{
+    char *memory = arena.allocateArray<char>(FB_ANDROID_NETPLAY_MAX_ROLLBACK * snapshotSize, Util::ArenaTag::Snapshot);
+    if (memory == nullptr) {
+        LOGE("Unable to allocate netplay snapshots, the session cannot be started");
+        failed = true;
+        return;
+    }
+    for (uint32_t slot = 0 ; slot < FB_ANDROID_NETPLAY_MAX_ROLLBACK ; slot++) {
+        snapshots[slot] = Util::state_buffer(memory + slot * snapshotSize, snapshotSize);
+    }
+}
+
+bool RollbackNetplay::advance(uint8_t keys) {
+    if (failed) {
+        return false;
+    }
+    uint64_t start = nowNs();
+    lastFrame = {};
+    lastFrame.frame = frame;
+
+    receiveInput();
+    if (rollbackFrom != FB_ANDROID_NETPLAY_NO_ROLLBACK) {
+        rollback();
+        if (failed) {
+            return false;
+        }
+    }
+
+    // The remote peer may be ahead, in which case nothing needs to be predicted
+    uint32_t predicted = frame > remoteConfirmed ? frame - remoteConfirmed : 0;
+    if (predicted >= rollbackLimit || frame - remoteAcknowledged >= FB_ANDROID_NETPLAY_INPUT_HISTORY) {
+        // Our input may have been lost, so keep resending it while waiting for the peer
+        sendInput(frame);
+        stats.stalls++;
+        return false;
+    }
+
+    localInput[historyIndex(frame)] = keys;
+    sendInput(frame + 1);
+    simulate(frame);
+    if (failed) {
+        return false;
+    }
+    frame++;
+
+    lastFrame.totalNs = nowNs() - start;
+    stats.frames++;
+    if (lastFrame.totalNs > FB_ANDROID_NETPLAY_FRAME_BUDGET_NS) {
+        stats.overBudget++;
+    }
+    return true;
+}
+
+void RollbackNetplay::receiveInput() {
+    uint8_t packet[FB_ANDROID_NETPLAY_MAX_PACKET_SIZE];
+    size_t size;
+    while ((size = transport.receive(packet, sizeof(packet))) > 0) {
+        if (size < FB_ANDROID_NETPLAY_HEADER_SIZE || read32(packet) != FB_ANDROID_NETPLAY_MAGIC) {
+            continue;
+        }
+        uint32_t acknowledged = read32(packet + 4);
+        uint32_t first = read32(packet + 8);
+        uint32_t count = packet[12];
+        if (size < FB_ANDROID_NETPLAY_HEADER_SIZE + count) {
+            continue;
+        }
+        if (acknowledged > remoteAcknowledged && acknowledged <= frame) {
+            remoteAcknowledged = acknowledged;
+        }
+        for (uint32_t i = 0 ; i < count ; i++) {
+            uint32_t inputFrame = first + i;
+            if (inputFrame < remoteConfirmed) {
+                // Resent input which has already been confirmed
+                continue;
+            }
+            if (inputFrame > remoteConfirmed || inputFrame >= frame + FB_ANDROID_NETPLAY_INPUT_HISTORY - FB_ANDROID_NETPLAY_MAX_ROLLBACK) {
+                // Input has to be confirmed in order, the gap gets filled by a later packet
+                break;
+            }
+            uint8_t keys = packet[FB_ANDROID_NETPLAY_HEADER_SIZE + i];
+            remoteInput[historyIndex(inputFrame)] = keys;
+            if (inputFrame < frame && keys != simulatedRemoteInput[historyIndex(inputFrame)]) {
+                rollbackFrom = std::min(rollbackFrom, inputFrame);
+            }
+            remoteConfirmed++;
+        }
+    }
+}
+
+void RollbackNetplay::sendInput(uint32_t end) {
+    uint8_t packet[FB_ANDROID_NETPLAY_MAX_PACKET_SIZE];
+    // Everything the peer has not acknowledged yet, oldest first, as it confirms input in order
+    uint32_t count = std::min<uint32_t>(end - remoteAcknowledged, FB_ANDROID_NETPLAY_MAX_PACKET_INPUTS);
+    write32(packet, FB_ANDROID_NETPLAY_MAGIC);
+    write32(packet + 4, remoteConfirmed);
+    write32(packet + 8, remoteAcknowledged);
+    packet[12] = static_cast<uint8_t>(count);
+    for (uint32_t i = 0 ; i < count ; i++) {
+        packet[FB_ANDROID_NETPLAY_HEADER_SIZE + i] = localInput[historyIndex(remoteAcknowledged + i)];
+    }
+    if (!transport.send(packet, FB_ANDROID_NETPLAY_HEADER_SIZE + count)) {
+        LOGW("Unable to send netplay input of frame %u", end);
+    }
+}
+
+void RollbackNetplay::rollback() {
+    uint64_t start = nowNs();
+    uint32_t target = rollbackFrom;
+    rollbackFrom = FB_ANDROID_NETPLAY_NO_ROLLBACK;
+    if (!loadSnapshot(target)) {
+        return;
+    }
+    uint64_t restored = nowNs();
+    simulation.setMuted(true);
+    for (uint32_t simulatedFrame = target ; simulatedFrame < frame && !failed ; simulatedFrame++) {
+        simulate(simulatedFrame);
+    }
+    simulation.setMuted(false);
+
+    lastFrame.rolledBackFrames = frame - target;
+    lastFrame.restoreNs = restored - start;
+    lastFrame.resimulateNs = nowNs() - restored;
+    stats.rollbacks++;
+    stats.rolledBackFrames += lastFrame.rolledBackFrames;
+    stats.longestRollback = std::max(stats.longestRollback, lastFrame.rolledBackFrames);
+    stats.resimulateNs += lastFrame.resimulateNs;
+    LOGD("Rolled back %u frames to frame %u in %.2f ms", lastFrame.rolledBackFrames, target,
+            (lastFrame.restoreNs + lastFrame.resimulateNs) / 1000000.0);
+}
+
+void RollbackNetplay::simulate(uint32_t simulatedFrame) {
+    uint64_t start = nowNs();
+    uint8_t remoteKeys;
+    if (simulatedFrame < remoteConfirmed) {
+        // Confirmed input never gets rolled back, so no snapshot is needed
+        remoteKeys = remoteInput[historyIndex(simulatedFrame)];
+    } else {
+        if (!saveSnapshot(simulatedFrame)) {
+            return;
+        }
+        remoteKeys = predictRemoteInput();
+    }
+    simulatedRemoteInput[historyIndex(simulatedFrame)] = remoteKeys;
+
+    simulation.setInput(localPlayer, localInput[historyIndex(simulatedFrame)]);
+    simulation.setInput(1 - localPlayer, remoteKeys);
+    simulation.stepFrame();
+
+    // Allow running ahead only as far as re-simulating all of it still fits into one frame
+    uint64_t duration = nowNs() - start;
+    averageFrameNs = averageFrameNs == 0 ? duration : (averageFrameNs * 7 + duration) / 8;
+    uint64_t affordable = FB_ANDROID_NETPLAY_FRAME_BUDGET_NS / std::max<uint64_t>(averageFrameNs, 1);
+    rollbackLimit = static_cast<uint32_t>(std::min<uint64_t>(std::max<uint64_t>(affordable, 2) - 1, FB_ANDROID_NETPLAY_MAX_ROLLBACK));
+}
+
+bool RollbackNetplay::saveSnapshot(uint32_t snapshotFrame) {
+    uint64_t start = nowNs();
+    Util::state_buffer &buffer = snapshots[snapshotFrame % FB_ANDROID_NETPLAY_MAX_ROLLBACK];
+    buffer.rewindWrite();
+    std::ostream ostream(&buffer);
+    simulation.saveState(ostream);
+    if (buffer.overflowed()) {
+        LOGE("Netplay snapshot of frame %u exceeds the snapshot size, ending the session", snapshotFrame);
+        failed = true;
+        return false;
+    }
+
+    uint64_t duration = nowNs() - start;
+    lastFrame.snapshots++;
+    lastFrame.snapshotNs += duration;
+    stats.snapshots++;
+    stats.snapshotNs += duration;
+    return true;
+}
+
+bool RollbackNetplay::loadSnapshot(uint32_t snapshotFrame) {
+    Util::state_buffer &buffer = snapshots[snapshotFrame % FB_ANDROID_NETPLAY_MAX_ROLLBACK];
+    buffer.rewindRead();
+    std::istream istream(&buffer);
+    if (!simulation.loadState(istream)) {
+        LOGE("Unable to restore the netplay snapshot of frame %u, ending the session", snapshotFrame);
+        failed = true;
+        return false;
+    }
+    return true;
+}
+
+uint8_t RollbackNetplay::predictRemoteInput() const {
+    // Players mostly hold buttons over many frames, so the last known input is the best guess
+    return remoteConfirmed > 0 ? remoteInput[historyIndex(remoteConfirmed - 1)] : 0;
+}
+
+void RollbackNetplay::logStats() const {
+    LOGI("Netplay: %llu frames, %llu stalls, %llu rollbacks re-simulating %llu frames (at most %u at once)",
+            static_cast<unsigned long long>(stats.frames), static_cast<unsigned long long>(stats.stalls),
+            static_cast<unsigned long long>(stats.rollbacks), static_cast<unsigned long long>(stats.rolledBackFrames),
+            stats.longestRollback);
+    LOGI("Netplay: %.3f ms per snapshot, %.3f ms per re-simulated frame, %llu frames over budget",
+            stats.snapshots > 0 ? stats.snapshotNs / 1000000.0 / stats.snapshots : 0.0,
+            stats.rolledBackFrames > 0 ? stats.resimulateNs / 1000000.0 / stats.rolledBackFrames : 0.0,
+            static_cast<unsigned long long>(stats.overBudget));
+}
@@ -0,0 +1,169 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FB_ANDROID_NETPLAY_ROLLBACK_H
+#define FB_ANDROID_NETPLAY_ROLLBACK_H
+
+#include <cstdint>
+#include <engine/frame_pacer.h>
+#include <netplay/simulation.h>
+#include <netplay/transport.h>
+#include <util/arena.h>
+#include <util/state_buffer.h>
+
+// Upper bound of frames which can be rolled back, which is also how far the local peer may run
+// ahead of the last confirmed remote input
+#define FB_ANDROID_NETPLAY_MAX_ROLLBACK 8
+
+// Frames of input history kept per player, must be a power of 2 above FB_ANDROID_NETPLAY_MAX_ROLLBACK
+#define FB_ANDROID_NETPLAY_INPUT_HISTORY 64
+
+#define FB_ANDROID_NETPLAY_FRAME_BUDGET_NS FB_ANDROID_GB_FRAME_NS
+
+namespace FunkyBoyAndroid::Netplay {
+
+    /**
+     * Cost of the last frame advanced, the hot path of rollback netplay.
+     */
+    struct frame_stats {
+        uint32_t frame;
+        // Frames re-simulated after a misprediction, 0 if none was detected
+        uint32_t rolledBackFrames;
+        uint32_t snapshots;
+        uint64_t snapshotNs;
+        uint64_t restoreNs;
+        uint64_t resimulateNs;
+        // Whole frame including the rollback, to be compared to FB_ANDROID_NETPLAY_FRAME_BUDGET_NS
+        uint64_t totalNs;
+    };
+
+    struct netplay_stats {
+        uint64_t frames;
+        uint64_t stalls;
+        uint64_t rollbacks;
+        uint64_t rolledBackFrames;
+        uint32_t longestRollback;
+        uint64_t snapshots;
+        uint64_t snapshotNs;
+        uint64_t resimulateNs;
+        uint64_t overBudget;
+    };
+
+    /**
+     * Two-player netplay, with rollback of mispredicted remote input.
+     *
+     * Each peer simulates the consoles of both players, e.g. linked by a LinkSimulation. Local
+     * input is applied immediately, while the input of the remote player is predicted to stay the
+     * same as its last confirmed input. Once the actual remote input of a frame arrives and differs
+     * from the prediction, both consoles are restored to the snapshot taken before that frame and
+     * the frames since then are simulated again, all within the current frame. Audio is muted while
+     * simulating again, as those frames have already been heard.
+     *
+     * Snapshots are only taken of frames simulated with predicted input, as frames with confirmed
+     * input never need to be rolled back. Both peers must start from the same power-on state of the
+     * same ROMs.
+     *
+     * A snapshot which cannot be taken or restored completely would desync both peers, so it ends
+     * the session, as does a failure to allocate the snapshots on construction. See hasFailed().
+     */
+    class RollbackNetplay {
+    private:
+        Simulation &simulation;
+        Transport &transport;
+        int localPlayer;
+
+        // Next frame to be simulated
+        uint32_t frame;
+        // All remote input before this frame has been received
+        uint32_t remoteConfirmed;
+        // All local input before this frame has been received by the remote peer
+        uint32_t remoteAcknowledged;
+        // Earliest frame simulated with a mispredicted remote input
+        uint32_t rollbackFrom;
+        // Limit of frames to run ahead, adapted so that a rollback fits into the frame budget
+        uint32_t rollbackLimit;
+        uint64_t averageFrameNs;
+        bool failed;
+
+        uint8_t localInput[FB_ANDROID_NETPLAY_INPUT_HISTORY];
+        uint8_t remoteInput[FB_ANDROID_NETPLAY_INPUT_HISTORY];
+        // Remote input which has been simulated, either confirmed or predicted
+        uint8_t simulatedRemoteInput[FB_ANDROID_NETPLAY_INPUT_HISTORY];
+
+        // Over memory from the arena given on construction
+        Util::state_buffer snapshots[FB_ANDROID_NETPLAY_MAX_ROLLBACK];
+
+        frame_stats lastFrame;
+        netplay_stats stats;
+
+        void receiveInput();
+        void sendInput(uint32_t end);
+        void rollback();
+        void simulate(uint32_t simulatedFrame);
+        bool saveSnapshot(uint32_t snapshotFrame);
+        bool loadSnapshot(uint32_t snapshotFrame);
+        uint8_t predictRemoteInput() const;
+
+    public:
+        /**
+         * Allocates the snapshots from the given arena, which has to outlive this instance.
+         * @param snapshotSize upper bound of a state saved by the simulation
+         * @param localPlayer 0 or 1, the same console must not be controlled by both peers
+         */
+        RollbackNetplay(Simulation &simulation, Transport &transport, Util::Arena &arena, size_t snapshotSize, int localPlayer);
+
+        RollbackNetplay(const RollbackNetplay &) = delete;
+        RollbackNetplay &operator=(const RollbackNetplay &) = delete;
+
+        /**
+         * Simulates the next frame with the given local input, given as a mask of FBA_KEY_* bits.
+         * Has to be called once per frame, on the thread owning the simulation.
+         * @return false if the remote peer lags too far behind, in which case no frame has been
+         * simulated and the input has to be offered again for the next frame, or if the session has
+         * failed
+         */
+        bool advance(uint8_t keys);
+
+        /**
+         * @return true if the session has ended because a snapshot could not be allocated, taken or
+         * restored, after which both peers are out of sync and no further frame gets simulated
+         */
+        inline bool hasFailed() const {
+            return failed;
+        }
+
+        inline uint32_t getFrame() const {
+            return frame;
+        }
+
+        inline uint32_t getConfirmedFrame() const {
+            return remoteConfirmed;
+        }
+
+        inline const frame_stats &getFrameStats() const {
+            return lastFrame;
+        }
+
+        inline const netplay_stats &getStats() const {
+            return stats;
+        }
+
+        void logStats() const;
+    };
+
+}
+
+#endif //FB_ANDROID_NETPLAY_ROLLBACK_H
@@ -0,0 +1,55 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FB_ANDROID_NETPLAY_SIMULATION_H
+#define FB_ANDROID_NETPLAY_SIMULATION_H
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+
+namespace FunkyBoyAndroid::Netplay {
+
+    /**
+     * Consoles of both players, driven frame by frame by rollback netplay.
+     */
+    class Simulation {
+    public:
+        virtual ~Simulation() = default;
+
+        /**
+         * Sets the joypad state of the given player for the next frame, as a mask of FBA_KEY_* bits.
+         */
+        virtual void setInput(int player, uint8_t keys) = 0;
+
+        virtual void stepFrame() = 0;
+
+        virtual void saveState(std::ostream &ostream) = 0;
+
+        /**
+         * @return false if the state is corrupt
+         */
+        virtual bool loadState(std::istream &istream) = 0;
+
+        /**
+         * Silences the audio output while frames which have already been heard are simulated again.
+         */
+        virtual void setMuted(bool muted) = 0;
+    };
+
+}
+
+#endif //FB_ANDROID_NETPLAY_SIMULATION_H
@@ -0,0 +1,48 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FB_ANDROID_NETPLAY_TRANSPORT_H
+#define FB_ANDROID_NETPLAY_TRANSPORT_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace FunkyBoyAndroid::Netplay {
+
+    /**
+     * Unreliable, non-blocking datagram channel to the remote peer.
+     *
+     * Datagrams may get lost, duplicated or reordered, the netplay protocol copes with all of it.
+     */
+    class Transport {
+    public:
+        virtual ~Transport() = default;
+
+        /**
+         * Sends one datagram without blocking.
+         */
+        virtual bool send(const uint8_t *data, size_t size) = 0;
+
+        /**
+         * Takes the next datagram which has arrived, without blocking.
+         * @return size of the datagram, or 0 if none has arrived
+         */
+        virtual size_t receive(uint8_t *buffer, size_t capacity) = 0;
+    };
+
+}
+
+#endif //FB_ANDROID_NETPLAY_TRANSPORT_H
@@ -0,0 +1,118 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "udp_transport.h"
+
+#include <fba_util/logging.h>
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <netdb.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+using namespace FunkyBoyAndroid::Netplay;
+
+UdpTransport::UdpTransport(): fd(-1) {
+}
+
+UdpTransport::~UdpTransport() {
+    close();
+}
+
+bool UdpTransport::open(uint16_t localPort, const char *remoteHost, uint16_t remotePort) {
+    close();
+
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    addrinfo *remote = nullptr;
+    std::string service = std::to_string(remotePort);
+    int error = getaddrinfo(remoteHost, service.c_str(), &hints, &remote);
+    if (error != 0) {
+        LOGW("Unable to resolve netplay peer %s: %s", remoteHost, gai_strerror(error));
+        return false;
+    }
+
+    fd = socket(remote->ai_family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        LOGW("Unable to create netplay socket: %s", std::strerror(errno));
+        freeaddrinfo(remote);
+        return false;
+    }
+
+    sockaddr_storage local{};
+    socklen_t localSize;
+    if (remote->ai_family == AF_INET6) {
+        auto *address = reinterpret_cast<sockaddr_in6 *>(&local);
+        address->sin6_family = AF_INET6;
+        address->sin6_addr = in6addr_any;
+        address->sin6_port = htons(localPort);
+        localSize = sizeof(sockaddr_in6);
+    } else {
+        auto *address = reinterpret_cast<sockaddr_in *>(&local);
+        address->sin_family = AF_INET;
+        address->sin_addr.s_addr = htonl(INADDR_ANY);
+        address->sin_port = htons(localPort);
+        localSize = sizeof(sockaddr_in);
+    }
+
+    bool connected = bind(fd, reinterpret_cast<sockaddr *>(&local), localSize) == 0
+            && connect(fd, remote->ai_addr, remote->ai_addrlen) == 0;
+    freeaddrinfo(remote);
+    if (!connected) {
+        LOGW("Unable to connect netplay socket to %s:%u: %s", remoteHost, remotePort, std::strerror(errno));
+        close();
+        return false;
+    }
+    LOGI("Netplay socket on port %u connected to %s:%u", localPort, remoteHost, remotePort);
+    return true;
+}
+
+void UdpTransport::close() {
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+bool UdpTransport::send(const uint8_t *data, size_t size) {
+    if (fd < 0) {
+        return false;
+    }
+    // A full socket buffer drops the datagram, which the protocol recovers from like from a loss
+    return ::send(fd, data, size, MSG_DONTWAIT) == static_cast<ssize_t>(size) || errno == EAGAIN || errno == ECONNREFUSED;
+}
+
+size_t UdpTransport::receive(uint8_t *buffer, size_t capacity) {
+    if (fd < 0) {
+        return 0;
+    }
+    while (true) {
+        ssize_t size = recv(fd, buffer, capacity, MSG_DONTWAIT);
+        if (size > 0) {
+            return static_cast<size_t>(size);
+        }
+        // Connected UDP sockets report ICMP errors of earlier datagrams, e.g. while the peer has
+        // not opened its socket yet. Those do not affect the datagrams which are still queued.
+        if (size < 0 && (errno == ECONNREFUSED || errno == EINTR)) {
+            continue;
+        }
+        return 0;
+    }
+}
@@ -0,0 +1,55 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FB_ANDROID_NETPLAY_UDP_TRANSPORT_H
+#define FB_ANDROID_NETPLAY_UDP_TRANSPORT_H
+
+#include <netplay/transport.h>
+
+namespace FunkyBoyAndroid::Netplay {
+
+    /**
+     * Transport over a non-blocking UDP socket connected to the remote peer.
+     */
+    class UdpTransport: public Transport {
+    private:
+        int fd;
+
+    public:
+        UdpTransport();
+        ~UdpTransport() override;
+
+        UdpTransport(const UdpTransport &) = delete;
+        UdpTransport &operator=(const UdpTransport &) = delete;
+
+        /**
+         * Binds the given local port and connects to the remote peer, which may be given either as
+         * a host name or as an IPv4 or IPv6 address.
+         */
+        bool open(uint16_t localPort, const char *remoteHost, uint16_t remotePort);
+        void close();
+
+        inline bool isOpen() const {
+            return fd >= 0;
+        }
+
+        bool send(const uint8_t *data, size_t size) override;
+        size_t receive(uint8_t *buffer, size_t capacity) override;
+    };
+
+}
+
+#endif //FB_ANDROID_NETPLAY_UDP_TRANSPORT_H
@@ -16,45 +16,23 @@
 
 #include "draw_bitmap.h"
 
-#include <fba_util/logging.h>
+#include <algorithm>
+#include <cstring>
 
-int FunkyBoyAndroid::drawBitmap(JNIEnv *env, ANativeWindow_Buffer &buffer, jobject bitmap, uint u, uint v, uint w, uint h, uint x, uint y) {
-    if (bitmap == nullptr) {
-        return -1;
+void FunkyBoyAndroid::drawBitmap(ANativeWindow_Buffer &buffer, const texture &tex, uint u, uint v, uint w, uint h, uint x, uint y) {
+    if (tex.pixels == nullptr || u >= tex.width || v >= tex.height
+            || x >= static_cast<uint>(buffer.width) || y >= static_cast<uint>(buffer.height)) {
+        return;
     }
-    AndroidBitmapInfo info;
-    if (AndroidBitmap_getInfo(env, bitmap, &info) < 0) {
-        LOGW("Unable to get bitmap info");
-        return -2;
-    }
-    char *data = nullptr;
-    if (AndroidBitmap_lockPixels(env, bitmap, (void **) &data) < 0) {
-        LOGW("Unable to lock pixels");
-        return -3;
-    }
-    if (AndroidBitmap_unlockPixels(env, bitmap) < 0) {
-        LOGW("Unable to unlock pixels");
-        return -4;
-    }
-    auto *bitmapPixes = (int32_t *) data;
-    auto *line = (uint32_t *) buffer.bits + (y * buffer.stride);
-    for (int _y = 0; _y < h; _y++) {
-        for (int _x = 0; _x < w; _x++) {
-            line[x + _x] = bitmapPixes[info.width * (_y + v) + _x + u];
-        }
-        line = line + buffer.stride;
-    }
-    return 0;
-}
+    w = std::min({w, tex.width - u, buffer.width - x});
+    h = std::min({h, tex.height - v, buffer.height - y});
 
-int FunkyBoyAndroid::drawBitmap(JNIEnv *env, ANativeWindow_Buffer &buffer, jobject bitmap, uint x, uint y) {
-    if (bitmap == nullptr) {
-        return -1;
-    }
-    AndroidBitmapInfo info;
-    if (AndroidBitmap_getInfo(env, bitmap, &info) < 0) {
-        LOGW("Unable to get bitmap info");
-        return -2;
+    const uint32_t *src = tex.pixels + (v * tex.stride) + u;
+    auto *dst = static_cast<uint32_t *>(buffer.bits) + (y * buffer.stride) + x;
+    const size_t rowSize = w * sizeof(uint32_t);
+    for (uint row = 0 ; row < h ; row++) {
+        std::memcpy(dst, src, rowSize);
+        src += tex.stride;
+        dst += buffer.stride;
     }
-    return drawBitmap(env, buffer, bitmap, 0, 0, info.width, info.height, x, y);
 }
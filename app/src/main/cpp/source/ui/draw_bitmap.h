@@ -18,15 +18,20 @@
 #define FB_ANDROID_UI_DRAW_BITMAP_H
 
 #include <cstdlib>
-#include <jni.h>
-#include <android/bitmap.h>
 #include <android/native_window.h>
+#include <ui/texture.h>
 
 namespace FunkyBoyAndroid {
 
-    int drawBitmap(JNIEnv *env, ANativeWindow_Buffer &buffer, jobject bitmap, uint x, uint y);
-    int drawBitmap(JNIEnv *env, ANativeWindow_Buffer &buffer, jobject bitmap, uint u, uint v, uint w, uint h, uint x, uint y);
+    /**
+     * Copies a region of a texture into the window buffer, clipped to both the texture and the buffer.
+     */
+    void drawBitmap(ANativeWindow_Buffer &buffer, const texture &tex, uint u, uint v, uint w, uint h, uint x, uint y);
+
+    inline void drawBitmap(ANativeWindow_Buffer &buffer, const texture &tex, uint x, uint y) {
+        drawBitmap(buffer, tex, 0, 0, tex.width, tex.height, x, y);
+    }
 
 }
 
-#endif
\ No newline at end of file
+#endif
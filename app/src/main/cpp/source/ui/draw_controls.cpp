@@ -16,25 +16,14 @@
 
 #include "draw_controls.h"
 
-#include <jni.h>
-#include <fba_util/logging.h>
 #include <ui/draw_bitmap.h>
+#include <fb_app_textures.h>
 
 void FunkyBoyAndroid::drawControls(struct engine* engine, ANativeWindow_Buffer &buffer) {
-    jobject bitmap = engine->bitmapButtons;
-    if (bitmap != nullptr && drawBitmap(engine->env, buffer, bitmap, 0, 0, 50, 50, engine->keyLeft.x, engine->keyUp.y) != 0) {
-        LOGW("Render of DPad failed");
-    }
-    if (bitmap != nullptr && drawBitmap(engine->env, buffer, bitmap, 50, 0, 25, 25, engine->keyA.x, engine->keyA.y) != 0) {
-        LOGW("Render of A key failed");
-    }
-    if (bitmap != nullptr && drawBitmap(engine->env, buffer, bitmap, 50, 25, 25, 25, engine->keyB.x, engine->keyB.y) != 0) {
-        LOGW("Render of B key failed");
-    }
-    if (bitmap != nullptr && drawBitmap(engine->env, buffer, bitmap, 75, 0, 25, 10, engine->keyStart.x, engine->keyStart.y) != 0) {
-        LOGW("Render of start key failed");
-    }
-    if (bitmap != nullptr && drawBitmap(engine->env, buffer, bitmap, 75, 10, 25, 10, engine->keySelect.x, engine->keySelect.y) != 0) {
-        LOGW("Render of select key failed");
-    }
+    const texture &buttons = R::Drawable::buttons;
+    drawBitmap(buffer, buttons, 0, 0, 50, 50, engine->keyLeft.x, engine->keyUp.y);
+    drawBitmap(buffer, buttons, 50, 0, 25, 25, engine->keyA.x, engine->keyA.y);
+    drawBitmap(buffer, buttons, 50, 25, 25, 25, engine->keyB.x, engine->keyB.y);
+    drawBitmap(buffer, buttons, 75, 0, 25, 10, engine->keyStart.x, engine->keyStart.y);
+    drawBitmap(buffer, buttons, 75, 10, 25, 10, engine->keySelect.x, engine->keySelect.y);
 }
\ No newline at end of file
@@ -18,14 +18,18 @@
 #define FB_ANDROID_UI_DRAW_TEXT_H
 
 #include <cstdlib>
-#include <jni.h>
 #include <android/native_window.h>
+#include <ui/texture.h>
 
 #define FBA_CHAR_HEIGHT 8
+#define FBA_GLYPH_COUNT 128
 
 namespace FunkyBoyAndroid {
 
-    int drawTextAt(JNIEnv *env, ANativeWindow_Buffer &buffer, jobject font, const char *text, size_t len, uint x, uint y);
+    /**
+     * Draws text using a font atlas, in which the rows of each glyph are stored contiguously.
+     */
+    void drawTextAt(ANativeWindow_Buffer &buffer, const texture &font, const char *text, size_t len, uint x, uint y);
     size_t measureTextWidth(const char* text, size_t len);
 
     inline size_t lineHeight() {
@@ -0,0 +1,40 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FB_ANDROID_UI_TEXTURE_H
+#define FB_ANDROID_UI_TEXTURE_H
+
+#include <cstdint>
+
+// Texture rows start on cache line boundaries
+#define FB_ANDROID_TEXTURE_ALIGNMENT 64
+
+namespace FunkyBoyAndroid {
+
+    /**
+     * Premultiplied RGBA 8888 pixels of a drawable, baked into the library at build time by
+     * fb_bake_textures(). The stride is given in pixels.
+     */
+    typedef struct {
+        const uint32_t *pixels;
+        uint32_t width;
+        uint32_t height;
+        uint32_t stride;
+    } texture;
+
+}
+
+#endif //FB_ANDROID_UI_TEXTURE_H
@@ -29,7 +29,8 @@
  *
  * Example code:
  *
- * LockFreeQueue<int, 1024> myQueue;
+ * int storage[1024];
+ * LockFreeQueue<int, 1024> myQueue(storage);
  * int value = 123;
  * myQueue.push(value);
  * myQueue.pop(value);
@@ -64,6 +65,11 @@ public:
     static_assert(isPowerOfTwo(CAPACITY), "Capacity must be a power of 2");
     static_assert(std::is_unsigned<INDEX_TYPE>::value, "Index type must be unsigned");
 
+    /**
+     * @param storage - CAPACITY items owned by the caller, which have to outlive the queue
+     */
+    explicit LockFreeQueue(T *storage): buffer(storage) {}
+
     /**
      * Pop a value off the head of the queue
      *
@@ -147,7 +153,7 @@ private:
 
     inline INDEX_TYPE mask(INDEX_TYPE n) const { return static_cast<INDEX_TYPE>(n & (CAPACITY - 1)); }
 
-    T buffer[CAPACITY];
+    T *buffer;
     std::atomic<INDEX_TYPE> writeCounter { 0 };
     std::atomic<INDEX_TYPE> readCounter { 0 };
 
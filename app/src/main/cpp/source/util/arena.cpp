@@ -0,0 +1,133 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "arena.h"
+
+#include <fba_util/logging.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace FunkyBoyAndroid::Util;
+
+namespace {
+
+    const char *tagNames[] = {
+            "display",
+            "audio",
+            "battery save",
+            "snapshots",
+            "ROM",
+            "capture",
+    };
+
+    static_assert(sizeof(tagNames) / sizeof(tagNames[0]) == static_cast<size_t>(ArenaTag::Count), "Every arena tag needs a name");
+
+    inline size_t alignUp(size_t value, size_t alignment) {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+
+}
+
+Arena::Arena(size_t cap)
+    : base(nullptr)
+    , capacity(0)
+    , usage{}
+{
+    cap = alignUp(cap, sysconf(_SC_PAGESIZE));
+    // Pages only get committed once touched, so a generous reservation costs no memory
+    void *mapping = mmap(nullptr, cap, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mapping == MAP_FAILED) {
+        LOGE("Unable to reserve an arena of %zu bytes: %s", cap, std::strerror(errno));
+        return;
+    }
+    base = static_cast<char *>(mapping);
+    capacity = cap;
+    usage.capacity = cap;
+}
+
+Arena::~Arena() {
+    if (base != nullptr) {
+        munmap(base, capacity);
+    }
+}
+
+void *Arena::allocate(size_t size, ArenaTag tag) {
+    static const size_t pageSize = sysconf(_SC_PAGESIZE);
+    size_t alignment = size >= pageSize ? pageSize : FB_ANDROID_CACHE_LINE_SIZE;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t offset = alignUp(usage.used, alignment);
+    if (base == nullptr || offset + size > capacity) {
+        LOGE("Arena exhausted, cannot allocate %zu bytes for %s (%zu of %zu bytes used)", size,
+                getArenaTagName(tag), usage.used, capacity);
+        return nullptr;
+    }
+    usage.used = offset + size;
+    usage.bytes[static_cast<size_t>(tag)] += size;
+    // Anonymous mappings are zero-filled already
+    return base + offset;
+}
+
+void Arena::setExternal(ArenaTag tag, size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    usage.external[static_cast<size_t>(tag)] = bytes;
+}
+
+arena_usage Arena::getUsage() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return usage;
+}
+
+void Arena::logUsage(const char *name) {
+    arena_usage snapshot = getUsage();
+    LOGI("Memory of %s: %zu of %zu KiB used", name, snapshot.used / 1024, snapshot.capacity / 1024);
+    for (size_t i = 0 ; i < static_cast<size_t>(ArenaTag::Count) ; i++) {
+        if (snapshot.bytes[i] > 0 || snapshot.external[i] > 0) {
+            LOGI("  %s: %zu KiB, %zu KiB outside of the arena", tagNames[i], snapshot.bytes[i] / 1024, snapshot.external[i] / 1024);
+        }
+    }
+#ifdef FB_DEBUG
+    process_memory process = getProcessMemory();
+    LOGI("Process RSS: %zu KiB, peak %zu KiB", process.rss / 1024, process.peakRss / 1024);
+#endif
+}
+
+process_memory FunkyBoyAndroid::Util::getProcessMemory() {
+    process_memory memory{};
+    FILE *file = std::fopen("/proc/self/status", "re");
+    if (file == nullptr) {
+        return memory;
+    }
+    char line[128];
+    size_t kib;
+    while (std::fgets(line, sizeof(line), file) != nullptr) {
+        if (std::sscanf(line, "VmRSS: %zu kB", &kib) == 1) {
+            memory.rss = kib * 1024;
+        } else if (std::sscanf(line, "VmHWM: %zu kB", &kib) == 1) {
+            memory.peakRss = kib * 1024;
+        }
+    }
+    std::fclose(file);
+    return memory;
+}
+
+const char *FunkyBoyAndroid::Util::getArenaTagName(ArenaTag tag) {
+    return tagNames[static_cast<size_t>(tag)];
+}
@@ -0,0 +1,105 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FB_ANDROID_UTIL_ARENA_H
+#define FB_ANDROID_UTIL_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+#define FB_ANDROID_CACHE_LINE_SIZE 64
+
+namespace FunkyBoyAndroid::Util {
+
+    enum class ArenaTag: uint8_t {
+        Display = 0,
+        Audio,
+        BatterySave,
+        Snapshot,
+        ROM,
+        Capture,
+        Count
+    };
+
+    struct arena_usage {
+        // Reserved address space, only pages which have been touched count towards the RSS
+        size_t capacity;
+        // Allocated so far, including alignment padding
+        size_t used;
+        size_t bytes[static_cast<size_t>(ArenaTag::Count)];
+        // Memory attributed to the owner without living in the arena, e.g. shared file mappings
+        size_t external[static_cast<size_t>(ArenaTag::Count)];
+    };
+
+    struct process_memory {
+        size_t rss;
+        size_t peakRss;
+    };
+
+    /**
+     * Fixed-size region holding the long-lived buffers of one owner, with per-subsystem accounting.
+     *
+     * The whole region is reserved once. Allocations are carved out of it in order and are only
+     * released together with the arena, so each buffer should be allocated once and reused.
+     * Allocations of at least a page are page-aligned, all others are aligned to cache lines, so
+     * that buffers of different threads never share a cache line.
+     */
+    class Arena {
+    private:
+        char *base;
+        size_t capacity;
+
+        std::mutex mutex;
+        arena_usage usage;
+
+    public:
+        explicit Arena(size_t capacity);
+        ~Arena();
+
+        Arena(const Arena &) = delete;
+        Arena &operator=(const Arena &) = delete;
+
+        /**
+         * @return zero-initialized memory, or nullptr if the arena is exhausted
+         */
+        void *allocate(size_t size, ArenaTag tag);
+
+        template<typename T>
+        inline T *allocateArray(size_t count, ArenaTag tag) {
+            return static_cast<T *>(allocate(count * sizeof(T), tag));
+        }
+
+        /**
+         * Sets the amount of memory used by the given subsystem outside of the arena.
+         */
+        void setExternal(ArenaTag tag, size_t bytes);
+
+        arena_usage getUsage();
+
+        void logUsage(const char *name);
+    };
+
+    /**
+     * Reads the current and the peak resident set size of this process.
+     */
+    process_memory getProcessMemory();
+
+    const char *getArenaTagName(ArenaTag tag);
+
+}
+
+#endif //FB_ANDROID_UTIL_ARENA_H
@@ -0,0 +1,56 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FB_ANDROID_UTIL_BYTE_BUFFER_H
+#define FB_ANDROID_UTIL_BYTE_BUFFER_H
+
+#include <streambuf>
+#include <cstddef>
+
+namespace FunkyBoyAndroid::Util {
+
+    /**
+     * Output stream buffer writing into a fixed, caller-owned memory region.
+     * In contrast to FunkyBoy::Util::membuf, this keeps track of the amount of bytes written so far.
+     * Writes beyond the capacity fail instead of reallocating.
+     */
+    class byte_buffer: public std::streambuf {
+    public:
+        byte_buffer(char *data, size_t capacity) {
+            setp(data, data + capacity);
+        }
+
+        inline size_t size() const {
+            return pptr() - pbase();
+        }
+
+        inline bool overflowed() const {
+            return overflowedFlag;
+        }
+
+    protected:
+        int_type overflow(int_type ch) override {
+            overflowedFlag = true;
+            return traits_type::eof();
+        }
+
+    private:
+        bool overflowedFlag = false;
+    };
+
+}
+
+#endif //FB_ANDROID_UTIL_BYTE_BUFFER_H
@@ -0,0 +1,72 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cpu_features.h"
+
+#if defined(__aarch64__) || defined(__arm__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#elif defined(__i386__) || defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
+namespace {
+
+    uint32_t detectCpuFeatures() {
+        uint32_t features = 0;
+#if defined(__aarch64__)
+        if (getauxval(AT_HWCAP) & HWCAP_ASIMD) {
+            features |= FB_ANDROID_CPU_NEON;
+        }
+#elif defined(__arm__)
+        // NEON is optional on ARMv7, some older devices (e.g. Tegra 2) do not have it
+        if (getauxval(AT_HWCAP) & HWCAP_NEON) {
+            features |= FB_ANDROID_CPU_NEON;
+        }
+#elif defined(__i386__) || defined(__x86_64__)
+        unsigned int eax, ebx, ecx, edx;
+        if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+            return features;
+        }
+        if (ecx & bit_SSSE3) {
+            features |= FB_ANDROID_CPU_SSSE3;
+        }
+        if (ecx & bit_SSE4_1) {
+            features |= FB_ANDROID_CPU_SSE41;
+        }
+        // AVX2 additionally requires the OS to save the YMM registers on context switches
+        bool osSavesYmm = false;
+        if ((ecx & bit_OSXSAVE) && (ecx & bit_AVX)) {
+            unsigned int xcr0Low, xcr0High;
+            __asm__ ("xgetbv" : "=a" (xcr0Low), "=d" (xcr0High) : "c" (0));
+            osSavesYmm = (xcr0Low & 0x6u) == 0x6u;
+        }
+        if (osSavesYmm && __get_cpuid_max(0, nullptr) >= 7) {
+            __cpuid_count(7, 0, eax, ebx, ecx, edx);
+            if (ebx & bit_AVX2) {
+                features |= FB_ANDROID_CPU_AVX2;
+            }
+        }
+#endif
+        return features;
+    }
+
+}
+
+uint32_t FunkyBoyAndroid::Util::getCpuFeatures() {
+    static const uint32_t features = detectCpuFeatures();
+    return features;
+}
@@ -0,0 +1,37 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FB_ANDROID_UTIL_CPU_FEATURES_H
+#define FB_ANDROID_UTIL_CPU_FEATURES_H
+
+#include <cstdint>
+
+#define FB_ANDROID_CPU_NEON (1u << 0u)
+#define FB_ANDROID_CPU_SSSE3 (1u << 1u)
+#define FB_ANDROID_CPU_SSE41 (1u << 2u)
+#define FB_ANDROID_CPU_AVX2 (1u << 3u)
+
+namespace FunkyBoyAndroid::Util {
+
+    /**
+     * Returns the FB_ANDROID_CPU_* features supported by the CPU and the OS, detected through
+     * getauxval on ARM and cpuid on x86. The result is computed once and cached.
+     */
+    uint32_t getCpuFeatures();
+
+}
+
+#endif //FB_ANDROID_UTIL_CPU_FEATURES_H
@@ -0,0 +1,43 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FB_ANDROID_UTIL_HASH_H
+#define FB_ANDROID_UTIL_HASH_H
+
+#include <cstdint>
+#include <cstddef>
+
+#define FB_ANDROID_FNV1A64_OFFSET 0xcbf29ce484222325ull
+#define FB_ANDROID_FNV1A64_PRIME 0x100000001b3ull
+
+namespace FunkyBoyAndroid::Util {
+
+    /**
+     * 64 bit FNV-1a hash. Not cryptographically secure, only used to cheaply detect changes in
+     * memory regions.
+     */
+    inline uint64_t fnv1a64(const void *data, size_t len, uint64_t hash = FB_ANDROID_FNV1A64_OFFSET) {
+        auto *bytes = static_cast<const uint8_t *>(data);
+        for (size_t i = 0 ; i < len ; i++) {
+            hash ^= bytes[i];
+            hash *= FB_ANDROID_FNV1A64_PRIME;
+        }
+        return hash;
+    }
+
+}
+
+#endif //FB_ANDROID_UTIL_HASH_H
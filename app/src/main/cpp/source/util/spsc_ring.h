@@ -0,0 +1,98 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FB_ANDROID_UTIL_SPSC_RING_H
+#define FB_ANDROID_UTIL_SPSC_RING_H
+
+#include <atomic>
+#include <cstdint>
+#include <util/arena.h>
+
+namespace FunkyBoyAndroid::Util {
+
+    /**
+     * Single-producer, single-consumer ring of slots which are filled and read in place.
+     *
+     * Unlike LockFreeQueue, items are never copied: the producer fills the slot returned by
+     * beginWrite() and publishes it with commitWrite(), the consumer reads the slot returned by
+     * beginRead() and hands it back with commitRead(). Neither side ever blocks.
+     *
+     * @tparam CAPACITY amount of slots, must be a power of 2
+     */
+    template <typename T, uint32_t CAPACITY>
+    class SpscRing {
+    private:
+        static_assert((CAPACITY & (CAPACITY - 1)) == 0, "Capacity must be a power of 2");
+
+        T *slots;
+        alignas(FB_ANDROID_CACHE_LINE_SIZE) std::atomic<uint32_t> writeCounter;
+        alignas(FB_ANDROID_CACHE_LINE_SIZE) std::atomic<uint32_t> readCounter;
+
+    public:
+        /**
+         * @param storage CAPACITY slots owned by the caller, which have to outlive the ring
+         */
+        explicit SpscRing(T *storage)
+            : slots(storage)
+            , writeCounter(0)
+            , readCounter(0)
+        {
+        }
+
+        /**
+         * @return the next free slot, or nullptr if the consumer has fallen behind. Producer only.
+         */
+        inline T *beginWrite() {
+            uint32_t write = writeCounter.load(std::memory_order_relaxed);
+            if (write - readCounter.load(std::memory_order_acquire) == CAPACITY) {
+                return nullptr;
+            }
+            return &slots[write & (CAPACITY - 1)];
+        }
+
+        /**
+         * Publishes the slot returned by the last call to beginWrite(). Producer only.
+         */
+        inline void commitWrite() {
+            writeCounter.store(writeCounter.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        /**
+         * @return the oldest published slot, or nullptr if there is none. Consumer only.
+         */
+        inline T *beginRead() {
+            uint32_t read = readCounter.load(std::memory_order_relaxed);
+            if (read == writeCounter.load(std::memory_order_acquire)) {
+                return nullptr;
+            }
+            return &slots[read & (CAPACITY - 1)];
+        }
+
+        /**
+         * Hands the slot returned by the last call to beginRead() back to the producer. Consumer only.
+         */
+        inline void commitRead() {
+            readCounter.store(readCounter.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        inline bool isEmpty() const {
+            return readCounter.load(std::memory_order_acquire) == writeCounter.load(std::memory_order_acquire);
+        }
+    };
+
+}
+
+#endif //FB_ANDROID_UTIL_SPSC_RING_H
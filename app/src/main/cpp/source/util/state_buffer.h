@@ -0,0 +1,106 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FB_ANDROID_UTIL_STATE_BUFFER_H
+#define FB_ANDROID_UTIL_STATE_BUFFER_H
+
+#include <streambuf>
+#include <cstddef>
+#include <cstring>
+
+namespace FunkyBoyAndroid::Util {
+
+    /**
+     * Stream buffer over a fixed, caller-owned memory region, which is written and read back over
+     * and over, e.g. for a snapshot per frame. It stays bound to the same streams, so that neither
+     * buffers nor streams have to be set up per snapshot, and copies whole blocks instead of
+     * single characters.
+     */
+    class state_buffer: public std::streambuf {
+    public:
+        state_buffer()
+            : state_buffer(nullptr, 0)
+        {
+        }
+
+        state_buffer(char *data, size_t capacity)
+            : data(data)
+            , capacity(capacity)
+            , overflowedFlag(false)
+        {
+            rewindWrite();
+        }
+
+        /**
+         * Discards the content, and starts writing from the beginning
+         */
+        inline void rewindWrite() {
+            setp(data, data + capacity);
+            setg(data, data, data);
+            overflowedFlag = false;
+        }
+
+        /**
+         * Starts reading back what has been written since the last rewindWrite()
+         */
+        inline void rewindRead() {
+            setg(data, data, pptr());
+        }
+
+        inline size_t size() const {
+            return pptr() - pbase();
+        }
+
+        inline bool overflowed() const {
+            return overflowedFlag;
+        }
+
+    protected:
+        std::streamsize xsputn(const char *s, std::streamsize n) override {
+            std::streamsize available = epptr() - pptr();
+            if (n > available) {
+                overflowedFlag = true;
+                n = available;
+            }
+            std::memcpy(pptr(), s, n);
+            pbump(static_cast<int>(n));
+            return n;
+        }
+
+        int_type overflow(int_type ch) override {
+            overflowedFlag = true;
+            return traits_type::eof();
+        }
+
+        std::streamsize xsgetn(char *s, std::streamsize n) override {
+            std::streamsize available = egptr() - gptr();
+            if (n > available) {
+                n = available;
+            }
+            std::memcpy(s, gptr(), n);
+            gbump(static_cast<int>(n));
+            return n;
+        }
+
+    private:
+        char *data;
+        size_t capacity;
+        bool overflowedFlag;
+    };
+
+}
+
+#endif //FB_ANDROID_UTIL_STATE_BUFFER_H
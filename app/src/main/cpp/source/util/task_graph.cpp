@@ -0,0 +1,129 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "task_graph.h"
+
+#include <fba_util/logging.h>
+
+using namespace FunkyBoyAndroid::Util;
+
+TaskGraph::TaskGraph(WorkStealingPool &pool)
+    : pool(pool)
+    , remaining(0)
+    , started(false)
+{
+}
+
+TaskGraph::~TaskGraph() {
+    if (started) {
+        waitAll();
+    }
+}
+
+TaskGraph::task_id TaskGraph::add(const char *name, task work, std::initializer_list<task_id> dependencies) {
+    task_id id = nodes.size();
+    auto &n = nodes.emplace_back();
+    n.name = name;
+    n.work = std::move(work);
+    n.done = false;
+    size_t count = 0;
+    for (task_id dependency : dependencies) {
+        if (dependency == FB_ANDROID_TASK_NONE) {
+            continue;
+        }
+        nodes[dependency].dependents.push_back(id);
+        count++;
+    }
+    n.dependencies = count;
+    return id;
+}
+
+void TaskGraph::start() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        started = true;
+        remaining = nodes.size();
+    }
+    for (task_id id = 0 ; id < nodes.size() ; id++) {
+        if (nodes[id].dependencies == 0) {
+            schedule(id, SIZE_MAX);
+        }
+    }
+}
+
+void TaskGraph::schedule(task_id id, size_t worker) {
+    pool.push([this, id](WorkStealingPool &, size_t w) {
+        run(id, w);
+    }, worker);
+}
+
+void TaskGraph::run(task_id id, size_t worker) {
+    auto &n = nodes[id];
+    n.started = std::chrono::steady_clock::now();
+    n.work();
+    n.work = nullptr;
+    n.finished = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        n.done.store(true, std::memory_order_release);
+        doneCondition.notify_all();
+    }
+
+    for (task_id dependent : n.dependents) {
+        if (nodes[dependent].dependencies.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            // Queued locally, as the dependent most likely works on what this task has just produced
+            schedule(dependent, worker);
+        }
+    }
+
+    // Counted last, so that the graph is not destroyed while dependents are still being queued
+    std::lock_guard<std::mutex> lock(mutex);
+    remaining--;
+    doneCondition.notify_all();
+}
+
+bool TaskGraph::isDone(task_id id) const {
+    return id == FB_ANDROID_TASK_NONE || nodes[id].done.load(std::memory_order_acquire);
+}
+
+void TaskGraph::wait(task_id id) {
+    if (isDone(id)) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    doneCondition.wait(lock, [this, id]{ return isDone(id); });
+}
+
+void TaskGraph::waitAll() {
+    std::unique_lock<std::mutex> lock(mutex);
+    doneCondition.wait(lock, [this]{ return remaining == 0; });
+}
+
+void TaskGraph::logTimings(std::chrono::steady_clock::time_point origin) const {
+    for (auto &n : nodes) {
+        if (!n.done.load(std::memory_order_acquire)) {
+            LOGD("Task %s: pending", n.name);
+            continue;
+        }
+#ifdef FB_DEBUG
+        auto started = std::chrono::duration_cast<std::chrono::microseconds>(n.started - origin).count();
+        auto finished = std::chrono::duration_cast<std::chrono::microseconds>(n.finished - origin).count();
+        LOGD("Task %s: %lld.%03lld - %lld.%03lld ms", n.name,
+             static_cast<long long>(started / 1000), static_cast<long long>(started % 1000),
+             static_cast<long long>(finished / 1000), static_cast<long long>(finished % 1000));
+#endif
+    }
+}
@@ -0,0 +1,113 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FB_ANDROID_UTIL_TASK_GRAPH_H
+#define FB_ANDROID_UTIL_TASK_GRAPH_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <mutex>
+#include <vector>
+#include <util/work_stealing_pool.h>
+
+#define FB_ANDROID_TASK_NONE SIZE_MAX
+
+namespace FunkyBoyAndroid::Util {
+
+    /**
+     * Set of tasks with dependencies between them, executed on a WorkStealingPool.
+     *
+     * All tasks are added before start() gets called. A task gets queued as soon as all of its
+     * dependencies have finished, on the worker which finished the last of them. As dependencies
+     * can only refer to tasks added earlier, the graph is acyclic by construction.
+     */
+    class TaskGraph {
+    public:
+        typedef size_t task_id;
+        typedef std::function<void()> task;
+
+    private:
+        struct node {
+            const char *name;
+            task work;
+            std::vector<task_id> dependents;
+            std::atomic<size_t> dependencies;
+            std::atomic<bool> done;
+            std::chrono::steady_clock::time_point started;
+            std::chrono::steady_clock::time_point finished;
+        };
+
+        WorkStealingPool &pool;
+        // A deque never moves its elements, so that workers can hold on to nodes while tasks get added
+        std::deque<node> nodes;
+        std::mutex mutex;
+        std::condition_variable doneCondition;
+        size_t remaining;
+        bool started;
+
+        void schedule(task_id id, size_t worker);
+        void run(task_id id, size_t worker);
+
+    public:
+        explicit TaskGraph(WorkStealingPool &pool);
+
+        /**
+         * Waits for all tasks which have been started.
+         */
+        ~TaskGraph();
+
+        TaskGraph(const TaskGraph &) = delete;
+        TaskGraph &operator=(const TaskGraph &) = delete;
+
+        /**
+         * Adds a task which runs once all of the given tasks have finished. Must not be called
+         * after start().
+         *
+         * @param name static string identifying the task in logTimings()
+         */
+        task_id add(const char *name, task work, std::initializer_list<task_id> dependencies = {});
+
+        /**
+         * Queues all tasks without dependencies.
+         */
+        void start();
+
+        /**
+         * @return true if the given task has finished, or if id is FB_ANDROID_TASK_NONE
+         */
+        bool isDone(task_id id) const;
+
+        /**
+         * Blocks until the given task has finished. Returns immediately for FB_ANDROID_TASK_NONE.
+         */
+        void wait(task_id id);
+
+        void waitAll();
+
+        /**
+         * Logs when each finished task has started and ended, relative to the given origin.
+         */
+        void logTimings(std::chrono::steady_clock::time_point origin) const;
+    };
+
+}
+
+#endif //FB_ANDROID_UTIL_TASK_GRAPH_H
@@ -0,0 +1,118 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "work_stealing_pool.h"
+
+using namespace FunkyBoyAndroid::Util;
+
+WorkStealingPool::WorkStealingPool(size_t threadCount)
+    : pending(0)
+    , nextQueue(0)
+    , queued(0)
+    , stopping(false)
+{
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (size_t i = 0 ; i < threadCount ; i++) {
+        queues.push_back(std::make_unique<worker_queue>());
+    }
+    for (size_t i = 0 ; i < threadCount ; i++) {
+        threads.emplace_back(&WorkStealingPool::run, this, i);
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    {
+        std::lock_guard<std::mutex> lock(idleMutex);
+        stopping = true;
+    }
+    workCondition.notify_all();
+    for (auto &thread : threads) {
+        thread.join();
+    }
+}
+
+void WorkStealingPool::push(task t, size_t worker) {
+    if (worker >= queues.size()) {
+        // External submissions are distributed round robin
+        worker = nextQueue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+    }
+    pending.fetch_add(1, std::memory_order_acq_rel);
+    {
+        std::lock_guard<std::mutex> lock(queues[worker]->mutex);
+        queues[worker]->tasks.push_back(std::move(t));
+    }
+    {
+        // Counting under the lock avoids lost wake-ups of workers about to go to sleep
+        std::lock_guard<std::mutex> lock(idleMutex);
+        queued++;
+    }
+    workCondition.notify_one();
+}
+
+bool WorkStealingPool::popLocal(size_t worker, task &t) {
+    auto &queue = *queues[worker];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) {
+        return false;
+    }
+    t = std::move(queue.tasks.back());
+    queue.tasks.pop_back();
+    return true;
+}
+
+bool WorkStealingPool::steal(size_t worker, task &t) {
+    for (size_t i = 1 ; i < queues.size() ; i++) {
+        auto &queue = *queues[(worker + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            t = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::run(size_t worker) {
+    task t;
+    while (true) {
+        if (popLocal(worker, t) || steal(worker, t)) {
+            {
+                std::lock_guard<std::mutex> lock(idleMutex);
+                queued--;
+            }
+            t(*this, worker);
+            t = nullptr;
+            if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                std::lock_guard<std::mutex> lock(idleMutex);
+                doneCondition.notify_all();
+            }
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(idleMutex);
+        workCondition.wait(lock, [this]{ return stopping || queued > 0; });
+        if (stopping) {
+            return;
+        }
+    }
+}
+
+void WorkStealingPool::wait() {
+    std::unique_lock<std::mutex> lock(idleMutex);
+    doneCondition.wait(lock, [this]{ return pending.load(std::memory_order_acquire) == 0; });
+}
@@ -0,0 +1,85 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FB_ANDROID_UTIL_WORK_STEALING_POOL_H
+#define FB_ANDROID_UTIL_WORK_STEALING_POOL_H
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+
+namespace FunkyBoyAndroid::Util {
+
+    /**
+     * Small fixed-size thread pool in which each worker owns a task deque.
+     * Workers take tasks from the back of their own deque and steal from the front of the deques
+     * of other workers when they run out of work. Tasks may push further tasks while running.
+     */
+    class WorkStealingPool {
+    public:
+        typedef std::function<void(WorkStealingPool &pool, size_t worker)> task;
+
+    private:
+        struct worker_queue {
+            std::mutex mutex;
+            std::deque<task> tasks;
+        };
+
+        std::vector<std::unique_ptr<worker_queue>> queues;
+        std::vector<std::thread> threads;
+        std::atomic<size_t> pending;
+        std::atomic<size_t> nextQueue;
+        std::mutex idleMutex;
+        std::condition_variable workCondition;
+        std::condition_variable doneCondition;
+        size_t queued;
+        bool stopping;
+
+        bool popLocal(size_t worker, task &t);
+        bool steal(size_t worker, task &t);
+        void run(size_t worker);
+
+    public:
+        /**
+         * @param threadCount amount of worker threads, 0 to use all available cores
+         */
+        explicit WorkStealingPool(size_t threadCount = 0);
+        ~WorkStealingPool();
+
+        inline size_t size() const {
+            return queues.size();
+        }
+
+        /**
+         * Adds a task. When called from a running task, pass the worker index given to the task so
+         * that the new task is queued locally.
+         */
+        void push(task t, size_t worker = SIZE_MAX);
+
+        /**
+         * Blocks until all tasks, including tasks pushed by other tasks, have finished.
+         */
+        void wait();
+    };
+
+}
+
+#endif //FB_ANDROID_UTIL_WORK_STEALING_POOL_H
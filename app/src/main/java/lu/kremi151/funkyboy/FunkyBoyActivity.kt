@@ -17,19 +17,25 @@
 package lu.kremi151.funkyboy
 
 import android.Manifest
+import android.app.AlertDialog
 import android.app.NativeActivity
 import android.content.Intent
 import android.content.pm.PackageManager
-import android.graphics.Bitmap
-import android.graphics.BitmapFactory
+import android.os.Bundle
 import android.os.Environment
 import android.util.Log
+import android.view.KeyEvent
 import android.widget.Toast
 import androidx.core.app.ActivityCompat
 import androidx.core.content.ContextCompat
 import com.nbsp.materialfilepicker.MaterialFilePicker
 import com.nbsp.materialfilepicker.ui.FilePickerActivity
 import java.io.File
+import java.text.SimpleDateFormat
+import java.util.Date
+import java.util.Locale
+import java.util.concurrent.ExecutorService
+import java.util.concurrent.Executors
 import java.util.regex.Pattern
 
 class FunkyBoyActivity: NativeActivity() {
@@ -37,6 +43,36 @@ class FunkyBoyActivity: NativeActivity() {
     companion object {
         const val REQUEST_CODE_PICK_ROM = 186
         const val REQUEST_CODE_ASK_READ_STORAGE_PERMISSIONS = 187
+        const val REQUEST_CODE_PICK_MOVIE = 188
+
+        // Replays the given movie headlessly on start, used by tools/perf.sh with benchmark builds
+        const val EXTRA_VERIFY_MOVIE = "lu.kremi151.funkyboy.VERIFY_MOVIE"
+
+        const val STATE_SLOTS = 4
+        private val SPEEDS = floatArrayOf(0.5f, 1.0f, 2.0f, 4.0f)
+        // FB_ANDROID_RUN_AHEAD_MAX_FRAMES in fba_util/run_ahead.h
+        const val RUN_AHEAD_MAX_FRAMES = 4
+
+        // Joypad keys as FBA_KEY_* bits, see engine/hit_map.h
+        private val MAPPABLE_KEYS = listOf(
+                R.string.key_up to 0b00100000,
+                R.string.key_down to 0b10000000,
+                R.string.key_left to 0b00010000,
+                R.string.key_right to 0b01000000,
+                R.string.key_a to 0b00000001,
+                R.string.key_b to 0b00000010,
+                R.string.key_start to 0b00000100,
+                R.string.key_select to 0b00001000
+        )
+
+        private const val PREFERENCES = "funkyboy"
+        private const val PREF_PALETTE = "palette"
+        private const val PREF_RUN_AHEAD = "run_ahead"
+        // Followed by the Android key code, mapped to FBA_KEY_* bits
+        private const val PREF_KEY_PREFIX = "key_"
+
+        // Scans replace the same index file, so they must never overlap
+        private val libraryExecutor: ExecutorService = Executors.newSingleThreadExecutor()
 
         init {
             System.loadLibrary("fb_android")
@@ -44,19 +80,235 @@ class FunkyBoyActivity: NativeActivity() {
     }
 
     private var awaitingPickRomResult = false
-    private var lastBackPressed = 0L
 
-    private external fun romPicked(path: String)
+    // Commands taking a path return false if the path is too long to be handled
+    private external fun romPicked(path: String): Boolean
+    // Returns the title and path of each ROM found, alternating
+    private external fun scanLibrary(indexPath: String, directories: Array<String>): Array<String>?
+    private external fun saveSlot(slot: Int)
+    private external fun loadSlot(slot: Int)
+    private external fun setPaused(paused: Boolean)
+    private external fun setSpeed(speed: Float)
+    private external fun setPalette(palette: Int)
+    private external fun recordMovie(path: String): Boolean
+    private external fun stopMovie()
+    private external fun playMovie(path: String): Boolean
+    // Only implemented by benchmark builds
+    private external fun verifyMovie(path: String): Boolean
+    private external fun mapKey(keyCode: Int, keys: Int)
+    // Presents the frame this many frames ahead, hiding input lag of games
+    private external fun setRunAhead(frames: Int)
+    // Writes <basePath>.y4m and <basePath>.wav
+    private external fun startCapture(basePath: String): Boolean
+    private external fun stopCapture()
+    private external fun takeScreenshot(path: String): Boolean
+
+    override fun onCreate(savedInstanceState: Bundle?) {
+        super.onCreate(savedInstanceState)
+        // Commands are queued until the native side is ready for them
+        val preferences = getSharedPreferences(PREFERENCES, MODE_PRIVATE)
+        setPalette(preferences.getInt(PREF_PALETTE, 0))
+        setRunAhead(preferences.getInt(PREF_RUN_AHEAD, 0))
+        for ((name, keys) in preferences.all) {
+            if (name.startsWith(PREF_KEY_PREFIX) && keys is Int) {
+                mapKey(name.removePrefix(PREF_KEY_PREFIX).toInt(), keys)
+            }
+        }
+        if (BuildConfig.BENCHMARK) {
+            intent.getStringExtra(EXTRA_VERIFY_MOVIE)?.let { verifyMovie(it) }
+        }
+    }
+
+    private fun checkPathAccepted(accepted: Boolean, path: String): Boolean {
+        if (!accepted) {
+            Toast.makeText(this, getString(R.string.path_too_long, path), Toast.LENGTH_LONG).show()
+        }
+        return accepted
+    }
 
     private fun pickRom() {
         MaterialFilePicker()
                 .withActivity(this)
                 .withCloseMenu(true)
-                .withFilter(Pattern.compile(".*\\.(gb|bin)$"))
+                .withFilter(Pattern.compile(".*\\.(gb|bin|zip|gz)$"))
                 .withRequestCode(REQUEST_CODE_PICK_ROM)
                 .start()
     }
 
+    private fun libraryDirectories(): List<File> {
+        @Suppress("DEPRECATION")
+        return listOf(
+                Environment.getExternalStoragePublicDirectory(Environment.DIRECTORY_DOWNLOADS),
+                File(Environment.getExternalStorageDirectory(), "ROMs")
+        ).filter { it.isDirectory }
+    }
+
+    private fun showLibrary() {
+        val indexPath = File(filesDir, "library.idx").absolutePath
+        val directories = libraryDirectories().map { it.absolutePath }.toTypedArray()
+        libraryExecutor.execute {
+            val roms = scanLibrary(indexPath, directories)?.toList()?.chunked(2) ?: emptyList()
+            Log.d("funkyboy", "ROM library contains ${roms.size} ROMs")
+            runOnUiThread {
+                if (isFinishing) {
+                    awaitingPickRomResult = false
+                    return@runOnUiThread
+                }
+                if (roms.isEmpty()) {
+                    pickRom()
+                    return@runOnUiThread
+                }
+                val labels = roms.map { (title, path) -> if (title.isBlank()) File(path).name else title } +
+                        getString(R.string.library_browse)
+                AlertDialog.Builder(this)
+                        .setTitle(R.string.library_title)
+                        .setItems(labels.toTypedArray()) { _, which ->
+                            if (which < roms.size) {
+                                awaitingPickRomResult = false
+                                checkPathAccepted(romPicked(roms[which][1]), roms[which][1])
+                            } else {
+                                pickRom()
+                            }
+                        }
+                        .setOnCancelListener { awaitingPickRomResult = false }
+                        .show()
+            }
+        }
+    }
+
+    private fun outputDirectory(name: String): File {
+        val directory = File(getExternalFilesDir(null) ?: filesDir, name)
+        directory.mkdirs()
+        return directory
+    }
+
+    private fun movieDirectory(): File {
+        return outputDirectory("movies")
+    }
+
+    private fun timestamp(): String {
+        return SimpleDateFormat("yyyyMMdd-HHmmss", Locale.US).format(Date())
+    }
+
+    private fun startCapturing() {
+        val base = File(outputDirectory("captures"), timestamp())
+        if (checkPathAccepted(startCapture(base.absolutePath), base.absolutePath)) {
+            Toast.makeText(this, getString(R.string.capturing_to, base.name), Toast.LENGTH_SHORT).show()
+        }
+    }
+
+    private fun takeScreenshotNow() {
+        val screenshot = File(outputDirectory("screenshots"), "${timestamp()}.png")
+        if (checkPathAccepted(takeScreenshot(screenshot.absolutePath), screenshot.absolutePath)) {
+            Toast.makeText(this, getString(R.string.screenshot_saved, screenshot.name), Toast.LENGTH_SHORT).show()
+        }
+    }
+
+    private fun startRecordingMovie() {
+        val movie = File(movieDirectory(), "${timestamp()}.fbm")
+        if (checkPathAccepted(recordMovie(movie.absolutePath), movie.absolutePath)) {
+            Toast.makeText(this, getString(R.string.recording_movie, movie.name), Toast.LENGTH_SHORT).show()
+        }
+    }
+
+    private fun pickMovie() {
+        MaterialFilePicker()
+                .withActivity(this)
+                .withCloseMenu(true)
+                .withRootPath(movieDirectory().absolutePath)
+                .withFilter(Pattern.compile(".*\\.fbm$"))
+                .withRequestCode(REQUEST_CODE_PICK_MOVIE)
+                .start()
+    }
+
+    /**
+     * Shows a list to choose from, while the emulation is paused.
+     */
+    private fun showChoice(title: Int, items: List<String>, onChoice: (Int) -> Unit) {
+        setPaused(true)
+        AlertDialog.Builder(this)
+                .setTitle(title)
+                .setItems(items.toTypedArray()) { _, which -> onChoice(which) }
+                .setOnDismissListener { setPaused(false) }
+                .show()
+    }
+
+    private fun stateSlots(): List<String> {
+        return (1..STATE_SLOTS).map { getString(R.string.state_slot, it) }
+    }
+
+    private fun choosePalette() {
+        val palettes = listOf(getString(R.string.palette_dmg), getString(R.string.palette_grayscale))
+        showChoice(R.string.option_palette, palettes) { palette ->
+            setPalette(palette)
+            getSharedPreferences(PREFERENCES, MODE_PRIVATE).edit().putInt(PREF_PALETTE, palette).apply()
+        }
+    }
+
+    private fun chooseRunAhead() {
+        val choices = listOf(getString(R.string.run_ahead_off)) +
+                (1..RUN_AHEAD_MAX_FRAMES).map { resources.getQuantityString(R.plurals.run_ahead_frames, it, it) }
+        showChoice(R.string.option_run_ahead, choices) { frames ->
+            setRunAhead(frames)
+            getSharedPreferences(PREFERENCES, MODE_PRIVATE).edit().putInt(PREF_RUN_AHEAD, frames).apply()
+        }
+    }
+
+    /**
+     * Asks for the button to map to each joypad key in turn. Back ends the mapping.
+     */
+    private fun mapButtons(index: Int = 0) {
+        if (index >= MAPPABLE_KEYS.size) {
+            return
+        }
+        val (name, keys) = MAPPABLE_KEYS[index]
+        setPaused(true)
+        val dialog = AlertDialog.Builder(this)
+                .setTitle(R.string.option_map_buttons)
+                .setMessage(getString(R.string.press_button_for, getString(name)))
+                .setNegativeButton(R.string.skip) { _, _ -> mapButtons(index + 1) }
+                .setOnDismissListener { setPaused(false) }
+                .create()
+        // The release of the button which opened the dialog must not be taken as an answer
+        var pressedKeyCode = KeyEvent.KEYCODE_UNKNOWN
+        dialog.setOnKeyListener { _, keyCode, event ->
+            if (keyCode == KeyEvent.KEYCODE_BACK) {
+                return@setOnKeyListener false
+            }
+            if (event.action == KeyEvent.ACTION_DOWN) {
+                pressedKeyCode = keyCode
+            } else if (event.action == KeyEvent.ACTION_UP && keyCode == pressedKeyCode) {
+                mapKey(keyCode, keys)
+                getSharedPreferences(PREFERENCES, MODE_PRIVATE).edit().putInt(PREF_KEY_PREFIX + keyCode, keys).apply()
+                dialog.dismiss()
+                mapButtons(index + 1)
+            }
+            true
+        }
+        dialog.show()
+    }
+
+    private fun showOptions() {
+        val options = listOf<Pair<Int, () -> Unit>>(
+                R.string.option_save_state to { showChoice(R.string.option_save_state, stateSlots()) { saveSlot(it + 1) } },
+                R.string.option_load_state to { showChoice(R.string.option_load_state, stateSlots()) { loadSlot(it + 1) } },
+                R.string.option_speed to {
+                    showChoice(R.string.option_speed, SPEEDS.map { getString(R.string.speed_factor, it) }) { setSpeed(SPEEDS[it]) }
+                },
+                R.string.option_palette to { choosePalette() },
+                R.string.option_run_ahead to { chooseRunAhead() },
+                R.string.option_map_buttons to { mapButtons() },
+                R.string.option_record_movie to { startRecordingMovie() },
+                R.string.option_play_movie to { pickMovie() },
+                R.string.option_stop_movie to { stopMovie() },
+                R.string.option_screenshot to { takeScreenshotNow() },
+                R.string.option_start_capture to { startCapturing() },
+                R.string.option_stop_capture to { stopCapture() },
+                R.string.option_quit to { finish() }
+        )
+        showChoice(R.string.options_title, options.map { getString(it.first) }) { options[it].second() }
+    }
+
     @Suppress("unused") // Used over JNI
     fun getSavePath(romTitle: String, destinationCode: Int, globalCheckSum: Int): String {
         val saveName = "$romTitle-$destinationCode-$globalCheckSum.sav"
@@ -81,6 +333,13 @@ class FunkyBoyActivity: NativeActivity() {
         return internalSaveFile.absolutePath
     }
 
+    @Suppress("unused") // Used over JNI
+    fun reportROMNotReadable(path: String) {
+        runOnUiThread {
+            Toast.makeText(this, getString(R.string.rom_not_readable_path, path), Toast.LENGTH_LONG).show()
+        }
+    }
+
     @Suppress("unused") // Used over JNI
     fun requestPickRom() {
         if (awaitingPickRomResult) {
@@ -92,22 +351,7 @@ class FunkyBoyActivity: NativeActivity() {
                     arrayOf(Manifest.permission.READ_EXTERNAL_STORAGE),
                     REQUEST_CODE_ASK_READ_STORAGE_PERMISSIONS)
         } else {
-            pickRom()
-        }
-    }
-
-    private fun loadBitmapFromResources(resId: Int): Bitmap {
-        val options = BitmapFactory.Options()
-        options.inScaled = false
-        return BitmapFactory.decodeResource(resources, resId, options)
-    }
-
-    @Suppress("unused") // Used over JNI
-    fun loadBitmap(type: Int): Bitmap? {
-        return when (type) {
-            0 -> loadBitmapFromResources(R.drawable.buttons)
-            1 -> loadBitmapFromResources(R.drawable.font)
-            else -> null
+            showLibrary()
         }
     }
 
@@ -123,16 +367,18 @@ class FunkyBoyActivity: NativeActivity() {
             if (resultCode == RESULT_OK) {
                 val filePath = data?.getStringExtra(FilePickerActivity.RESULT_FILE_PATH)
                 if (filePath != null) {
-                    romPicked(filePath)
+                    checkPathAccepted(romPicked(filePath), filePath)
                 }
             }
+        } else if (requestCode == REQUEST_CODE_PICK_MOVIE && resultCode == RESULT_OK) {
+            data?.getStringExtra(FilePickerActivity.RESULT_FILE_PATH)?.let { checkPathAccepted(playMovie(it), it) }
         }
     }
 
     override fun onRequestPermissionsResult(requestCode: Int, permissions: Array<out String>, grantResults: IntArray) {
         if (requestCode == REQUEST_CODE_ASK_READ_STORAGE_PERMISSIONS) {
             if (grantResults[0] == PackageManager.PERMISSION_GRANTED) {
-                pickRom()
+                showLibrary()
             } else {
                 awaitingPickRomResult = false
             }
@@ -140,14 +386,8 @@ class FunkyBoyActivity: NativeActivity() {
     }
 
     override fun onBackPressed() {
-        val now = System.currentTimeMillis()
-        if (now - lastBackPressed > 2000L) {
-            lastBackPressed = now
-            val text = getString(R.string.confirm_back, getString(R.string.app_name))
-            Toast.makeText(this, text, Toast.LENGTH_SHORT).show()
-        } else {
-            super.onBackPressed()
-        }
+        // Closing the app is one of the options, so it still takes a second confirmation
+        showOptions()
     }
 
 }
\ No newline at end of file
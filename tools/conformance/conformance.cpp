@@ -0,0 +1,331 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Headless conformance and regression runner for the emulator core.
+ *
+ * Runs a corpus of test ROMs in parallel, each in its own session with a hashing display and null
+ * audio. A ROM finishes when it reports a result over the serial port (blargg prints "Passed" or
+ * "Failed", mooneye sends the Fibonacci sequence 3, 5, 8, 13, 21, 34 or six 0x42 bytes) or when the
+ * frame limit is reached. The final frame hash can be compared against a baseline to catch
+ * regressions in ROMs which do not report over the serial port.
+ */
+
+#include <fba_util/session.h>
+#include <util/work_stealing_pool.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+#define FB_CONFORMANCE_DEFAULT_FRAMES 3600
+#define FB_CONFORMANCE_SERIAL_BUFFER_SIZE 4096
+
+namespace {
+
+    enum class Status {
+        Passed,
+        Failed,
+        Finished,
+        TimedOut,
+        Regressed,
+        Error,
+    };
+
+    const char *statusName(Status status) {
+        switch (status) {
+            case Status::Passed: return "PASS";
+            case Status::Failed: return "FAIL";
+            case Status::Finished: return "DONE";
+            case Status::TimedOut: return "TIMEOUT";
+            case Status::Regressed: return "REGRESS";
+            default: return "ERROR";
+        }
+    }
+
+    /**
+     * Records the bytes a test ROM sends over the serial port.
+     */
+    class SerialCapture: public FunkyBoy::Controller::SerialController {
+    private:
+        std::string output;
+
+    public:
+        void sendByte(FunkyBoy::u8 data) override {
+            if (output.size() < FB_CONFORMANCE_SERIAL_BUFFER_SIZE) {
+                output.push_back(static_cast<char>(data));
+            }
+        }
+
+        inline const std::string &getOutput() const {
+            return output;
+        }
+
+        /**
+         * @return true as soon as the ROM has reported its result, which is then stored in status
+         */
+        bool checkResult(Status &status) const {
+            static const char mooneyePass[] = {3, 5, 8, 13, 21, 34};
+            static const char mooneyeFail[] = {0x42, 0x42, 0x42, 0x42, 0x42, 0x42};
+            if (output.find("Passed") != std::string::npos
+                    || output.find(std::string(mooneyePass, sizeof(mooneyePass))) != std::string::npos) {
+                status = Status::Passed;
+                return true;
+            }
+            if (output.find("Failed") != std::string::npos
+                    || output.find(std::string(mooneyeFail, sizeof(mooneyeFail))) != std::string::npos) {
+                status = Status::Failed;
+                return true;
+            }
+            return false;
+        }
+    };
+
+    struct baseline_entry {
+        uint32_t frames;
+        uint64_t hash;
+    };
+
+    struct job {
+        std::string path;
+        std::string name;
+
+        Status status;
+        uint32_t frames;
+        uint64_t hash;
+        double elapsedMs;
+        std::string serialOutput;
+    };
+
+    struct options {
+        uint32_t frameLimit = FB_CONFORMANCE_DEFAULT_FRAMES;
+        size_t threads = 0;
+        std::string baselinePath;
+        bool updateBaseline = false;
+        bool verbose = false;
+        std::vector<std::string> inputs;
+    };
+
+    bool isROM(const std::filesystem::path &path) {
+        std::string extension = path.extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+        return extension == ".gb" || extension == ".gbc" || extension == ".zip" || extension == ".gz";
+    }
+
+    void collectJobs(const std::string &input, std::vector<job> &jobs) {
+        namespace fs = std::filesystem;
+        fs::path root(input);
+        if (fs::is_directory(root)) {
+            for (auto &entry : fs::recursive_directory_iterator(root)) {
+                if (entry.is_regular_file() && isROM(entry.path())) {
+                    jobs.push_back(job{entry.path().string(), fs::relative(entry.path(), root).string()});
+                }
+            }
+        } else {
+            jobs.push_back(job{root.string(), root.filename().string()});
+        }
+    }
+
+    void runJob(job &j, const options &opts) {
+        auto start = std::chrono::steady_clock::now();
+
+        FunkyBoyAndroid::Session session;
+        auto serial = std::make_shared<SerialCapture>();
+        session.setSerial(serial);
+
+        j.frames = 0;
+        j.hash = 0;
+        if (session.loadROM(j.path.c_str()) != FunkyBoy::CartridgeStatus::Loaded) {
+            j.status = Status::Error;
+            j.serialOutput = "ROM could not be loaded";
+        } else {
+            j.status = Status::TimedOut;
+            while (j.frames < opts.frameLimit) {
+                session.runFrame();
+                j.frames++;
+                if (serial->checkResult(j.status)) {
+                    break;
+                }
+            }
+            j.hash = session.getHeadlessDisplay().getFrameHash();
+            j.serialOutput = serial->getOutput();
+        }
+
+        j.elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    std::map<std::string, baseline_entry> readBaseline(const std::string &path) {
+        std::map<std::string, baseline_entry> baseline;
+        std::ifstream file(path);
+        std::string line;
+        while (std::getline(file, line)) {
+            if (line.empty() || line[0] == '#') {
+                continue;
+            }
+            // <frames> <hash> <name>, the name may contain spaces
+            unsigned int frames;
+            unsigned long long hash;
+            int nameOffset;
+            if (std::sscanf(line.c_str(), "%u %llx %n", &frames, &hash, &nameOffset) == 2) {
+                baseline[line.substr(nameOffset)] = baseline_entry{frames, hash};
+            }
+        }
+        return baseline;
+    }
+
+    bool writeBaseline(const std::string &path, const std::vector<job> &jobs) {
+        std::ofstream file(path, std::ios::out | std::ios::trunc);
+        file << "# <frames> <final frame hash> <ROM>, written by fb_conformance --update" << std::endl;
+        char line[64];
+        for (auto &j : jobs) {
+            if (j.status == Status::Error) {
+                continue;
+            }
+            std::snprintf(line, sizeof(line), "%u %016" PRIx64 " ", j.frames, j.hash);
+            file << line << j.name << std::endl;
+        }
+        return file.good();
+    }
+
+    void printSerialOutput(const std::string &output) {
+        std::string printable;
+        for (char c : output) {
+            printable.push_back(c == '\n' || (c >= 0x20 && c < 0x7f) ? c : '.');
+        }
+        std::printf("    %s\n", printable.c_str());
+    }
+
+    void printUsage(const char *program) {
+        std::fprintf(stderr,
+                "Usage: %s [options] <ROM or directory>...\n"
+                "  -f, --frames <n>       frame limit per ROM (default %d)\n"
+                "  -j, --jobs <n>         worker threads (default: all cores)\n"
+                "  -b, --baseline <file>  compare the final frame hashes against a baseline\n"
+                "  -u, --update           write the final frame hashes to the baseline instead\n"
+                "  -v, --verbose          print the serial output of failing ROMs\n",
+                program, FB_CONFORMANCE_DEFAULT_FRAMES);
+    }
+
+    bool parseOptions(int argc, char **argv, options &opts) {
+        for (int i = 1 ; i < argc ; i++) {
+            std::string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+            if ((arg == "-f" || arg == "--frames") && hasValue) {
+                opts.frameLimit = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+            } else if ((arg == "-j" || arg == "--jobs") && hasValue) {
+                opts.threads = std::strtoul(argv[++i], nullptr, 10);
+            } else if ((arg == "-b" || arg == "--baseline") && hasValue) {
+                opts.baselinePath = argv[++i];
+            } else if (arg == "-u" || arg == "--update") {
+                opts.updateBaseline = true;
+            } else if (arg == "-v" || arg == "--verbose") {
+                opts.verbose = true;
+            } else if (!arg.empty() && arg[0] == '-') {
+                return false;
+            } else {
+                opts.inputs.push_back(arg);
+            }
+        }
+        return !opts.inputs.empty() && (!opts.updateBaseline || !opts.baselinePath.empty());
+    }
+
+}
+
+int main(int argc, char **argv) {
+    options opts;
+    if (!parseOptions(argc, argv, opts)) {
+        printUsage(argv[0]);
+        return 2;
+    }
+
+    std::vector<job> jobs;
+    for (auto &input : opts.inputs) {
+        collectJobs(input, jobs);
+    }
+    std::sort(jobs.begin(), jobs.end(), [](const job &a, const job &b) {
+        return a.name < b.name;
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    size_t threads;
+    {
+        FunkyBoyAndroid::Util::WorkStealingPool pool(opts.threads);
+        threads = pool.size();
+        for (auto &j : jobs) {
+            pool.push([&j, &opts](FunkyBoyAndroid::Util::WorkStealingPool &, size_t) {
+                runJob(j, opts);
+            });
+        }
+        pool.wait();
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (!opts.baselinePath.empty() && !opts.updateBaseline) {
+        auto baseline = readBaseline(opts.baselinePath);
+        for (auto &j : jobs) {
+            auto entry = baseline.find(j.name);
+            if (j.status == Status::Error || entry == baseline.end()) {
+                continue;
+            }
+            if (entry->second.frames != j.frames || entry->second.hash != j.hash) {
+                j.status = Status::Regressed;
+            } else if (j.status == Status::TimedOut) {
+                // Ran to the frame limit and ended up on the expected frame
+                j.status = Status::Finished;
+            }
+        }
+    }
+
+    std::map<Status, size_t> counts;
+    uint64_t totalFrames = 0;
+    std::printf("%-8s %8s %-16s %10s  %s\n", "STATUS", "FRAMES", "HASH", "FRAMES/S", "ROM");
+    for (auto &j : jobs) {
+        counts[j.status]++;
+        totalFrames += j.frames;
+        double fps = j.elapsedMs > 0.0 ? j.frames * 1000.0 / j.elapsedMs : 0.0;
+        std::printf("%-8s %8u %016" PRIx64 " %10.0f  %s\n", statusName(j.status), j.frames, j.hash, fps, j.name.c_str());
+        if (opts.verbose && (j.status == Status::Failed || j.status == Status::Error) && !j.serialOutput.empty()) {
+            printSerialOutput(j.serialOutput);
+        }
+    }
+    std::printf("\n%zu ROMs in %.2f s on %zu threads (%.0f frames/s overall): %zu passed, %zu failed, %zu finished, %zu timed out, %zu regressed, %zu errors\n",
+            jobs.size(), elapsed, threads, elapsed > 0.0 ? totalFrames / elapsed : 0.0,
+            counts[Status::Passed], counts[Status::Failed], counts[Status::Finished],
+            counts[Status::TimedOut], counts[Status::Regressed], counts[Status::Error]);
+
+    if (opts.updateBaseline) {
+        if (!writeBaseline(opts.baselinePath, jobs)) {
+            std::fprintf(stderr, "Unable to write baseline %s\n", opts.baselinePath.c_str());
+            return 1;
+        }
+        std::printf("Baseline written to %s\n", opts.baselinePath.c_str());
+        return counts[Status::Error] > 0 ? 1 : 0;
+    }
+    if (counts[Status::Passed] + counts[Status::Finished] == 0) {
+        // Nothing has been verified, e.g. all ROMs timed out without a baseline to compare against
+        std::fprintf(stderr, "No ROM reached its pass condition\n");
+        return 1;
+    }
+    return counts[Status::Failed] + counts[Status::Regressed] + counts[Status::Error] > 0 ? 1 : 0;
+}
@@ -0,0 +1,206 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Rollback netplay test.
+ *
+ * Runs two peers of a rollback netplay session in the same process, connected by a loopback
+ * transport with delay, jitter and loss, while both players change their input every few frames.
+ * The remote input is thereby mispredicted over and over. Fails unless both peers end up with the
+ * same state for every confirmed frame, rollbacks actually happened, and every re-simulated frame
+ * was muted.
+ */
+
+#include <netplay/loopback_transport.h>
+#include <netplay/rollback.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+// Frames of changing input, followed by idle frames until all of it has been confirmed
+#define FB_NETPLAY_TEST_FRAMES 600
+#define FB_NETPLAY_TEST_TIMEOUT_S 60
+
+#define FB_NETPLAY_TEST_SNAPSHOT_SIZE 64
+
+using namespace FunkyBoyAndroid;
+using namespace FunkyBoyAndroid::Netplay;
+
+namespace {
+
+    inline uint64_t mix(uint64_t value) {
+        value ^= value >> 33u;
+        value *= 0xff51afd7ed558ccdull;
+        value ^= value >> 33u;
+        return value;
+    }
+
+    uint8_t inputOf(int player, uint32_t frame) {
+        if (frame >= FB_NETPLAY_TEST_FRAMES) {
+            return 0;
+        }
+        // Held for a few frames, like buttons pressed by a player
+        return static_cast<uint8_t>(mix((static_cast<uint64_t>(player) << 32u) | (frame / 5)));
+    }
+
+    /**
+     * Both consoles reduced to a hash over all input simulated so far, which diverges on any
+     * misprediction that has not been rolled back.
+     */
+    class HashSimulation: public Simulation {
+    private:
+        uint32_t frame;
+        uint64_t hash;
+        uint8_t keys[2];
+        bool muted;
+
+    public:
+        // State after each frame, as last simulated
+        std::vector<uint64_t> history;
+        uint64_t steps;
+        uint64_t mutedSteps;
+
+        HashSimulation()
+            : frame(0)
+            , hash(0)
+            , keys{}
+            , muted(false)
+            , steps(0)
+            , mutedSteps(0)
+        {
+        }
+
+        void setInput(int player, uint8_t k) override {
+            keys[player] = k;
+        }
+
+        void stepFrame() override {
+            hash = mix(hash ^ (static_cast<uint64_t>(keys[0]) << 8u) ^ keys[1] ^ (static_cast<uint64_t>(frame) << 16u));
+            if (history.size() <= frame) {
+                history.resize(frame + 1);
+            }
+            history[frame++] = hash;
+            steps++;
+            if (muted) {
+                mutedSteps++;
+            }
+        }
+
+        void saveState(std::ostream &ostream) override {
+            ostream.write(reinterpret_cast<const char *>(&frame), sizeof(frame));
+            ostream.write(reinterpret_cast<const char *>(&hash), sizeof(hash));
+        }
+
+        bool loadState(std::istream &istream) override {
+            istream.read(reinterpret_cast<char *>(&frame), sizeof(frame));
+            istream.read(reinterpret_cast<char *>(&hash), sizeof(hash));
+            return istream.good();
+        }
+
+        void setMuted(bool m) override {
+            muted = m;
+        }
+
+        inline bool isMuted() const {
+            return muted;
+        }
+    };
+
+    struct peer {
+        const char *name;
+        HashSimulation simulation;
+        Util::Arena arena;
+        std::unique_ptr<LoopbackTransport> transport;
+        RollbackNetplay netplay;
+        int player;
+
+        peer(const char *name, std::unique_ptr<LoopbackTransport> t, int player)
+            : name(name)
+            , arena(FB_ANDROID_NETPLAY_MAX_ROLLBACK * FB_NETPLAY_TEST_SNAPSHOT_SIZE)
+            , transport(std::move(t))
+            , netplay(simulation, *transport, arena, FB_NETPLAY_TEST_SNAPSHOT_SIZE, player)
+            , player(player)
+        {
+        }
+
+        bool advance() {
+            netplay.advance(inputOf(player, netplay.getFrame()));
+            if (simulation.isMuted()) {
+                std::printf("FAIL %s: audio still muted after frame %u\n", name, netplay.getFrame());
+                return false;
+            }
+            return !netplay.hasFailed();
+        }
+    };
+
+    bool check(const peer &p) {
+        const netplay_stats &stats = p.netplay.getStats();
+        std::printf("%s: %llu frames, %llu stalls, %llu rollbacks re-simulating %llu frames (at most %u at once)\n", p.name,
+                static_cast<unsigned long long>(stats.frames), static_cast<unsigned long long>(stats.stalls),
+                static_cast<unsigned long long>(stats.rollbacks), static_cast<unsigned long long>(stats.rolledBackFrames),
+                stats.longestRollback);
+        bool ok = true;
+        if (stats.rollbacks == 0) {
+            std::printf("FAIL %s: no input was mispredicted\n", p.name);
+            ok = false;
+        }
+        if (p.simulation.mutedSteps != stats.rolledBackFrames) {
+            std::printf("FAIL %s: %llu of %llu re-simulated frames were muted\n", p.name,
+                    static_cast<unsigned long long>(p.simulation.mutedSteps), static_cast<unsigned long long>(stats.rolledBackFrames));
+            ok = false;
+        }
+        if (p.simulation.steps != stats.frames + stats.rolledBackFrames) {
+            std::printf("FAIL %s: %llu frames simulated, expected %llu\n", p.name,
+                    static_cast<unsigned long long>(p.simulation.steps), static_cast<unsigned long long>(stats.frames + stats.rolledBackFrames));
+            ok = false;
+        }
+        return ok;
+    }
+
+}
+
+int main() {
+    auto transports = LoopbackTransport::createPair({20, 10, 10}, 1234);
+    peer a("Peer 0", std::move(transports.first), 0);
+    peer b("Peer 1", std::move(transports.second), 1);
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(FB_NETPLAY_TEST_TIMEOUT_S);
+    while (a.netplay.getConfirmedFrame() < FB_NETPLAY_TEST_FRAMES || b.netplay.getConfirmedFrame() < FB_NETPLAY_TEST_FRAMES) {
+        if (!a.advance() || !b.advance()) {
+            std::printf("FAIL the session has ended\n");
+            return EXIT_FAILURE;
+        }
+        if (std::chrono::steady_clock::now() > deadline) {
+            std::printf("FAIL only frames up to %u and %u were confirmed after %d s\n", a.netplay.getConfirmedFrame(),
+                    b.netplay.getConfirmedFrame(), FB_NETPLAY_TEST_TIMEOUT_S);
+            return EXIT_FAILURE;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    bool ok = check(a) & check(b);
+    for (uint32_t frame = 0 ; frame < FB_NETPLAY_TEST_FRAMES ; frame++) {
+        if (a.simulation.history[frame] != b.simulation.history[frame]) {
+            std::printf("FAIL both peers diverge at frame %u\n", frame);
+            ok = false;
+            break;
+        }
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,187 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Frame pacing simulator.
+ *
+ * Drives the frame pacer of the app with simulated displays of common refresh rates, including
+ * timestamp jitter, missed vsyncs and a refresh rate switch, and prints the resulting cadence and
+ * judder with and without locking to vsync. Fails if the pacer does not settle on the expected
+ * cadence, drifts from the emulation speed it chose, or judders more when locked than without.
+ */
+
+#include <engine/frame_pacer.h>
+#include <engine/simulated_vsync.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Simulated seconds per scenario
+#define FB_PACING_SIM_SECONDS 120
+
+// Timestamp jitter of +/- 0.3 ms and 0.2% missed vsyncs, as seen on loaded devices
+#define FB_PACING_SIM_JITTER_NS 300000
+#define FB_PACING_SIM_MISS_RATE 0.002
+
+// Largest speed adjustment of a locked cadence, and tolerated deviation of the emulated time
+#define FB_PACING_SIM_MAX_SPEED_ERROR 0.01
+#define FB_PACING_SIM_MAX_DRIFT_ERROR 0.001
+
+using namespace FunkyBoyAndroid::Engine;
+
+namespace {
+
+    struct scenario {
+        const char *name;
+        double refreshRate;
+        // Refresh rate the display switches to half way through, or 0
+        double switchRate;
+        // Expected cadence when locking to vsync, 0:0 if no cadence is close enough
+        uint32_t cadenceFrames;
+        uint32_t cadenceVsyncs;
+    };
+
+    const scenario scenarios[] = {
+            {"60 Hz", 60.0, 0.0, 1, 1},
+            {"59.94 Hz", 59.94, 0.0, 1, 1},
+            {"90 Hz", 90.0, 0.0, 2, 3},
+            {"120 Hz", 120.0, 0.0, 1, 2},
+            {"144 Hz", 144.0, 0.0, 0, 0},
+            {"120 -> 60 Hz", 120.0, 60.0, 1, 1},
+    };
+
+    const char *modeNames[] = {
+            "estimating",
+            "locked",
+            "real time",
+    };
+
+    struct simulation {
+        SimulatedVsync vsync;
+        FramePacer pacer;
+        uint64_t emulatedFrames;
+    };
+
+    void onVsync(int64_t vsyncNs, void *data) {
+        auto *sim = static_cast<simulation *>(data);
+        sim->emulatedFrames += sim->pacer.onVsync(vsyncNs);
+        sim->vsync.request(onVsync, sim);
+    }
+
+    int64_t toPeriod(double refreshRate) {
+        return static_cast<int64_t>(1e9 / refreshRate);
+    }
+
+    struct result {
+        pacing_stats stats;
+        double drift;
+    };
+
+    result run(const scenario &s, bool locking) {
+        simulation sim{
+                SimulatedVsync(toPeriod(s.refreshRate), FB_PACING_SIM_JITTER_NS, FB_PACING_SIM_MISS_RATE, 42),
+                FramePacer(),
+                0,
+        };
+        sim.pacer.setVsyncLocking(locking);
+        sim.vsync.request(onVsync, &sim);
+
+        const int64_t duration = static_cast<int64_t>(FB_PACING_SIM_SECONDS) * 1000000000;
+        bool switched = s.switchRate <= 0.0;
+        while (sim.vsync.now() < duration) {
+            if (!switched && sim.vsync.now() >= duration / 2) {
+                sim.vsync.setPeriod(toPeriod(s.switchRate));
+                // Only the statistics of the new rate are of interest
+                sim.pacer.resetStats();
+                switched = true;
+            }
+            // The estimate has settled after the first second
+            if (sim.vsync.now() < 1000000000 && sim.vsync.now() + toPeriod(s.refreshRate) >= 1000000000) {
+                sim.pacer.resetStats();
+            }
+            sim.vsync.tick();
+        }
+
+        auto stats = sim.pacer.getStats();
+        double emulatedSeconds = static_cast<double>(sim.emulatedFrames) * FB_ANDROID_GB_FRAME_NS / 1e9;
+        double drift = emulatedSeconds / (static_cast<double>(sim.vsync.now()) / 1e9) - 1.0;
+        std::printf("%-14s %-8s %-10s %8.2f Hz  %u:%u  speed %.4f  judder %6.3f ms  long %6llu  skipped %5llu  drift %+6.2f%%\n",
+                    s.name, locking ? "lock" : "realtime", modeNames[static_cast<int>(stats.mode)],
+                    1e9 / static_cast<double>(stats.displayPeriodNs), stats.cadenceFrames, stats.cadenceVsyncs,
+                    stats.speed, stats.judderMs,
+                    static_cast<unsigned long long>(stats.longFrames),
+                    static_cast<unsigned long long>(stats.skippedFrames),
+                    drift * 100.0);
+        return {stats, drift};
+    }
+
+    /**
+     * @return false if the pacer did not behave as expected for the given scenario
+     */
+    bool check(const scenario &s, bool locking, const result &r) {
+        bool ok = true;
+        PacingMode expectedMode = locking && s.cadenceFrames > 0 ? PacingMode::VsyncLocked : PacingMode::RealTime;
+        if (r.stats.mode != expectedMode) {
+            std::printf("FAIL %s: ended up %s instead of %s\n", s.name,
+                        modeNames[static_cast<int>(r.stats.mode)], modeNames[static_cast<int>(expectedMode)]);
+            ok = false;
+        }
+        if (expectedMode == PacingMode::VsyncLocked
+                && (r.stats.cadenceFrames != s.cadenceFrames || r.stats.cadenceVsyncs != s.cadenceVsyncs)) {
+            std::printf("FAIL %s: locked to %u:%u instead of %u:%u\n", s.name,
+                        r.stats.cadenceFrames, r.stats.cadenceVsyncs, s.cadenceFrames, s.cadenceVsyncs);
+            ok = false;
+        }
+        if (std::fabs(r.stats.speed - 1.0) > FB_PACING_SIM_MAX_SPEED_ERROR) {
+            std::printf("FAIL %s: speed %.4f is off by more than %.0f%%\n", s.name, r.stats.speed,
+                        FB_PACING_SIM_MAX_SPEED_ERROR * 100.0);
+            ok = false;
+        }
+        // Emulated time has to advance at the chosen speed, without frames getting lost or doubled
+        if (std::fabs(r.drift - (r.stats.speed - 1.0)) > FB_PACING_SIM_MAX_DRIFT_ERROR) {
+            std::printf("FAIL %s: emulated time drifts by %+.2f%% at speed %.4f\n", s.name, r.drift * 100.0,
+                        r.stats.speed);
+            ok = false;
+        }
+        return ok;
+    }
+
+}
+
+int main(int argc, char **argv) {
+    bool compare = argc > 1 && std::strcmp(argv[1], "-c") == 0;
+    if (argc > 1 && !compare) {
+        std::fprintf(stderr, "Usage: %s [-c]\n  -c  Also run every scenario with pure real time pacing\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    bool ok = true;
+    for (const auto &s : scenarios) {
+        result locked = run(s, true);
+        ok &= check(s, true, locked);
+        if (compare) {
+            result realTime = run(s, false);
+            ok &= check(s, false, realTime);
+            if (locked.stats.judderMs > realTime.stats.judderMs) {
+                std::printf("FAIL %s: judder of %.3f ms when locked exceeds %.3f ms in real time\n", s.name,
+                            locked.stats.judderMs, realTime.stats.judderMs);
+                ok = false;
+            }
+        }
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
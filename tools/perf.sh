@@ -0,0 +1,124 @@
+#!/bin/sh
+#
+# Collects PGO profiles for, and benchmarks the options of, the performance build type on a
+# connected device.
+#
+# Both commands replay movies headlessly and as fast as possible, which only the performance and
+# pgoInstrumented build types accept. Movies are recorded on the device with any build: press back
+# while a game runs and choose "Record movie", play for a while, then "Stop movie". Movies are
+# passed as device paths, "movies" lists the recorded ones.
+#
+# Usage:
+#   tools/perf.sh movies                 Lists the movies recorded on the device
+#   tools/perf.sh profile <movie>...     Collects app/src/main/cpp/pgo/fb_android.profdata
+#   tools/perf.sh benchmark <movie>...   Compares the replay throughput of each build option
+#
+# The benchmark prints one line per option, each adding to the one above, with the average
+# headless replay frames per second and the change relative to the plain release options:
+#   release                  <fps> frames/s   +0.0 %
+#   + -O3 and ABI flags      <fps> frames/s   <change> %
+#   + ThinLTO                <fps> frames/s   <change> %
+#   + PGO                    <fps> frames/s   <change> %
+# and appends them to build/perf/benchmark.txt along with the device model and the movies, so that
+# results of several devices can be collected and compared.
+#
+
+set -e
+
+PACKAGE=lu.kremi151.funkyboy
+PGO_DEVICE_DIR=/sdcard/Android/data/$PACKAGE/files/pgo
+MOVIE_DEVICE_DIR=/sdcard/Android/data/$PACKAGE/files/movies
+BENCHMARK_LOG=build/perf/benchmark.txt
+PROFDATA=app/src/main/cpp/pgo/fb_android.profdata
+
+cd "$(dirname "$0")/.."
+
+install_variant() {
+    variant=$1
+    shift
+    task=$(printf %s "$variant" | cut -c1 | tr a-z A-Z)$(printf %s "$variant" | cut -c2-)
+    ./gradlew -q "assemble$task" "$@"
+    adb install -r "app/build/outputs/apk/$variant/app-$variant.apk" > /dev/null
+}
+
+# Prints the frames per second of a headless replay
+replay() {
+    adb shell rm -f "$1.result"
+    adb shell am start -S -n "$PACKAGE/.FunkyBoyActivity" --es "$PACKAGE.VERIFY_MOVIE" "$1" > /dev/null
+    until adb shell cat "$1.result" 2> /dev/null | grep -q divergences; do
+        sleep 1
+    done
+    result=$(adb shell cat "$1.result")
+    case "$result" in
+        *divergences=0*) ;;
+        *) echo "Warning: replay of $1 diverged from the recording" >&2 ;;
+    esac
+    echo "$result" | sed 's/.*fps=\([0-9.]*\).*/\1/'
+}
+
+profile() {
+    if [ -z "$LLVM_PROFDATA" ]; then
+        LLVM_PROFDATA=$(ls "$ANDROID_NDK_HOME"/toolchains/llvm/prebuilt/*/bin/llvm-profdata | head -n 1)
+    fi
+    install_variant pgoInstrumented
+    adb shell rm -rf "$PGO_DEVICE_DIR"
+    for movie in "$@"; do
+        echo "Profiling $movie: $(replay "$movie") frames/s"
+    done
+    rm -rf build/pgo
+    mkdir -p build/pgo "$(dirname "$PROFDATA")"
+    adb pull "$PGO_DEVICE_DIR" build/pgo > /dev/null
+    "$LLVM_PROFDATA" merge -o "$PROFDATA" build/pgo/pgo/*.profraw
+    echo "Profile written to $PROFDATA"
+}
+
+# Prints the average frames per second over all movies
+measure() {
+    total=0
+    for movie in $MOVIES; do
+        total=$(echo "$total + $(replay "$movie")" | bc -l)
+    done
+    echo "$total / $(echo $MOVIES | wc -w)" | bc -l
+}
+
+benchmark_option() {
+    name=$1
+    shift
+    install_variant performance "$@"
+    fps=$(measure)
+    if [ -z "$BASELINE" ]; then
+        BASELINE=$fps
+    fi
+    printf "%-24s %10.1f frames/s %+8.1f %%\n" "$name" "$fps" "$(echo "($fps / $BASELINE - 1) * 100" | bc -l)" | tee -a "$BENCHMARK_LOG"
+}
+
+benchmark() {
+    MOVIES="$*"
+    BASELINE=
+    mkdir -p "$(dirname "$BENCHMARK_LOG")"
+    echo "# $(date -u +%Y-%m-%dT%H:%MZ) $(adb shell getprop ro.product.model | tr -d '\r') ($(adb shell getprop ro.product.cpu.abi | tr -d '\r')): $MOVIES" >> "$BENCHMARK_LOG"
+    benchmark_option "release" -PfbOptimize=false -PfbLto=false -PfbPgo=false
+    benchmark_option "+ -O3 and ABI flags" -PfbLto=false -PfbPgo=false
+    benchmark_option "+ ThinLTO" -PfbPgo=false
+    if [ -f "$PROFDATA" ]; then
+        benchmark_option "+ PGO"
+    else
+        echo "No PGO profile found, run tools/perf.sh profile first"
+    fi
+}
+
+command=$1
+if [ "$command" = movies ]; then
+    adb shell ls "$MOVIE_DEVICE_DIR/*.fbm"
+    exit 0
+fi
+if [ $# -lt 2 ]; then
+    sed -n '2,24p' "$0" | sed 's/^# \{0,1\}//'
+    exit 1
+fi
+shift
+case "$command" in
+    profile) profile "$@" ;;
+    benchmark) benchmark "$@" ;;
+    *) echo "Unknown command $command" >&2; exit 1 ;;
+esac
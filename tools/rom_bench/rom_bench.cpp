@@ -0,0 +1,131 @@
+/**
+ * Copyright 2021 Michel Kremer (kremi151)
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * ROM load benchmark.
+ *
+ * Compares loading a compressed ROM the way the app does, by inflating it into a memfd which the
+ * core then reads through /proc/self/fd, against reading the plain ROM file. The inflated ROM is
+ * checked against the plain one, so a mismatch fails the run. Files are read once beforehand, so
+ * both paths are measured from the page cache.
+ */
+
+#include <fba_util/rom_archive.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#define FB_ROM_BENCH_DEFAULT_ITERATIONS 50
+
+namespace {
+
+    typedef std::chrono::steady_clock clock;
+
+    struct sample {
+        double inflateUs;
+        double loadUs;
+    };
+
+    // Reads the whole file like the core does when loading a ROM
+    bool readFile(const std::string &path, std::vector<char> &content) {
+        std::ifstream file(path, std::ios::binary | std::ios::in);
+        if (!file.is_open()) {
+            return false;
+        }
+        content.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        return true;
+    }
+
+    double median(std::vector<double> values) {
+        std::sort(values.begin(), values.end());
+        return values[values.size() / 2];
+    }
+
+    double throughput(size_t bytes, double us) {
+        return us > 0.0 ? (static_cast<double>(bytes) / 1048576.0) / (us / 1000000.0) : 0.0;
+    }
+
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        std::fprintf(stderr, "Usage: %s <archive> <plain ROM> [iterations]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    const char *archivePath = argv[1];
+    const char *plainPath = argv[2];
+    int iterations = argc > 3 ? std::atoi(argv[3]) : FB_ROM_BENCH_DEFAULT_ITERATIONS;
+    if (iterations <= 0) {
+        std::fprintf(stderr, "Invalid amount of iterations: %s\n", argv[3]);
+        return EXIT_FAILURE;
+    }
+
+    std::vector<char> plain;
+    std::vector<char> archive;
+    if (!readFile(plainPath, plain) || !readFile(archivePath, archive)) {
+        std::fprintf(stderr, "Unable to read %s or %s\n", plainPath, archivePath);
+        return EXIT_FAILURE;
+    }
+    if (!FunkyBoyAndroid::ROMArchive::isCompressed(archivePath)) {
+        std::fprintf(stderr, "%s is neither a zip archive nor a gzip stream\n", archivePath);
+        return EXIT_FAILURE;
+    }
+
+    std::vector<double> plainUs;
+    std::vector<double> inflateUs;
+    std::vector<double> compressedUs;
+    std::vector<char> content;
+    for (int i = 0 ; i < iterations ; i++) {
+        auto start = clock::now();
+        readFile(plainPath, content);
+        plainUs.push_back(std::chrono::duration<double, std::micro>(clock::now() - start).count());
+
+        start = clock::now();
+        size_t romSize;
+        int fd = FunkyBoyAndroid::ROMArchive::inflateToMemoryFile(archivePath, romSize);
+        auto inflated = clock::now();
+        if (fd < 0) {
+            std::fprintf(stderr, "Unable to inflate %s\n", archivePath);
+            return EXIT_FAILURE;
+        }
+        bool read = readFile(FunkyBoyAndroid::ROMArchive::fdPath(fd), content);
+        auto loaded = clock::now();
+        close(fd);
+        if (!read || content != plain) {
+            std::fprintf(stderr, "Inflated ROM differs from %s\n", plainPath);
+            return EXIT_FAILURE;
+        }
+        inflateUs.push_back(std::chrono::duration<double, std::micro>(inflated - start).count());
+        compressedUs.push_back(std::chrono::duration<double, std::micro>(loaded - start).count());
+    }
+
+    double plainMedian = median(plainUs);
+    double inflateMedian = median(inflateUs);
+    double compressedMedian = median(compressedUs);
+    std::printf("ROM: %zu bytes, archive: %zu bytes, %d iterations, medians:\n", plain.size(), archive.size(), iterations);
+    std::printf("  plain load       %10.1f us  %8.1f MiB/s\n", plainMedian, throughput(plain.size(), plainMedian));
+    std::printf("  inflate          %10.1f us  %8.1f MiB/s\n", inflateMedian, throughput(plain.size(), inflateMedian));
+    std::printf("  compressed load  %10.1f us  %8.1f MiB/s  %+.1f us over plain\n", compressedMedian,
+                throughput(plain.size(), compressedMedian), compressedMedian - plainMedian);
+    return EXIT_SUCCESS;
+}